@@ -0,0 +1,89 @@
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "arena.h"
+
+#define ARENA_ALIGN 16
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+
+struct ArenaBlock {
+  struct ArenaBlock* next;
+  size_t size;
+  size_t used;
+  alignas(ARENA_ALIGN) unsigned char data[];
+};
+
+static _Thread_local Arena worker_arena;
+static _Thread_local bool worker_arena_ready = false;
+
+static ArenaBlock* block_create(size_t size) {
+  ArenaBlock* block = malloc(sizeof(ArenaBlock) + size);
+  if (block == NULL) return NULL;
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+  return block;
+}
+
+void arena_init(Arena* arena, size_t block_size) {
+  arena->head = NULL;
+  arena->block_size = block_size;
+  arena->base_size = block_size;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+  ArenaBlock* block = arena->head;
+  if (block == NULL || block->size - block->used < size) {
+    // 느린 경로: 예열 중이거나 평소보다 큰 묶음일 때만 온다
+    block = block_create(size > arena->block_size ? size : arena->block_size);
+    if (block == NULL) return NULL;
+    block->next = arena->head;
+    arena->head = block;
+  }
+
+  void* ptr = block->data + block->used;
+  block->used += size;
+  return ptr;
+}
+
+void arena_reset(Arena* arena) {
+  ArenaBlock* block = arena->head;
+  if (block == NULL) return;
+  if (block->next == NULL && block->size <= ARENA_MAX_RETAINED_SIZE) {
+    block->used = 0;
+    return;
+  }
+
+  // 블록이 여러 개 생겼으면 합친 크기의 블록 하나로 바꿔 둔다.
+  // 한도를 넘으면 큰 묶음 하나 때문에 커진 것이므로 처음 크기로 돌아간다.
+  size_t total = 0;
+  while (block != NULL) {
+    ArenaBlock* next = block->next;
+    total += block->size;
+    free(block);
+    block = next;
+  }
+  arena->block_size = total <= ARENA_MAX_RETAINED_SIZE ? total : arena->base_size;
+  arena->head = block_create(arena->block_size);
+}
+
+void arena_destroy(Arena* arena) {
+  ArenaBlock* block = arena->head;
+  while (block != NULL) {
+    ArenaBlock* next = block->next;
+    free(block);
+    block = next;
+  }
+  arena->head = NULL;
+}
+
+Arena* thread_arena(void) {
+  if (!worker_arena_ready) {
+    arena_init(&worker_arena, ARENA_DEFAULT_BLOCK_SIZE);
+    worker_arena_ready = true;
+  }
+  return &worker_arena;
+}
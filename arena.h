@@ -0,0 +1,32 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// 요청 처리용 bump 할당기. 프레임 파서와 핸들러가 요청 하나를 처리하는 동안
+// 쓰는 임시 메모리(요청 문자열, 응답 데이터)를 여기서 받고, 처리한 묶음이
+// 송신 버퍼로 복사되고 나면 arena_reset 으로 한 번에 되돌린다.
+// 블록이 모자라면 새 블록을 붙이고, reset 때 하나로 합쳐서 다음부터는
+// malloc 없이 돈다. 합친 크기가 ARENA_MAX_RETAINED_SIZE 를 넘으면 (드물게 큰
+// 요청 하나 때문이면) 붙잡아 두지 않고 처음 크기로 돌아간다.
+// 스레드 간에 공유하지 않는다.
+typedef struct ArenaBlock ArenaBlock;
+
+#define ARENA_MAX_RETAINED_SIZE (1024 * 1024)
+
+typedef struct {
+  ArenaBlock* head;
+  size_t block_size;  // 다음에 만들 블록 크기
+  size_t base_size;   // arena_init 의 block_size. 너무 커진 뒤에는 이 크기로 돌아간다
+} Arena;
+
+void arena_init(Arena* arena, size_t block_size);
+// 16 바이트 정렬. 메모리가 없으면 NULL.
+void* arena_alloc(Arena* arena, size_t size);
+void arena_reset(Arena* arena);
+void arena_destroy(Arena* arena);
+
+// 이 스레드의 요청 처리용 arena (처음 부를 때 만든다)
+Arena* thread_arena(void);
+
+#endif
@@ -0,0 +1,65 @@
+#include <helper.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include "event_table.h"
+
+// id -> 이벤트. main 에서만 채우고 워커는 읽기만 한다. 기본 이벤트만은 워커가
+// 처음 찾을 때 만들 수 있으므로 release/acquire 로 공개한다.
+static _Atomic(Event*) events[EVENT_MAX_EVENTS];
+static pthread_once_t default_once = PTHREAD_ONCE_INIT;
+
+bool event_table_create(uint32_t id, uint32_t n_seats) {
+  if (id >= EVENT_MAX_EVENTS || atomic_load(&events[id]) != NULL) return false;
+  if (n_seats == 0 || n_seats > EVENT_MAX_SEATS) return false;
+
+  // calloc 은 큰 배열을 0 페이지로 받아 오므로 쓰지 않은 좌석은 메모리를 먹지 않는다
+  Event* event = calloc(1, sizeof(Event));
+  if (event == NULL) return false;
+  event->id = id;
+  event->n_seats = n_seats;
+  event->n_words = ((size_t)n_seats + 63) / 64;
+  event->owner = calloc(n_seats, sizeof(_Atomic uint64_t));
+  event->counters = calloc(n_seats, sizeof(SeatCounters));
+  event->booked_bits = calloc(event->n_words, sizeof(_Atomic uint64_t));
+  event->epochs = aligned_alloc(64, (event->n_words * sizeof(_Atomic uint64_t) + 63) & ~(size_t)63);
+  if (event->owner == NULL || event->counters == NULL || event->booked_bits == NULL ||
+      event->epochs == NULL) {
+    free(event->owner);
+    free(event->counters);
+    free(event->booked_bits);
+    free(event->epochs);
+    free(event);
+    return false;
+  }
+  for (size_t i = 0; i < event->n_words; i++) atomic_init(&event->epochs[i], 0);
+
+  atomic_store_explicit(&events[id], event, memory_order_release);
+  return true;
+}
+
+bool event_table_attach(uint32_t id, uint32_t n_seats,
+                        _Atomic uint64_t* owner, SeatCounters* counters) {
+  Event* event = event_table_get(id);
+  if (event == NULL || event->n_seats != n_seats) return false;
+  free(event->owner);
+  free(event->counters);
+  event->owner = owner;
+  event->counters = counters;
+  return true;
+}
+
+// --event 0:N 으로 만들지 않았으면 기본 이벤트는 예전처럼 NUM_SEATS 좌석이다
+static void create_default_event(void) {
+  if (atomic_load(&events[EVENT_DEFAULT_ID]) == NULL) event_table_create(EVENT_DEFAULT_ID, NUM_SEATS);
+}
+
+Event* event_table_get(uint32_t id) {
+  if (id >= EVENT_MAX_EVENTS) return NULL;
+  Event* event = atomic_load_explicit(&events[id], memory_order_acquire);
+  if (event == NULL && id == EVENT_DEFAULT_ID) {
+    // main 을 거치지 않고 handle_request 만 쓰는 경우
+    pthread_once(&default_once, create_default_event);
+    event = atomic_load_explicit(&events[id], memory_order_acquire);
+  }
+  return event;
+}
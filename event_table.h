@@ -0,0 +1,66 @@
+#ifndef EVENT_TABLE_H
+#define EVENT_TABLE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 공연(이벤트)별 좌석 맵. 컴파일 때 정해진 NUM_SEATS 배열 대신 서버를 띄울 때
+// 이벤트마다 좌석 수를 정해 만든다. 연결은 SELECT_EVENT 로 이벤트를 고르고
+// (기본은 EVENT_DEFAULT_ID), 좌석 번호는 그 이벤트 안에서 1 부터 센다.
+//
+// 좌석 상태는 좌석별 구조체 대신 필드별 배열로 둔다. 좌석 하나에 16 바이트
+// (owner 8 + 카운터 8) 라 수백만 좌석도 수십 MB 안에 들고, 가용 목록이나 범위
+// 조회는 필요한 배열만 순서대로 훑는다. 대신 이웃 좌석끼리 캐시 라인을 나눠 쓴다
+// (CAS 한 번이라 경합이 몰려도 라인이 잠깐 오가는 정도다).
+//
+// 이벤트는 워커가 뜨기 전에 만들고 지우지 않으므로 event_table_get 은 락이 없다.
+
+typedef struct {
+  _Atomic uint32_t times_booked;
+  _Atomic uint32_t times_canceled;
+} SeatCounters;
+
+typedef struct {
+  uint32_t id;
+  uint32_t n_seats;
+  size_t n_words;                 // 비트맵 워드 수 ((n_seats + 63) / 64)
+  // 좌석별 owner 워드: 하위 32비트는 예약한 유저 id + 1 (0 이면 빈 좌석),
+  // 상위 32비트는 바뀔 때마다 증가하는 버전 (CAS 의 ABA 방지).
+  _Atomic uint64_t* owner;        // n_seats 개
+  SeatCounters* counters;         // n_seats 개
+  _Atomic uint64_t* booked_bits;  // 예약된 좌석 비트맵 (비트 i = 좌석 i + 1)
+
+  // 좌석 상태의 변경 세대 (seqlock 처럼 쓴다). 가용 비트맵 워드 하나 (64 좌석)
+  // 마다 하나씩 두어, 떨어진 좌석을 바꾸는 writer 끼리 한 워드를 두고 다투지 않고
+  // 범위를 읽는 쪽은 자기가 걸친 것만 본다. 비트맵과 같은 순서로 붙어 있어
+  // 캐시 라인 하나가 512 좌석을 덮는다.
+  // - 하위 31비트: 지금 이 64 좌석을 바꾸는 중인 writer 수
+  // - 비트 31: 여러 좌석을 읽는 reader 가 writer 를 잠깐 막아 달라고 요청함
+  // - 상위 32비트: 끝난 변경 수 (모두 더한 값이 availability 캐시의 버전)
+  _Atomic uint64_t* epochs;       // n_words 개
+} Event;
+
+// epochs 하나가 맡는 좌석 수 (비트맵 워드 하나)
+#define EVENT_EPOCH_SEATS 64
+
+#define EVENT_DEFAULT_ID 0
+#define EVENT_MAX_EVENTS 1024
+// v2 "available" 응답 (u32 목록) 이 24 비트 data_size 안에 들어가는 크기
+#define EVENT_MAX_SEATS 4000000
+
+// 이벤트를 만든다. 같은 id 가 이미 있거나 크기가 범위를 벗어나면 false.
+// 워커를 띄우기 전 (main) 에만 부른다.
+bool event_table_create(uint32_t id, uint32_t n_seats);
+
+// 스냅샷 복구용: 이벤트의 좌석 배열을 스냅샷 파일의 (MAP_PRIVATE) 매핑으로
+// 바꾼다. 페이지는 처음 닿을 때 읽히고 처음 쓸 때 복사된다. 이벤트가 없거나
+// 좌석 수가 다르면 false. 워커를 띄우기 전에만 부른다.
+bool event_table_attach(uint32_t id, uint32_t n_seats,
+                        _Atomic uint64_t* owner, SeatCounters* counters);
+
+// 없으면 NULL. 기본 이벤트는 처음 찾을 때 NUM_SEATS 좌석으로 만든다.
+Event* event_table_get(uint32_t id);
+
+#endif
@@ -0,0 +1,297 @@
+#include <getopt.h>
+#include <helper.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "arena.h"
+#include "event_table.h"
+#include "handle_request.h"
+#include "latency.h"
+#include "lockprof.h"
+#include "user_table.h"
+
+// handle_request 마이크로 벤치마크.
+//
+// 소켓 없이 스레드 여러 개가 공유 Users/Seat 에 handle_request 를 직접 부른다.
+// 시나리오마다 스레드 수를 1, 2, 4, ... 로 늘리며 정해진 시간 동안 돌리고,
+// 결과를 한 줄에 하나씩 CSV 로 stdout 에 낸다 (진행 상황은 stderr).
+// 락 구조를 바꾼 뒤 같은 옵션으로 돌려 처리량과 확장성(efficiency)을 비교한다.
+// -DLOCK_PROFILE 로 빌드하면 실행마다 락 경합 보고서를 stderr 에 낸다.
+//
+//   uniform  모든 좌석에 고르게 book/cancel
+//   hot      모든 스레드가 한 좌석에 book/cancel
+//   read     query/confirm 90%, book/cancel 10%
+//   login    유저 여러 명을 돌아가며 login/logout (비밀번호 해시 포함)
+
+bool sigint_received = false;
+
+#define BENCH_DEFAULT_DURATION_MS 1000
+#define BENCH_LOGIN_USERS 16  // login 시나리오에서 스레드마다 돌아가며 쓰는 유저 수
+#define BENCH_ARENA_RESET_OPS 256
+
+typedef struct BenchThread BenchThread;
+
+typedef struct {
+  const char* name;
+  void (*op)(BenchThread* thread);
+} Scenario;
+
+struct BenchThread {
+  _Alignas(64) size_t index;
+  pthread_t tid;
+  uint64_t rng;
+  uint64_t ops;
+  char username[32];
+  char data[32];
+  const Scenario* scenario;
+};
+
+static struct {
+  Users users;
+  Seat* seats;
+  uint32_t duration_ms;
+  pthread_barrier_t start;
+  _Atomic bool stop;
+} bench;
+
+// xorshift64*
+static uint64_t next_random(BenchThread* thread) {
+  thread->rng ^= thread->rng >> 12;
+  thread->rng ^= thread->rng << 25;
+  thread->rng ^= thread->rng >> 27;
+  return thread->rng * 2685821657736338717ull;
+}
+
+static int32_t call(BenchThread* thread, Action action, const char* username, const char* data) {
+  Request request = {
+    .action = action,
+    .username_length = strlen(username),
+    .data_size = data != NULL ? strlen(data) : 0,
+    .username = (char*)username,
+    .data = (char*)data,
+  };
+  Response response;
+  int32_t code = handle_request(&request, &response, &bench.users, bench.seats);
+  response_release(&response);
+  // 응답 데이터는 스레드 arena 에 있으므로 서버처럼 묶음 단위로 되돌린다
+  if (++thread->ops % BENCH_ARENA_RESET_OPS == 0) arena_reset(thread_arena());
+  return code;
+}
+
+static void book_or_cancel(BenchThread* thread, uint32_t seat_id) {
+  snprintf(thread->data, sizeof(thread->data), "%u", seat_id);
+  Action action = next_random(thread) & 1 ? ACTION_BOOK : ACTION_CANCEL_BOOKING;
+  call(thread, action, thread->username, thread->data);
+}
+
+// -------------------------------------
+// scenarios
+// -------------------------------------
+static void op_uniform(BenchThread* thread) {
+  book_or_cancel(thread, 1 + next_random(thread) % NUM_SEATS);
+}
+
+static void op_hot(BenchThread* thread) {
+  book_or_cancel(thread, 1);
+}
+
+static void op_read(BenchThread* thread) {
+  uint64_t pick = next_random(thread) % 100;
+  uint32_t seat_id = 1 + next_random(thread) % NUM_SEATS;
+  if (pick < 10) {
+    book_or_cancel(thread, seat_id);
+  } else if (pick < 55) {
+    snprintf(thread->data, sizeof(thread->data), "%u", seat_id);
+    call(thread, ACTION_QUERY, thread->username, thread->data);
+  } else {
+    call(thread, ACTION_CONFIRM_BOOKING, thread->username, pick & 1 ? "booked" : "available");
+  }
+}
+
+static void op_login(BenchThread* thread) {
+  char username[48];
+  snprintf(username, sizeof(username), "%s_%llu", thread->username,
+           (unsigned long long)(next_random(thread) % BENCH_LOGIN_USERS));
+  if (call(thread, ACTION_LOGIN, username, "pw") == 0) {
+    call(thread, ACTION_LOGOUT, username, NULL);
+  }
+}
+
+static const Scenario scenarios[] = {
+  {"uniform", op_uniform},
+  {"hot", op_hot},
+  {"read", op_read},
+  {"login", op_login},
+};
+#define N_SCENARIOS (sizeof(scenarios) / sizeof(scenarios[0]))
+
+// -------------------------------------
+// runner
+// -------------------------------------
+static void* bench_thread_func(void* arg) {
+  BenchThread* thread = arg;
+  pthread_barrier_wait(&bench.start);
+  while (!atomic_load_explicit(&bench.stop, memory_order_relaxed)) {
+    thread->scenario->op(thread);
+  }
+  response_cache_release();
+  arena_reset(thread_arena());
+  return NULL;
+}
+
+// 스레드 n_threads 개로 scenario 를 한 번 돌리고 처리한 요청 수와 걸린 시간을 돌려준다
+static uint64_t run_once(const Scenario* scenario, size_t n_threads, BenchThread* threads,
+                         double* seconds) {
+  pthread_barrier_init(&bench.start, NULL, n_threads + 1);
+  atomic_store(&bench.stop, false);
+  for (size_t i = 0; i < n_threads; i++) {
+    BenchThread* thread = &threads[i];
+    thread->index = i;
+    thread->ops = 0;
+    thread->rng = 0x9e3779b97f4a7c15ull * (i + 1);
+    thread->scenario = scenario;
+    if (pthread_create(&thread->tid, NULL, bench_thread_func, thread) != 0) {
+      perror("pthread_create");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  pthread_barrier_wait(&bench.start);
+  uint64_t started = now_ns();
+  usleep(bench.duration_ms * 1000);
+  atomic_store(&bench.stop, true);
+  uint64_t ops = 0;
+  for (size_t i = 0; i < n_threads; i++) {
+    pthread_join(threads[i].tid, NULL);
+    ops += threads[i].ops;
+  }
+  *seconds = (now_ns() - started) / 1e9;
+  pthread_barrier_destroy(&bench.start);
+  return ops;
+}
+
+// 좌석 시나리오의 유저는 시간을 재기 전에 등록하고 로그인해 둔다
+static void prepare_threads(BenchThread* threads, size_t n_threads) {
+  for (size_t i = 0; i < n_threads; i++) {
+    snprintf(threads[i].username, sizeof(threads[i].username), "mb%zu", i);
+    call(&threads[i], ACTION_LOGIN, threads[i].username, "pw");
+  }
+  arena_reset(thread_arena());
+}
+
+// 1, 2, 4, ... 다음은 max 자체. 끝나면 0.
+static size_t next_thread_count(size_t n, size_t max) {
+  if (n * 2 < max) return n * 2;
+  return n < max ? max : 0;
+}
+
+static const Scenario* find_scenario(const char* name) {
+  for (size_t i = 0; i < N_SCENARIOS; i++) {
+    if (strcmp(scenarios[i].name, name) == 0) return &scenarios[i];
+  }
+  return NULL;
+}
+
+static void print_usage(const char* prog) {
+  fprintf(stderr,
+          "usage: %s [--threads=MAX] [--duration=MS] [--scenario=NAME[,NAME]...]\n"
+          "       scenarios: uniform, hot, read, login (default: all)\n"
+          "       threads run 1, 2, 4, ... up to MAX (default: number of cores)\n",
+          prog);
+}
+
+int main(int argc, char* argv[]) {
+  static const struct option long_options[] = {
+    {"threads", required_argument, NULL, 't'},
+    {"duration", required_argument, NULL, 'd'},
+    {"scenario", required_argument, NULL, 's'},
+    {NULL, 0, NULL, 0},
+  };
+
+  size_t max_threads = get_num_cores();
+  bench.duration_ms = BENCH_DEFAULT_DURATION_MS;
+  const Scenario* selected[N_SCENARIOS];
+  size_t n_selected = 0;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "t:d:s:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 't':
+        max_threads = strtoull(optarg, NULL, 10);
+        break;
+      case 'd':
+        bench.duration_ms = strtoul(optarg, NULL, 10);
+        break;
+      case 's':
+        for (char* name = strtok(optarg, ","); name != NULL; name = strtok(NULL, ",")) {
+          const Scenario* scenario = find_scenario(name);
+          if (scenario == NULL || n_selected == N_SCENARIOS) {
+            print_usage(argv[0]);
+            return 1;
+          }
+          selected[n_selected++] = scenario;
+        }
+        break;
+      default:
+        print_usage(argv[0]);
+        return 1;
+    }
+  }
+  if (max_threads == 0 || bench.duration_ms == 0 || optind != argc) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  if (n_selected == 0) {
+    for (size_t i = 0; i < N_SCENARIOS; i++) selected[n_selected++] = &scenarios[i];
+  }
+
+  memset(&bench.users, 0, sizeof(Users));
+  setup_users(&bench.users);
+  user_table_init();
+  bench.seats = default_seats();
+  if (event_table_get(EVENT_DEFAULT_ID) == NULL) {
+    fprintf(stderr, "failed to create the default event\n");
+    return 1;
+  }
+
+  BenchThread* threads = calloc(max_threads, sizeof(BenchThread));
+  if (threads == NULL) {
+    perror("calloc failed");
+    return 1;
+  }
+  prepare_threads(threads, max_threads);
+#ifdef LOCK_PROFILE
+  lockprof_reset();
+#endif
+
+  printf("scenario,threads,ops,seconds,ops_per_sec,ns_per_op,speedup,efficiency\n");
+  for (size_t s = 0; s < n_selected; s++) {
+    double base_rate = 0;
+    for (size_t n = 1; n != 0; n = next_thread_count(n, max_threads)) {
+      double seconds;
+      uint64_t ops = run_once(selected[s], n, threads, &seconds);
+      double rate = ops / seconds;
+      if (n == 1) base_rate = rate;
+      double speedup = base_rate > 0 ? rate / base_rate : 0;
+      // ns_per_op 는 스레드 하나가 요청 하나에 쓴 시간 (벽시계 * 스레드 / 요청)
+      printf("%s,%zu,%llu,%.3f,%.0f,%.1f,%.2f,%.2f\n", selected[s]->name, n,
+             (unsigned long long)ops, seconds, rate, ops ? seconds * 1e9 * n / ops : 0,
+             speedup, speedup / n);
+      fflush(stdout);
+      fprintf(stderr, "%s x%zu: %.0f ops/s\n", selected[s]->name, n, rate);
+#ifdef LOCK_PROFILE
+      lockprof_report(stderr);
+      fprintf(stderr, "\n");
+      lockprof_reset();
+#endif
+    }
+  }
+
+  free(threads);
+  response_cache_release();
+  arena_destroy(thread_arena());
+  return 0;
+}
@@ -1,13 +1,523 @@
 #include <helper.h>
 #include <pa3_error.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
+#include <sched.h>
+#include "arena.h"
+#include "event_table.h"
+#include "handle_request.h"
 #include "helper.h"
+#include "lockprof.h"
+#include "trace.h"
+#include "user_table.h"
+#include "wal.h"
 
-// Users 배열 접근을 보호하기 위한 정적 뮤텍스 (Users 구조체에 락이 없으므로 추가)
-static pthread_mutex_t user_mutex = PTHREAD_MUTEX_INITIALIZER;
+// 유저 정보는 helper 의 Users/find_user 대신 user_table 에서 관리한다.
+// 조회는 락 없이 O(1) 이고 logged_in 은 원자적 플래그다.
+
+// 좌석 상태는 Seat 의 mutex/user_who_booked 대신 이벤트의 좌석 맵 (event_table)
+// 에서 원자적으로 관리한다. owner 워드의 배치와 epoch 는 event_table.h 참고.
+// 여러 좌석을 읽는 쪽은 writer 가 없을 때 읽고 그동안 epoch 가 그대로였으면
+// 한 시점의 상태로 본다. 좌석마다 락을 잡지 않는다.
+#define SEAT_EPOCH_WRITERS(word) ((word) & 0x7fffffffULL)
+#define SEAT_EPOCH_READER_WAIT (1ULL << 31)
+#define SEAT_EPOCH_COMPLETED(word) ((uint32_t)((word) >> 32))
+// 계속 바뀌는 동안 이만큼 다시 읽어도 안 되면 writer 를 잠깐 막고 읽는다
+#define SEAT_SNAPSHOT_OPTIMISTIC_TRIES 64
+
+// "available" 응답 캐시. 워커 스레드마다 최근에 조회한 (이벤트, 인코딩) 몇 개만
+// 두어 락 없이 재사용한다. version 이 이벤트의 끝난 변경 수와 같으면 ids 를 그대로
+// 응답으로 쓴다. 목록은 요청한 프로토콜의 인코딩 (v1 size_t, v2 u32) 으로만 만들고
+// 빈 좌석 수만큼만 잡는다. 스레드의 캐시는 모두 합쳐 AVAILABILITY_CACHE_BUDGET 을
+// 넘지 않게 오래 안 쓴 것부터 비우고, 그보다 큰 목록은 캐시하지 않고 arena 에 만든다.
+#define AVAILABILITY_CACHE_SLOTS 8
+#define AVAILABILITY_CACHE_BUDGET (32u * 1024 * 1024)
+
+typedef struct {
+  const Event* event;  // NULL 이면 빈 칸
+  size_t id_size;      // sizeof(size_t) 또는 sizeof(uint32_t)
+  uint64_t version;
+  void* ids;
+  size_t cap;          // ids 에 들어갈 수 있는 좌석 수
+  size_t count;
+  uint64_t last_used;
+} AvailabilityCache;
+
+static _Thread_local AvailabilityCache availability_caches[AVAILABILITY_CACHE_SLOTS];
+static _Thread_local uint64_t availability_clock;
+
+#define SEAT_OWNER(word) ((uint32_t)(word))
+#define SEAT_VERSION(word) ((uint32_t)((word) >> 32))
+#define SEAT_WORD(owner, version) (((uint64_t)(version) << 32) | (uint32_t)(owner))
+
+// 유저 예약 목록의 키: 상위 32비트 이벤트 id, 하위 32비트 좌석 번호.
+// 정렬하면 이벤트별로 모이고 그 안에서 좌석 번호 순서가 된다.
+#define BOOKING_KEY(event_id, seat_id) (((uint64_t)(event_id) << 32) | (uint32_t)(seat_id))
+#define BOOKING_SEAT(key) ((uint32_t)(key))
+
+// 좌석 owner 를 from 에서 to 로 바꾼다. 지금 owner 가 from 이 아니면 false.
+// 성공하면 *version 에 바뀐 뒤의 버전을 적는다 (WAL 레코드용, NULL 이어도 된다).
+static bool seat_try_transfer(Event* event, int64_t seat_id, uint32_t from, uint32_t to,
+                              uint32_t* version) {
+  _Atomic uint64_t* owner = &event->owner[seat_id - 1];
+  uint64_t cur = atomic_load(owner);
+  uint32_t retries = 0;
+  while (true) {
+    if (SEAT_OWNER(cur) != from) {
+      LOCKPROF_SEAT(event->id, seat_id, retries, true);
+      return false;
+    }
+    if (atomic_compare_exchange_weak(owner, &cur, SEAT_WORD(to, SEAT_VERSION(cur) + 1))) break;
+    retries++;
+  }
+  LOCKPROF_SEAT(event->id, seat_id, retries, false);
+  if (version != NULL) *version = SEAT_VERSION(cur) + 1;
+  return true;
+}
+
+// 빈 좌석을 owner 로 점유한다. 이미 누가 예약했으면 false.
+static bool seat_try_book(Event* event, int64_t seat_id, uint32_t owner, uint32_t* version) {
+  if (!seat_try_transfer(event, seat_id, 0, owner, version)) return false;
+  atomic_fetch_add(&event->counters[seat_id - 1].times_booked, 1);
+  return true;
+}
+
+// owner 가 예약한 좌석을 비운다. owner 의 좌석이 아니면 false.
+static bool seat_try_cancel(Event* event, int64_t seat_id, uint32_t owner, uint32_t* version) {
+  if (!seat_try_transfer(event, seat_id, owner, 0, version)) return false;
+  atomic_fetch_add(&event->counters[seat_id - 1].times_canceled, 1);
+  return true;
+}
+
+// 좌석 seat_id 를 덮는 epoch
+static _Atomic uint64_t* seat_epoch(Event* event, int64_t seat_id) {
+  return &event->epochs[(seat_id - 1) / EVENT_EPOCH_SEATS];
+}
+
+// epoch 하나에 writer 로 들어간다. 막혀서 기다렸으면 기다리기 시작한 시각을
+// *wait_started 에 남긴다 (이미 값이 있으면 그대로 둔다).
+static void epoch_enter(_Atomic uint64_t* epoch, uint64_t* wait_started) {
+  while (true) {
+    uint64_t word = atomic_fetch_add(epoch, 1);
+    if (!(word & SEAT_EPOCH_READER_WAIT)) return;
+    // 스냅샷을 뜨는 reader 가 있다. 물러났다가 끝나면 다시 들어간다.
+    if (*wait_started == 0) *wait_started = LOCKPROF_NOW();
+    atomic_fetch_sub(epoch, 1);
+    uint64_t traced = trace_stage_begin();
+    while (atomic_load(epoch) & SEAT_EPOCH_READER_WAIT) {
+      sched_yield();
+    }
+    trace_stage_end(TRACE_STAGE_LOCK, traced);
+  }
+}
+
+// changed 가 false 면 (CAS 실패) 끝난 변경 수를 올리지 않는다.
+static void epoch_exit(_Atomic uint64_t* epoch, bool changed) {
+  if (changed) {
+    atomic_fetch_add(epoch, (1ULL << 32) - 1);
+  } else {
+    atomic_fetch_sub(epoch, 1);
+  }
+}
+
+static void seat_write_begin(Event* event, int64_t seat_id) {
+  uint64_t wait_started = 0;
+  epoch_enter(seat_epoch(event, seat_id), &wait_started);
+  LOCKPROF_ACQUIRED(LOCK_SITE_SEAT_WRITE, wait_started);
+}
+
+static void seat_write_end(Event* event, int64_t seat_id, bool changed) {
+  LOCKPROF_RELEASED(LOCK_SITE_SEAT_WRITE);
+  epoch_exit(seat_epoch(event, seat_id), changed);
+}
+
+// BOOK_MANY 에서 점유할 좌석. 요청 순서(index)를 들고 좌석 번호 순으로 정렬한다.
+typedef struct {
+  uint32_t seat_id;
+  uint32_t index;
+} SeatClaim;
+
+// 좌석 번호 오름차순인 claims 가 걸친 epoch 들에 차례로 들어간다. reader 도
+// 오름차순으로 막으므로 서로 기다리며 멈추지 않는다.
+static void claims_write_begin(Event* event, const SeatClaim* claims, size_t n_claims) {
+  uint64_t wait_started = 0;
+  _Atomic uint64_t* entered = NULL;
+  for (size_t i = 0; i < n_claims; i++) {
+    _Atomic uint64_t* epoch = seat_epoch(event, claims[i].seat_id);
+    if (epoch == entered) continue;
+    epoch_enter(epoch, &wait_started);
+    entered = epoch;
+  }
+  LOCKPROF_ACQUIRED(LOCK_SITE_SEAT_WRITE, wait_started);
+}
+
+static void claims_write_end(Event* event, const SeatClaim* claims, size_t n_claims,
+                             bool changed) {
+  LOCKPROF_RELEASED(LOCK_SITE_SEAT_WRITE);
+  _Atomic uint64_t* exited = NULL;
+  for (size_t i = 0; i < n_claims; i++) {
+    _Atomic uint64_t* epoch = seat_epoch(event, claims[i].seat_id);
+    if (epoch == exited) continue;
+    epoch_exit(epoch, changed);
+    exited = epoch;
+  }
+}
+
+// 좌석 owner CAS 가 성공한 뒤에 가용 비트맵을 갱신한다.
+static void availability_mark(Event* event, int64_t seat_id, bool booked) {
+  uint64_t bit = 1ULL << ((seat_id - 1) % 64);
+  if (booked) {
+    atomic_fetch_or(&event->booked_bits[(seat_id - 1) / 64], bit);
+  } else {
+    atomic_fetch_and(&event->booked_bits[(seat_id - 1) / 64], ~bit);
+  }
+}
+
+static void seat_read_records(Event* event, int64_t first, int64_t last, SeatRecord* out) {
+  for (int64_t seat_id = first; seat_id <= last; seat_id++) {
+    SeatCounters* counters = &event->counters[seat_id - 1];
+    SeatRecord* record = &out[seat_id - first];
+    record->id = (uint32_t)seat_id;
+    record->booked =
+        SEAT_OWNER(atomic_load_explicit(&event->owner[seat_id - 1], memory_order_relaxed)) != 0;
+    record->times_booked = atomic_load_explicit(&counters->times_booked, memory_order_relaxed);
+    record->times_canceled = atomic_load_explicit(&counters->times_canceled, memory_order_relaxed);
+  }
+}
+
+// first..last 번째 epoch 에 writer 가 없으면 끝난 변경 수의 합을 *completed 에
+// 적고 true. 끝난 변경 수는 줄지 않으므로 합이 같으면 그사이 바뀐 것이 없다.
+static bool epochs_quiet(Event* event, size_t first, size_t last, uint64_t* completed) {
+  uint64_t sum = 0;
+  for (size_t i = first; i <= last; i++) {
+    uint64_t word = atomic_load_explicit(&event->epochs[i], memory_order_acquire);
+    if (SEAT_EPOCH_WRITERS(word) != 0) return false;
+    sum += SEAT_EPOCH_COMPLETED(word);
+  }
+  *completed = sum;
+  return true;
+}
+
+// first..last 좌석 (1 부터) 에 writer 가 없는 한 시점에 read(event, ctx) 를 돌린다.
+// 그 좌석들을 덮는 epoch 만 본다. writer 가 없는 동안 읽고 그사이 epoch 들이
+// 그대로였는지 확인하고, 계속 실패하면 READER_WAIT 로 새 writer 를 잠깐 막고
+// 진행 중인 writer 가 빠지기를 기다렸다가 읽는다.
+static void seat_stable_read(Event* event, int64_t first, int64_t last,
+                             void (*read)(Event* event, void* ctx), void* ctx) {
+  size_t first_epoch = (first - 1) / EVENT_EPOCH_SEATS;
+  size_t last_epoch = (last - 1) / EVENT_EPOCH_SEATS;
+  for (int tries = 0; tries < SEAT_SNAPSHOT_OPTIMISTIC_TRIES; tries++) {
+    uint64_t before, after;
+    if (epochs_quiet(event, first_epoch, last_epoch, &before)) {
+      read(event, ctx);
+      atomic_thread_fence(memory_order_acquire);
+      if (epochs_quiet(event, first_epoch, last_epoch, &after) && after == before) return;
+    }
+    sched_yield();
+  }
+
+  // 비관적 경로: epoch 마다 READER_WAIT 를 차지한 reader 하나만 들어온다.
+  // 오름차순으로 하나씩 막고 그 writer 가 빠지기를 기다리므로, 여러 epoch 에
+  // 걸친 writer (claims_write_begin) 와 서로 기다리며 멈추지 않는다.
+  for (size_t i = first_epoch; i <= last_epoch; i++) {
+    _Atomic uint64_t* epoch = &event->epochs[i];
+    uint64_t word = atomic_load(epoch);
+    while (true) {
+      if (word & SEAT_EPOCH_READER_WAIT) {
+        sched_yield();
+        word = atomic_load(epoch);
+      } else if (atomic_compare_exchange_weak(epoch, &word, word | SEAT_EPOCH_READER_WAIT)) {
+        break;
+      }
+    }
+    while (SEAT_EPOCH_WRITERS(atomic_load(epoch)) != 0) {
+      sched_yield();
+    }
+  }
+  read(event, ctx);
+  for (size_t i = first_epoch; i <= last_epoch; i++) {
+    atomic_fetch_and(&event->epochs[i], ~SEAT_EPOCH_READER_WAIT);
+  }
+}
+
+typedef struct {
+  int64_t first;
+  int64_t last;
+  SeatRecord* out;
+} RecordRange;
+
+static void read_record_range(Event* event, void* ctx) {
+  RecordRange* range = ctx;
+  seat_read_records(event, range->first, range->last, range->out);
+}
+
+// first..last 좌석을 한 시점의 상태로 읽는다.
+static void seat_snapshot(Event* event, int64_t first, int64_t last, SeatRecord* out) {
+  RecordRange range = {.first = first, .last = last, .out = out};
+  seat_stable_read(event, first, last, read_record_range, &range);
+}
+
+typedef struct {
+  uint32_t first;
+  uint32_t count;
+  uint64_t* owner;
+  SeatCounters* counters;
+} SeatChunk;
+
+static void read_seat_chunk(Event* event, void* ctx) {
+  SeatChunk* chunk = ctx;
+  for (uint32_t i = 0; i < chunk->count; i++) {
+    uint32_t seat = chunk->first + i;
+    chunk->owner[i] = atomic_load_explicit(&event->owner[seat], memory_order_relaxed);
+    atomic_init(&chunk->counters[i].times_booked,
+                atomic_load_explicit(&event->counters[seat].times_booked, memory_order_relaxed));
+    atomic_init(&chunk->counters[i].times_canceled,
+                atomic_load_explicit(&event->counters[seat].times_canceled, memory_order_relaxed));
+  }
+}
+
+void seats_checkpoint(Event* event, uint32_t first, uint32_t count,
+                      uint64_t* owner, SeatCounters* counters) {
+  SeatChunk chunk = {.first = first, .count = count, .owner = owner, .counters = counters};
+  seat_stable_read(event, (int64_t)first + 1, (int64_t)first + count, read_seat_chunk, &chunk);
+}
+
+// 이벤트 전체의 끝난 변경 수. epoch 를 모두 더하지만 비트맵 워드 수만큼이라
+// 캐시를 다시 만드는 비용보다 작다.
+static uint64_t event_version(Event* event) {
+  uint64_t version = 0;
+  for (size_t i = 0; i < event->n_words; i++) {
+    version += SEAT_EPOCH_COMPLETED(atomic_load_explicit(&event->epochs[i], memory_order_acquire));
+  }
+  return version;
+}
+
+// 비트맵에서 빈 좌석 번호를 out 에 적고 개수를 돌려준다. cap 개를 넘으면 SIZE_MAX.
+// 대부분의 워드는 모두 비었거나 모두 찼으므로 워드 단위로 처리한다: 찬 워드는
+// 건너뛰고, 빈 워드는 연속한 64 개 번호를 한 번에 적는다 (컴파일러가 벡터 저장으로
+// 바꾼다). 섞인 워드만 ctz 로 한 비트씩 뽑는다.
+#define DEFINE_AVAILABILITY_FILL(name, type)                                          \
+  static size_t name(const Event* event, type* out, size_t cap) {                     \
+    size_t count = 0;                                                                 \
+    size_t tail = event->n_seats % 64;                                                \
+    for (size_t w = 0; w < event->n_words; w++) {                                     \
+      uint64_t free_bits =                                                            \
+          ~atomic_load_explicit(&event->booked_bits[w], memory_order_relaxed);        \
+      if (w == event->n_words - 1 && tail != 0) free_bits &= (1ULL << tail) - 1;      \
+      if (free_bits == 0) continue;                                                   \
+      if (cap - count < 64) return SIZE_MAX;                                          \
+      type base = (type)(w * 64 + 1);                                                 \
+      if (free_bits == ~0ULL) {                                                       \
+        for (type i = 0; i < 64; i++) out[count + i] = base + i;                      \
+        count += 64;                                                                  \
+        continue;                                                                     \
+      }                                                                               \
+      while (free_bits != 0) {                                                        \
+        out[count++] = base + (type)__builtin_ctzll(free_bits);                       \
+        free_bits &= free_bits - 1;                                                   \
+      }                                                                               \
+    }                                                                                 \
+    return count;                                                                     \
+  }
+
+DEFINE_AVAILABILITY_FILL(availability_fill64, size_t)
+DEFINE_AVAILABILITY_FILL(availability_fill32, uint32_t)
+
+static size_t availability_fill(const Event* event, size_t id_size, void* out, size_t cap) {
+  return id_size == sizeof(uint32_t) ? availability_fill32(event, out, cap)
+                                     : availability_fill64(event, out, cap);
+}
+
+static void availability_evict(AvailabilityCache* cache) {
+  free(cache->ids);
+  memset(cache, 0, sizeof(AvailabilityCache));
+}
+
+static size_t availability_used_bytes(void) {
+  size_t used = 0;
+  for (size_t i = 0; i < AVAILABILITY_CACHE_SLOTS; i++) {
+    used += availability_caches[i].cap * availability_caches[i].id_size;
+  }
+  return used;
+}
+
+// 새 목록을 둘 칸: 빈 칸이 있으면 그것, 없으면 가장 오래 안 쓴 칸
+static AvailabilityCache* availability_victim(const AvailabilityCache* keep) {
+  AvailabilityCache* victim = NULL;
+  for (size_t i = 0; i < AVAILABILITY_CACHE_SLOTS; i++) {
+    AvailabilityCache* slot = &availability_caches[i];
+    if (slot == keep) continue;
+    if (slot->event == NULL) return slot;
+    if (victim == NULL || slot->last_used < victim->last_used) victim = slot;
+  }
+  return victim;
+}
+
+// cap 좌석이 들어갈 칸을 마련한다 (cache 가 NULL 이면 새 칸). 예산을 넘으면 오래
+// 안 쓴 칸부터 비운다. 메모리가 없으면 NULL.
+static AvailabilityCache* availability_reserve(AvailabilityCache* cache, const Event* event,
+                                               size_t id_size, size_t cap) {
+  if (cache == NULL) cache = availability_victim(NULL);
+  availability_evict(cache);
+  while (availability_used_bytes() + cap * id_size > AVAILABILITY_CACHE_BUDGET) {
+    availability_evict(availability_victim(cache));
+  }
+  cache->ids = malloc(cap * id_size);
+  if (cache->ids == NULL) return NULL;
+  cache->event = event;
+  cache->id_size = id_size;
+  cache->cap = cap;
+  return cache;
+}
+
+// event 의 빈 좌석 목록 (id_size 인코딩) 을 돌려주고 개수를 *count 에 적는다.
+// 실패하면 NULL. 버전을 먼저 읽고 비트맵을 읽으므로 캐시 내용은 언제나 그 버전
+// 이후의 상태다 (사이에 바뀌었다면 다음 조회에서 버전이 달라 다시 만든다).
+static void* availability_snapshot(Event* event, size_t id_size, size_t* count) {
+  uint64_t version = event_version(event);
+  AvailabilityCache* cache = NULL;
+  for (size_t i = 0; i < AVAILABILITY_CACHE_SLOTS; i++) {
+    AvailabilityCache* slot = &availability_caches[i];
+    if (slot->event == event && slot->id_size == id_size) cache = slot;
+  }
+  if (cache != NULL && cache->version == version) {
+    cache->last_used = ++availability_clock;
+    *count = cache->count;
+    return cache->ids;
+  }
+
+  // 지금 빈 좌석 수에 여유를 두고 잡는다 (세는 사이 취소된 좌석)
+  size_t n_free = 0;
+  for (size_t w = 0; w < event->n_words; w++) {
+    n_free += __builtin_popcountll(~atomic_load_explicit(&event->booked_bits[w], memory_order_relaxed));
+  }
+  size_t cap = n_free + n_free / 8 + 64;
+  if (cap > event->n_seats + 64) cap = event->n_seats + 64;
+
+  if (cap * id_size > AVAILABILITY_CACHE_BUDGET) {
+    if (cache != NULL) availability_evict(cache);
+  } else {
+    if (cache == NULL || cache->cap < cap) cache = availability_reserve(cache, event, id_size, cap);
+    if (cache != NULL) {
+      size_t filled = availability_fill(event, id_size, cache->ids, cache->cap);
+      if (filled != SIZE_MAX) {
+        cache->count = *count = filled;
+        cache->version = version;
+        cache->last_used = ++availability_clock;
+        return cache->ids;
+      }
+      availability_evict(cache);
+    }
+  }
+
+  // 캐시하기에 너무 크거나 여유분보다 많이 비었다. 이번 응답만 arena 에 만든다.
+  cap = (size_t)event->n_seats + 64;
+  void* ids = arena_alloc(thread_arena(), cap * id_size);
+  if (ids == NULL) return NULL;
+  *count = availability_fill(event, id_size, ids, cap);
+  return ids;
+}
+
+void response_release(Response* response) {
+  response->data = NULL;
+}
+
+void response_cache_release(void) {
+  for (size_t i = 0; i < AVAILABILITY_CACHE_SLOTS; i++) availability_evict(&availability_caches[i]);
+}
+
+static uint8_t session_protocol(const Session* session) {
+  return session != NULL ? session->protocol : PROTOCOL_V1;
+}
+
+// 요청이 다루는 이벤트. 세션이 없으면 (handle_request) 기본 이벤트.
+static Event* session_event(const Session* session) {
+  return event_table_get(session != NULL ? session->event_id : EVENT_DEFAULT_ID);
+}
+
+// 좌석 변경을 WAL 에 남기고, 동기 모드면 이 연결의 응답이 그 레코드의 fsync 를
+// 기다리게 한다.
+static void session_log(Session* session, const WalRecord* record) {
+  uint64_t lsn = wal_append(record);
+  if (session != NULL && lsn > session->wal_lsn) session->wal_lsn = lsn;
+}
+
+static void session_log_seats(Session* session, WalRecordType type, const UserEntry* user,
+                              const Event* event, const WalSeat* seats, uint32_t n_seats) {
+  if (!wal_enabled()) return;
+  WalRecord record = {.type = type, .user_id = user->id, .event_id = event->id,
+                      .n_seats = n_seats, .seats = seats};
+  session_log(session, &record);
+}
+
+// 유저 예약 목록을 잠근다. 추적 중인 요청이면 기다린 시간을 LOCK 단계에 더한다.
+static void bookings_lock(UserBookings* bookings, LockSite site) {
+  uint64_t traced = trace_stage_begin();
+  LOCKPROF_LOCK(&bookings->mutex, site);
+  trace_stage_end(TRACE_STAGE_LOCK, traced);
+}
+
+// 예약 목록에 좌석 n 개를 더 넣을 자리를 확보한다. bookings.mutex 를 잡고 호출.
+static bool bookings_reserve(UserBookings* bookings, size_t n) {
+  if (bookings->count + n <= bookings->capacity) return true;
+  size_t capacity = bookings->capacity ? bookings->capacity * 2 : 8;
+  while (capacity < bookings->count + n) capacity *= 2;
+  uint64_t* keys = realloc(bookings->keys, capacity * sizeof(uint64_t));
+  if (keys == NULL) return false;
+  bookings->keys = keys;
+  bookings->capacity = capacity;
+  return true;
+}
+
+// key 이상인 첫 자리
+static size_t bookings_lower_bound(const UserBookings* bookings, uint64_t key) {
+  size_t lo = 0, hi = bookings->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (bookings->keys[mid] < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// 정렬 순서를 유지하며 넣는다. 자리는 bookings_reserve 로 미리 확보되어 있어야 한다.
+static void bookings_insert(UserBookings* bookings, uint32_t event_id, int64_t seat_id) {
+  uint64_t key = BOOKING_KEY(event_id, seat_id);
+  size_t i = bookings_lower_bound(bookings, key);
+  memmove(&bookings->keys[i + 1], &bookings->keys[i],
+          (bookings->count - i) * sizeof(uint64_t));
+  bookings->keys[i] = key;
+  bookings->count++;
+}
+
+static void bookings_remove(UserBookings* bookings, uint32_t event_id, int64_t seat_id) {
+  uint64_t key = BOOKING_KEY(event_id, seat_id);
+  size_t i = bookings_lower_bound(bookings, key);
+  if (i == bookings->count || bookings->keys[i] != key) return;
+  memmove(&bookings->keys[i], &bookings->keys[i + 1],
+          (bookings->count - i - 1) * sizeof(uint64_t));
+  bookings->count--;
+}
+
+// 로그인한 유저를 찾는다. 없거나 로그인하지 않았으면 NULL.
+// 세션이 있으면 username 을 보지 않고 세션의 id 로 바로 찾는다.
+static UserEntry* find_logged_in_user(const Request* request, Session* session) {
+  if (session != NULL && session->user_id != USER_ID_NONE) {
+    UserEntry* user = user_table_get(session->user_id);
+    if (user != NULL && atomic_load(&user->logged_in)) return user;
+    session->user_id = USER_ID_NONE;  // 다른 연결에서 로그아웃했다
+  }
+
+  UserEntry* user = user_table_find(request->username);
+  if (user == NULL || !atomic_load(&user->logged_in)) return NULL;
+  return user;
+}
 
 // Helper: 문자열이 숫자인지 확인
 int is_number(const char* str) {
@@ -17,52 +527,130 @@ int is_number(const char* str) {
   return *endptr == '\0';
 }
 
-LoginErrorCode handle_login_request(const Request* request,
-                                    Response* response,
-                                    Users* users) {
+// BOOK/CANCEL/QUERY 의 좌석 번호. v1 은 10진 문자열, v2 는 u32 이다.
+// 해석할 수 없으면 -1 (핸들러는 범위 밖으로 답한다).
+static int64_t request_seat_id(const Request* request, const Session* session) {
+  if (session_protocol(session) == PROTOCOL_V2) {
+    if (request->data_size != sizeof(uint32_t)) return -1;
+    uint32_t seat_id;
+    memcpy(&seat_id, request->data, sizeof(uint32_t));
+    return seat_id;
+  }
+  if (!is_number(request->data)) return -1;
+  return strtoll(request->data, NULL, 10);
+}
+
+void login_begin(const Request* request, LoginJob* job) {
+  memset(job, 0, sizeof(LoginJob));
+  job->step = LOGIN_STEP_DONE;
+
   if (request->data_size == 0 || request->data == NULL) {
-    return LOGIN_ERROR_NO_PASSWORD; // [cite: 214]
+    job->code = LOGIN_ERROR_NO_PASSWORD; // [cite: 214]
+    return;
+  }
+  if (request->username == NULL) {
+    job->code = LOGIN_ERROR_INCORRECT_PASSWORD;
+    return;
   }
 
-  char* username = request->username;
-  char* password = request->data; // Login action uses data field for password [cite: 171]
+  UserEntry* user = user_table_find(request->username);
+  if (user != NULL) {
+    // 기존 유저 로그인 [cite: 204-206]
+    // 이미 로그인되어 있으면 해시할 필요도 없다 [cite: 214]
+    if (atomic_load(&user->logged_in)) {
+      job->code = LOGIN_ERROR_ACTIVE_USER;
+      return;
+    }
+    job->step = LOGIN_STEP_VALIDATE;
+    job->user = user;
+  } else {
+    // 신규 유저 등록 [cite: 197-201]
+    job->step = LOGIN_STEP_REGISTER;
+  }
 
-  pthread_mutex_lock(&user_mutex);
+  // Login action uses data field for password [cite: 171]
+  job->username = strdup(request->username);
+  job->password = strdup(request->data);
+  if (job->username == NULL || job->password == NULL) {
+    free(job->username);
+    free(job->password);
+    job->username = job->password = NULL;
+    job->step = LOGIN_STEP_DONE;
+    job->code = LOGIN_ERROR_INCORRECT_PASSWORD;
+  }
+}
 
-  ssize_t uid = find_user(users, username);
+void login_run_hash(LoginJob* job) {
+  if (job->step == LOGIN_STEP_REGISTER) {
+    hash_password(job->password, job->hashed_password);
+  } else if (job->step == LOGIN_STEP_VALIDATE) {
+    job->password_ok = validate_password(job->password, job->user->hashed_password);
+  }
+}
 
-  if (uid == -1) {
-    // 신규 유저 등록 [cite: 197-201]
-    char hashed_password[HASHED_PASSWORD_SIZE];
-    hash_password(password, hashed_password);
-    size_t new_uid = add_user(users, username, hashed_password);
-    users->array[new_uid].logged_in = true;
-    pthread_mutex_unlock(&user_mutex);
-    return LOGIN_ERROR_SUCCESS;
-  } else {
-    // 기존 유저 로그인 [cite: 204-206]
-    User* user = &users->array[uid];
+// 기존 유저를 로그인 상태로 바꾼다. 이미 로그인되어 있으면 실패.
+static int32_t mark_logged_in(UserEntry* user) {
+  bool expected = false;
+  return atomic_compare_exchange_strong(&user->logged_in, &expected, true)
+             ? LOGIN_ERROR_SUCCESS
+             : LOGIN_ERROR_ACTIVE_USER;
+}
 
-    // 이미 로그인되어 있는지 확인 [cite: 214]
-    if (user->logged_in) {
-      pthread_mutex_unlock(&user_mutex);
-      return LOGIN_ERROR_ACTIVE_USER;
-    }
+int32_t login_finish(LoginJob* job, Session* session) {
+  int32_t code = job->code;
+  UserEntry* user = job->user;
 
-    // 비밀번호 검증
-    if (validate_password(password, user->hashed_password)) {
-      user->logged_in = true;
-      pthread_mutex_unlock(&user_mutex);
-      return LOGIN_ERROR_SUCCESS;
+  if (job->step == LOGIN_STEP_REGISTER) {
+    bool created;
+    user = user_table_insert(job->username, job->hashed_password, &created);
+    if (user == NULL) {
+      code = LOGIN_ERROR_INCORRECT_PASSWORD;
+    } else if (created) {
+      // 로그인되어 예약을 남기기 전에 등록부터 로그에 남긴다
+      WalRecord record = {.type = WAL_RECORD_REGISTER, .user_id = user->id,
+                          .username = user->username,
+                          .hashed_password = user->hashed_password};
+      session_log(session, &record);
+      // 동시에 같은 이름으로 로그인한 요청이 먼저 들어갔을 수 있으므로 CAS
+      code = mark_logged_in(user);
+    } else if (atomic_load(&user->logged_in)) {
+      code = LOGIN_ERROR_ACTIVE_USER;
     } else {
-      pthread_mutex_unlock(&user_mutex);
-      return LOGIN_ERROR_INCORRECT_PASSWORD;
+      // 해시하는 사이 다른 요청이 먼저 등록했다 (드문 경우라 여기서 바로 검증)
+      code = validate_password(job->password, user->hashed_password)
+                 ? mark_logged_in(user)
+                 : LOGIN_ERROR_INCORRECT_PASSWORD;
     }
+  } else if (job->step == LOGIN_STEP_VALIDATE) {
+    code = job->password_ok ? mark_logged_in(job->user)
+                            : LOGIN_ERROR_INCORRECT_PASSWORD;
   }
+
+  if (code == LOGIN_ERROR_SUCCESS && session != NULL) {
+    session->user_id = user->id;
+  }
+
+  free(job->username);
+  free(job->password);
+  job->username = job->password = NULL;
+  return code;
+}
+
+LoginErrorCode handle_login_request(const Request* request,
+                                    Response* response,
+                                    Session* session,
+                                    Users* users) {
+  LoginJob job;
+  login_begin(request, &job);
+  uint64_t traced = trace_stage_begin();
+  login_run_hash(&job);
+  trace_stage_end(TRACE_STAGE_HASH, traced);
+  return login_finish(&job, session);
 }
 
 BookErrorCode handle_book_request(const Request* request,
                                   Response* response,
+                                  Session* session,
                                   Users* users,
                                   Seat* seats) {
   // 1. 데이터 유효성 검사 (Lock 불필요)
@@ -71,58 +659,221 @@ BookErrorCode handle_book_request(const Request* request,
   }
 
   // [최적화] 좌석 번호 파싱을 먼저 수행 (Lock 잡기 전에 수행하여 병목 최소화)
-  if (!is_number(request->data)) {
-      return BOOK_ERROR_SEAT_OUT_OF_RANGE;
-  }
-  int seat_id = atoi(request->data);
-  if (seat_id < 1 || seat_id > NUM_SEATS) {
+  Event* event = session_event(session);
+  int64_t seat_id = request_seat_id(request, session);
+  if (event == NULL || seat_id < 1 || seat_id > event->n_seats) {
     return BOOK_ERROR_SEAT_OUT_OF_RANGE; 
   }
 
-  // ---------------- CRITICAL SECTION START ----------------
-  // 2. 유저 로그인 상태 확인 (user_mutex Lock 시작)
-  pthread_mutex_lock(&user_mutex);
-  
-  ssize_t uid = find_user(users, request->username);
-  if (uid == -1 || !users->array[uid].logged_in) {
-    pthread_mutex_unlock(&user_mutex); // 실패 시 바로 Unlock
+  // 2. 유저 로그인 상태 확인 (락 없음)
+  UserEntry* user = find_logged_in_user(request, session);
+  if (user == NULL) {
     return BOOK_ERROR_USER_NOT_LOGGED_IN; 
   }
-  
-  // [중요 수정] 여기서 user_mutex를 풀지 않습니다!
-  // 예약이 끝날 때까지 로그아웃을 못하게 막아야 합니다.
 
-  // 3. 좌석 예약 (seat mutex Lock 시작)
-  // Lock 순서: User -> Seat (Deadlock 방지를 위해 순서 유지 필수)
-  Seat* seat = &seats[seat_id - 1]; 
-  pthread_mutex_lock(&seat->mutex);
-
-  if (seat->user_who_booked != NULL) {
-    pthread_mutex_unlock(&seat->mutex);
-    pthread_mutex_unlock(&user_mutex); // [중요] 나갈 때 두 락을 모두 풀어야 함
+  // 3. 좌석 예약: 빈 좌석을 CAS 로 점유하고 유저의 예약 목록에 넣는다.
+  // 좌석끼리는 CAS 로만 경합하고, bookings.mutex 는 같은 유저의 요청끼리만 잡는다.
+  UserBookings* bookings = &user->bookings;
+  bookings_lock(bookings, LOCK_SITE_BOOK);
+  if (!bookings_reserve(bookings, 1)) {
+    LOCKPROF_UNLOCK(&bookings->mutex, LOCK_SITE_BOOK);
     return BOOK_ERROR_SEAT_UNAVAILABLE; 
   }
+  seat_write_begin(event, seat_id);
+  WalSeat logged = {.seat_id = seat_id};
+  if (!seat_try_book(event, seat_id, user->id + 1, &logged.version)) {
+    seat_write_end(event, seat_id, false);
+    LOCKPROF_UNLOCK(&bookings->mutex, LOCK_SITE_BOOK);
+    return BOOK_ERROR_SEAT_UNAVAILABLE; 
+  }
+  session_log_seats(session, WAL_RECORD_BOOK, user, event, &logged, 1);
+  availability_mark(event, seat_id, true);
+  seat_write_end(event, seat_id, true);
+  bookings_insert(bookings, event->id, seat_id);
+  LOCKPROF_UNLOCK(&bookings->mutex, LOCK_SITE_BOOK);
+
+  return BOOK_ERROR_SUCCESS;
+}
 
-  // 실제 예약 수행
-  // (strdup 실패 가능성에 대한 방어 코드는 선택사항이지만 넣는 게 좋습니다)
-  char* new_booking = strdup(request->username);
-  if (new_booking == NULL) {
-      pthread_mutex_unlock(&seat->mutex);
-      pthread_mutex_unlock(&user_mutex);
-      return BOOK_ERROR_SUCCESS; // 혹은 적절한 서버 에러 처리
+// BOOK_MANY 의 좌석 번호 목록을 arena 에 읽어 낸다. 해석할 수 없는 항목은 -1.
+// 형식이 틀렸으면 (v2 에서 길이가 4 의 배수가 아님) false.
+static bool request_seat_list(const Request* request, const Session* session,
+                              int64_t** seat_ids, size_t* count) {
+  *count = 0;
+  if (session_protocol(session) == PROTOCOL_V2) {
+    if (request->data_size % sizeof(uint32_t) != 0) return false;
+    *seat_ids = arena_alloc(thread_arena(),
+                            sizeof(int64_t) * (request->data_size / sizeof(uint32_t) + 1));
+    if (*seat_ids == NULL) return false;
+    for (size_t i = 0; i < request->data_size / sizeof(uint32_t); i++) {
+      uint32_t seat_id;
+      memcpy(&seat_id, request->data + i * sizeof(uint32_t), sizeof(uint32_t));
+      (*seat_ids)[(*count)++] = seat_id;
+    }
+    return true;
+  }
+
+  // 항목 수는 길이의 절반 + 1 을 넘지 않는다 (한 글자 + 구분자)
+  *seat_ids = arena_alloc(thread_arena(), sizeof(int64_t) * (request->data_size / 2 + 1));
+  if (*seat_ids == NULL) return false;
+  const char* p = request->data;
+  while (*p != '\0') {
+    size_t len = strcspn(p, " ,\t");
+    if (len > 0) {
+      char token[24];
+      int64_t seat_id = -1;
+      if (len < sizeof(token)) {
+        memcpy(token, p, len);
+        token[len] = '\0';
+        if (is_number(token)) seat_id = strtoll(token, NULL, 10);
+      }
+      (*seat_ids)[(*count)++] = seat_id;
+      p += len;
+    }
+    if (*p != '\0') p++;
+  }
+  return true;
+}
+
+static int seat_claim_compare(const void* a, const void* b) {
+  const SeatClaim* x = a;
+  const SeatClaim* y = b;
+  if (x->seat_id != y->seat_id) return x->seat_id < y->seat_id ? -1 : 1;
+  return x->index < y->index ? -1 : x->index > y->index;
+}
+
+// claims (좌석 번호 오름차순, 중복 없음) 를 모두 점유하고 유저의 예약으로 올린다.
+// 하나라도 실패하면 그 앞까지 점유한 좌석을 되돌리고 실패한 좌석을 status 에 적는다.
+static BookErrorCode claim_seats(Event* event, UserEntry* user, Session* session,
+                                 const SeatClaim* claims, size_t n_claims,
+                                 int32_t* status) {
+  // 점유한 좌석의 버전 (성공하면 한 WAL 레코드로 남긴다)
+  WalSeat* logged = arena_alloc(thread_arena(), sizeof(WalSeat) * n_claims);
+  if (logged == NULL) {
+    return BOOK_ERROR_SEAT_UNAVAILABLE;
+  }
+
+  UserBookings* bookings = &user->bookings;
+  uint32_t owner = user->id + 1;
+  bookings_lock(bookings, LOCK_SITE_BOOK_MANY);
+  if (!bookings_reserve(bookings, n_claims)) {
+    LOCKPROF_UNLOCK(&bookings->mutex, LOCK_SITE_BOOK_MANY);
+    return BOOK_ERROR_SEAT_UNAVAILABLE;
+  }
+
+  claims_write_begin(event, claims, n_claims);
+  size_t claimed = 0;
+  while (claimed < n_claims &&
+         seat_try_transfer(event, claims[claimed].seat_id, 0, owner,
+                           &logged[claimed].version)) {
+    logged[claimed].seat_id = claims[claimed].seat_id;
+    claimed++;
+  }
+
+  if (claimed < n_claims) {
+    status[claims[claimed].index] = BOOK_ERROR_SEAT_UNAVAILABLE;
+    for (size_t i = 0; i < claimed; i++) {
+      seat_try_transfer(event, claims[i].seat_id, owner, 0, NULL);
+    }
+    // 잠깐이라도 점유했던 좌석이 있으면 그동안 읽은 reader 가 다시 읽게 한다
+    claims_write_end(event, claims, n_claims, claimed > 0);
+    LOCKPROF_UNLOCK(&bookings->mutex, LOCK_SITE_BOOK_MANY);
+    return BOOK_ERROR_SEAT_UNAVAILABLE;
   }
-  seat->user_who_booked = new_booking;
-  seat->amount_of_times_booked++;
-  
-  pthread_mutex_unlock(&seat->mutex);
-  pthread_mutex_unlock(&user_mutex); // 모든 작업이 끝나고 User Lock 해제
-  // ---------------- CRITICAL SECTION END ----------------
 
+  for (size_t i = 0; i < n_claims; i++) {
+    uint32_t seat_id = claims[i].seat_id;
+    atomic_fetch_add(&event->counters[seat_id - 1].times_booked, 1);
+    bookings_insert(bookings, event->id, seat_id);
+    availability_mark(event, seat_id, true);
+  }
+  session_log_seats(session, WAL_RECORD_BOOK, user, event, logged, n_claims);
+  claims_write_end(event, claims, n_claims, true);
+  LOCKPROF_UNLOCK(&bookings->mutex, LOCK_SITE_BOOK_MANY);
   return BOOK_ERROR_SUCCESS;
 }
 
+// 여러 좌석을 모두 예약하거나 하나도 예약하지 않는다.
+// 좌석 번호 오름차순으로 CAS 점유해 나가고, 하나라도 실패하면 이미 점유한
+// 좌석을 되돌린다. 좌석 점유는 락을 기다리지 않으므로 교착이 없고, 겹치는 두 요청은
+// 가장 작은 좌석부터 부딪혀 한쪽이 일찍 실패한다. 되돌릴 수도 있는 점유는 카운터,
+// 가용 비트맵, 예약 목록에 반영하지 않으므로 "available" 조회에는 보이지 않는다.
+// 좌석 수가 이벤트마다 다르므로 순서는 비트맵 대신 요청한 좌석만 정렬해서 정한다.
+BookErrorCode handle_book_many_request(const Request* request,
+                                       Response* response,
+                                       Session* session,
+                                       Users* users,
+                                       Seat* seats) {
+  if (request->data_size == 0 || request->data == NULL) {
+    return BOOK_ERROR_NO_DATA;
+  }
+
+  int64_t* seat_ids;
+  size_t count;
+  if (!request_seat_list(request, session, &seat_ids, &count) || count == 0) {
+    return BOOK_ERROR_NO_DATA;
+  }
+
+  UserEntry* user = find_logged_in_user(request, session);
+  if (user == NULL) {
+    return BOOK_ERROR_USER_NOT_LOGGED_IN;
+  }
+
+  // 1. 좌석별 결과 (요청 순서). 범위, 중복, 이미 예약된 좌석을 먼저 걸러 낸다.
+  Event* event = session_event(session);
+  int32_t* status = arena_alloc(thread_arena(), sizeof(int32_t) * count);
+  SeatClaim* claims = arena_alloc(thread_arena(), sizeof(SeatClaim) * count);
+  if (status == NULL || claims == NULL) {
+    return BOOK_ERROR_NO_DATA;
+  }
+  BookErrorCode code = BOOK_ERROR_SUCCESS;
+  size_t n_claims = 0;
+  for (size_t i = 0; i < count; i++) {
+    int64_t seat_id = seat_ids[i];
+    status[i] = BOOK_ERROR_SUCCESS;
+    if (event == NULL || seat_id < 1 || seat_id > event->n_seats) {
+      status[i] = BOOK_ERROR_SEAT_OUT_OF_RANGE;
+      code = BOOK_ERROR_SEAT_OUT_OF_RANGE;
+      continue;
+    }
+    claims[n_claims++] = (SeatClaim){.seat_id = (uint32_t)seat_id, .index = (uint32_t)i};
+  }
+  qsort(claims, n_claims, sizeof(SeatClaim), seat_claim_compare);
+
+  // 같은 좌석이 여러 번 나오면 첫 번째만 남긴다
+  size_t n_unique = 0;
+  for (size_t i = 0; i < n_claims; i++) {
+    SeatClaim claim = claims[i];
+    if ((n_unique > 0 && claims[n_unique - 1].seat_id == claim.seat_id) ||
+        SEAT_OWNER(atomic_load(&event->owner[claim.seat_id - 1])) != 0) {
+      status[claim.index] = BOOK_ERROR_SEAT_UNAVAILABLE;
+      if (code == BOOK_ERROR_SUCCESS) code = BOOK_ERROR_SEAT_UNAVAILABLE;
+    }
+    if (n_unique == 0 || claims[n_unique - 1].seat_id != claim.seat_id) {
+      claims[n_unique++] = claim;
+    }
+  }
+
+  // 2. 오름차순으로 점유한다
+  if (code == BOOK_ERROR_SUCCESS) {
+    code = claim_seats(event, user, session, claims, n_unique, status);
+  }
+
+  // 3. 좌석별 결과 (v1 은 i32, v2 는 i8)
+  if (session_protocol(session) == PROTOCOL_V2) {
+    int8_t* compact = (int8_t*)status;  // 앞에서부터 덮어써도 읽기가 앞선다
+    for (size_t i = 0; i < count; i++) compact[i] = (int8_t)status[i];
+    response->data_size = count * sizeof(int8_t);
+  } else {
+    response->data_size = count * sizeof(int32_t);
+  }
+  response->data = (uint8_t*)status;
+  return code;
+}
+
 ConfirmBookingErrorCode handle_confirm_booking_request(const Request* request,
                                                        Response* response,
+                                                       Session* session,
                                                        Users* users,
                                                        Seat* seats) {
   if (request->data_size == 0 || request->data == NULL) {
@@ -130,56 +881,62 @@ ConfirmBookingErrorCode handle_confirm_booking_request(const Request* request,
   }
 
   // 1. 유저 로그인 확인
-  pthread_mutex_lock(&user_mutex);
-  ssize_t uid = find_user(users, request->username);
-  if (uid == -1 || !users->array[uid].logged_in) {
-    pthread_mutex_unlock(&user_mutex);
+  UserEntry* user = find_logged_in_user(request, session);
+  if (user == NULL) {
     return CONFIRM_BOOKING_ERROR_USER_NOT_LOGGED_IN;
   }
-  pthread_mutex_unlock(&user_mutex);
 
-  // 2. 요청 타입 확인 ("available" or "booked")
+  // 2. 요청 타입 확인 ("available" or "booked", v2 는 1 바이트 종류)
+  bool v2 = session_protocol(session) == PROTOCOL_V2;
   bool check_available = false;
-  if (strcmp(request->data, "available") == 0) {
+  if (v2 ? request->data_size == 1 && (uint8_t)request->data[0] == V2_CONFIRM_AVAILABLE
+         : strcmp(request->data, "available") == 0) {
     check_available = true;
-  } else if (strcmp(request->data, "booked") == 0) {
+  } else if (v2 ? request->data_size == 1 && (uint8_t)request->data[0] == V2_CONFIRM_BOOKED
+                : strcmp(request->data, "booked") == 0) {
     check_available = false;
   } else {
     return CONFIRM_BOOKING_ERROR_INVALID_DATA;
   }
 
   // 3. 좌석 정보 수집
-  // 응답 데이터는 size_t(pa3_seat_t) 배열이어야 함. 최대 100개.
-  size_t* result_array = malloc(sizeof(size_t) * NUM_SEATS);
-  int count = 0;
-
-  for (int i = 0; i < NUM_SEATS; i++) {
-    pthread_mutex_lock(&seats[i].mutex);
-    bool condition_met = false;
-    
-    if (check_available) {
-      if (seats[i].user_who_booked == NULL) condition_met = true;
-    } else {
-      if (seats[i].user_who_booked != NULL && 
-          strcmp(seats[i].user_who_booked, request->username) == 0) {
-        condition_met = true;
-      }
-    }
+  // 응답 데이터는 size_t(pa3_seat_t) 배열이어야 함 (v2 는 u32 배열). 최대 이벤트 좌석 수.
+  size_t id_size = v2 ? sizeof(uint32_t) : sizeof(size_t);
+  void* result_array;
+  size_t count = 0;
 
-    if (condition_met) {
-      result_array[count++] = seats[i].id;
+  if (check_available) {
+    // 빈 좌석 목록은 스레드별 캐시를 그대로 응답으로 쓴다 (response_release 가 해제하지 않음)
+    Event* event = session_event(session);
+    result_array = event != NULL ? availability_snapshot(event, id_size, &count) : NULL;
+  } else {
+    // 내 좌석은 예약 목록에서 이 이벤트 구간만 복사한다 (전체 좌석을 훑지 않는다)
+    uint32_t event_id = session != NULL ? session->event_id : EVENT_DEFAULT_ID;
+    UserBookings* bookings = &user->bookings;
+    bookings_lock(bookings, LOCK_SITE_CONFIRM);
+    size_t begin = bookings_lower_bound(bookings, BOOKING_KEY(event_id, 0));
+    size_t end = bookings_lower_bound(bookings, BOOKING_KEY(event_id + 1ULL, 0));
+    count = end - begin;
+    result_array = arena_alloc(thread_arena(), id_size * (count ? count : 1));
+    for (size_t i = 0; result_array != NULL && i < count; i++) {
+      uint32_t seat_id = BOOKING_SEAT(bookings->keys[begin + i]);
+      if (v2) {
+        ((uint32_t*)result_array)[i] = seat_id;
+      } else {
+        ((size_t*)result_array)[i] = seat_id;
+      }
     }
-    pthread_mutex_unlock(&seats[i].mutex);
+    LOCKPROF_UNLOCK(&bookings->mutex, LOCK_SITE_CONFIRM);
   }
+  if (result_array == NULL) count = 0;
 
   // 4. 응답 설정
   response->data = (uint8_t*)result_array;
-  response->data_size = count * sizeof(size_t);
+  response->data_size = count * id_size;
   
   // 만약 데이터가 없으면 free하고 NULL 처리 (프로토콜상 size 0이면 data 무시됨)
   if (count == 0) {
-      free(result_array);
-      response->data = NULL;
+      response_release(response);
   }
 
   return CONFIRM_BOOKING_ERROR_SUCCESS;
@@ -187,6 +944,7 @@ ConfirmBookingErrorCode handle_confirm_booking_request(const Request* request,
 
 int32_t handle_cancel_booking_request(const Request* request,
                                       Response* response,
+                                      Session* session,
                                       Users* users,
                                       Seat* seats) {
   if (request->data_size == 0 || request->data == NULL) {
@@ -194,99 +952,105 @@ int32_t handle_cancel_booking_request(const Request* request,
   }
 
   // 1. 유저 로그인 확인
-  pthread_mutex_lock(&user_mutex);
-  ssize_t uid = find_user(users, request->username);
-  if (uid == -1 || !users->array[uid].logged_in) {
-    pthread_mutex_unlock(&user_mutex);
+  UserEntry* user = find_logged_in_user(request, session);
+  if (user == NULL) {
     return CANCEL_BOOKING_ERROR_USER_NOT_LOGGED_IN;
   }
-  pthread_mutex_unlock(&user_mutex);
 
   // 2. 좌석 번호 확인
-  if (!is_number(request->data)) {
-      return CANCEL_BOOKING_ERROR_SEAT_OUT_OF_RANGE;
-  }
-  int seat_id = atoi(request->data);
-  if (seat_id < 1 || seat_id > NUM_SEATS) {
+  Event* event = session_event(session);
+  int64_t seat_id = request_seat_id(request, session);
+  if (event == NULL || seat_id < 1 || seat_id > event->n_seats) {
     return CANCEL_BOOKING_ERROR_SEAT_OUT_OF_RANGE;
   }
 
-  // 3. 취소 처리
-  Seat* seat = &seats[seat_id - 1];
-  pthread_mutex_lock(&seat->mutex);
-
-  if (seat->user_who_booked == NULL || 
-      strcmp(seat->user_who_booked, request->username) != 0) {
-    pthread_mutex_unlock(&seat->mutex);
+  // 3. 취소 처리: 내 좌석일 때만 CAS 로 비우고 예약 목록에서 뺀다
+  UserBookings* bookings = &user->bookings;
+  bookings_lock(bookings, LOCK_SITE_CANCEL);
+  seat_write_begin(event, seat_id);
+  WalSeat logged = {.seat_id = seat_id};
+  if (!seat_try_cancel(event, seat_id, user->id + 1, &logged.version)) {
+    seat_write_end(event, seat_id, false);
+    LOCKPROF_UNLOCK(&bookings->mutex, LOCK_SITE_CANCEL);
     return CANCEL_BOOKING_ERROR_SEAT_NOT_BOOKED_BY_USER;
   }
-
-  // 예약 해제
-  free((void*)seat->user_who_booked);
-  seat->user_who_booked = NULL;
-  seat->amount_of_times_canceled++;
-
-  pthread_mutex_unlock(&seat->mutex);
+  session_log_seats(session, WAL_RECORD_CANCEL, user, event, &logged, 1);
+  availability_mark(event, seat_id, false);
+  seat_write_end(event, seat_id, true);
+  bookings_remove(bookings, event->id, seat_id);
+  LOCKPROF_UNLOCK(&bookings->mutex, LOCK_SITE_CANCEL);
 
   return CANCEL_BOOKING_ERROR_SUCCESS;
 }
 
 int32_t handle_logout_request(const Request* request,
                               Response* response,
+                              Session* session,
                               Users* users) {
-  pthread_mutex_lock(&user_mutex);
-  
-  ssize_t uid = find_user(users, request->username);
-  
-  if (uid == -1) {
-    pthread_mutex_unlock(&user_mutex);
+  // 세션 유저가 아직 로그인되어 있으면 그 유저를 로그아웃한다
+  UserEntry* user = find_logged_in_user(request, session);
+  if (user == NULL) {
+    user = user_table_find(request->username);
+  }
+  if (session != NULL) {
+    session->user_id = USER_ID_NONE;
+  }
+
+  if (user == NULL) {
     return LOGOUT_ERROR_USER_NOT_FOUND;
   }
 
-  if (!users->array[uid].logged_in) {
-    pthread_mutex_unlock(&user_mutex);
+  bool expected = true;
+  if (!atomic_compare_exchange_strong(&user->logged_in, &expected, false)) {
     return LOGOUT_ERROR_USER_NOT_LOGGED_IN;
   }
 
-  users->array[uid].logged_in = false;
-  pthread_mutex_unlock(&user_mutex);
-
   return LOGOUT_ERROR_SUCCESS;
 }
 
 int32_t handle_query_request(const Request* request,
                              Response* response,
+                             Session* session,
                              Seat* seats) {
   if (request->data_size == 0 || request->data == NULL) {
       return QUERY_ERROR_NO_DATA;
   }
 
   // 1. 좌석 번호 확인
-  if (!is_number(request->data)) {
+  Event* event = session_event(session);
+  int64_t seat_id = request_seat_id(request, session);
+  if (event == NULL || seat_id < 1 || seat_id > event->n_seats) {
+    return QUERY_ERROR_SEAT_OUT_OF_RANGE;
+  }
+
+  // 2. 좌석 정보 조회 (카운터와 예약 여부를 한 시점의 값으로 읽는다)
+  SeatRecord record;
+  seat_snapshot(event, seat_id, seat_id, &record);
+
+  // v2 는 고정 배치의 SeatRecord 를 보낸다
+  if (session_protocol(session) == PROTOCOL_V2) {
+    SeatRecord* out = arena_alloc(thread_arena(), sizeof(SeatRecord));
+    if (out == NULL) {
       return QUERY_ERROR_SEAT_OUT_OF_RANGE;
+    }
+    *out = record;
+    response->data = (uint8_t*)out;
+    response->data_size = sizeof(SeatRecord);
+    return QUERY_ERROR_SUCCESS;
   }
-  int seat_id = atoi(request->data);
-  if (seat_id < 1 || seat_id > NUM_SEATS) {
+
+  // v1 클라이언트는 Seat 구조체 전체를 바이너리로 받기를 원함 [cite: 265]
+  Seat* seat_data = arena_alloc(thread_arena(), sizeof(Seat));
+  if (seat_data == NULL) {
     return QUERY_ERROR_SEAT_OUT_OF_RANGE;
   }
+  memset(seat_data, 0, sizeof(Seat));
 
-  // 2. 좌석 정보 조회
-  // 클라이언트는 Seat 구조체 전체를 바이너리로 받기를 원함 [cite: 265]
-  Seat* seat_data = malloc(sizeof(Seat));
-  Seat* target_seat = &seats[seat_id - 1];
-  
-  pthread_mutex_lock(&target_seat->mutex);
-  
-  // 구조체 복사 (Deep copy of user_who_booked is tricky here, 
-  // but client mainly needs IDs and counts. 
-  // user_who_booked is a pointer. Sending a pointer value to client is meaningless.
-  // However, client code sets seat->user_who_booked = nullptr after memcpy.
-  // So a shallow copy of the struct is fine for the counts and ID.)
-  memcpy(seat_data, target_seat, sizeof(Seat));
-  
-  pthread_mutex_unlock(&target_seat->mutex);
+  seat_data->id = seat_id;
+  seat_data->amount_of_times_booked = record.times_booked;
+  seat_data->amount_of_times_canceled = record.times_canceled;
 
-  // 포인터 정보는 클라이언트에서 의미 없으므로 NULL 처리 (선택사항, 클라이언트가 어차피 덮어씀)
+  // 포인터 정보는 클라이언트에서 의미 없으므로 NULL (클라이언트가 어차피 덮어씀)
   seat_data->user_who_booked = NULL;
   // 뮤텍스도 클라이언트에서 쓸 일 없음
 
@@ -296,34 +1060,263 @@ int32_t handle_query_request(const Request* request,
   return QUERY_ERROR_SUCCESS;
 }
 
+// QUERY_RANGE 의 first, last. v1 은 "first last" (또는 "first-last"), v2 는 u32 두 개.
+static bool request_seat_range(const Request* request, const Session* session,
+                               int64_t* first, int64_t* last) {
+  if (session_protocol(session) == PROTOCOL_V2) {
+    if (request->data_size != 2 * sizeof(uint32_t)) return false;
+    uint32_t bounds[2];
+    memcpy(bounds, request->data, sizeof(bounds));
+    *first = bounds[0];
+    *last = bounds[1];
+    return true;
+  }
+
+  char* end;
+  *first = strtoll(request->data, &end, 10);
+  if (end == request->data || (*end != ' ' && *end != '-' && *end != ',')) return false;
+  const char* second = end + 1;
+  *last = strtoll(second, &end, 10);
+  return end != second && *end == '\0';
+}
+
+// 여러 좌석을 한 번에 조회한다. 좌석마다 락을 잡지 않고 seat_snapshot 으로
+// 한 시점의 상태를 읽는다.
+int32_t handle_query_range_request(const Request* request,
+                                   Response* response,
+                                   Session* session) {
+  if (request->data_size == 0 || request->data == NULL) {
+    return QUERY_ERROR_NO_DATA;
+  }
+
+  Event* event = session_event(session);
+  int64_t first, last;
+  if (event == NULL || !request_seat_range(request, session, &first, &last) ||
+      first < 1 || last > event->n_seats || first > last ||
+      last - first + 1 > QUERY_RANGE_MAX_SEATS) {
+    return QUERY_ERROR_SEAT_OUT_OF_RANGE;
+  }
+
+  size_t count = last - first + 1;
+  SeatRecord* records = arena_alloc(thread_arena(), sizeof(SeatRecord) * count);
+  if (records == NULL) {
+    return QUERY_ERROR_SEAT_OUT_OF_RANGE;
+  }
+  seat_snapshot(event, first, last, records);
+
+  response->data = (uint8_t*)records;
+  response->data_size = sizeof(SeatRecord) * count;
+  return QUERY_ERROR_SUCCESS;
+}
+
+// 연결이 다룰 이벤트를 바꾼다. 세션이 없으면 (handle_request) 바꿀 곳이 없다.
+int32_t handle_select_event_request(const Request* request,
+                                    Response* response,
+                                    Session* session) {
+  if (session == NULL) {
+    return -1;
+  }
+  if (request->data_size == 0 || request->data == NULL) {
+    return SELECT_EVENT_ERROR_NO_DATA;
+  }
+
+  int64_t event_id = request_seat_id(request, session);  // 같은 인코딩 (10진 / u32)
+  Event* event = event_id >= 0 && event_id <= UINT32_MAX
+                     ? event_table_get((uint32_t)event_id)
+                     : NULL;
+  if (event == NULL) {
+    return SELECT_EVENT_ERROR_NOT_FOUND;
+  }
+  session->event_id = event->id;
+
+  // 좌석 수를 알려 준다
+  bool v2 = session_protocol(session) == PROTOCOL_V2;
+  void* out = arena_alloc(thread_arena(), sizeof(size_t));
+  if (out != NULL) {
+    if (v2) {
+      *(uint32_t*)out = event->n_seats;
+    } else {
+      *(size_t*)out = event->n_seats;
+    }
+    response->data = out;
+    response->data_size = v2 ? sizeof(uint32_t) : sizeof(size_t);
+  }
+  return SELECT_EVENT_ERROR_SUCCESS;
+}
+
+// 재생하는 동안의 좌석 상태. 시작할 때 좌석을 모두 훑지 않도록 로그가 건드린
+// 좌석만 기억한다.
+// - restore_base: 좌석마다 스냅샷 버전 + 1 (0 이면 아직 건드리지 않음). 이 버전
+//   이하의 레코드는 이미 스냅샷의 카운터에 들어 있다. calloc 으로 받으므로 큰
+//   이벤트도 건드린 좌석의 페이지만 메모리를 먹는다.
+// - restore_touched: 건드린 좌석과 지금 가용 비트맵/예약 목록에 반영된 owner.
+//   seats_restore_finish 가 이것만 최종 owner 와 맞춘다.
+typedef struct {
+  uint32_t event_id;
+  uint32_t seat_id;
+  uint32_t applied_owner;  // 유저 id + 1, 0 이면 반영된 예약 없음
+} RestoreSeat;
+
+static uint32_t* restore_base[EVENT_MAX_EVENTS];
+static RestoreSeat* restore_touched;
+static size_t restore_touched_count;
+static size_t restore_touched_cap;
+
+void seats_restore_begin(void) {
+  for (uint32_t event_id = 0; event_id < EVENT_MAX_EVENTS; event_id++) {
+    Event* event = event_table_get(event_id);
+    if (event == NULL) continue;
+    restore_base[event_id] = calloc(event->n_seats, sizeof(uint32_t));
+    if (restore_base[event_id] == NULL) {
+      perror("seats_restore_begin");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+// 좌석을 처음 건드리면 지금 (스냅샷) 버전을 기억하고 건드린 목록에 넣는다.
+// 스냅샷 버전을 돌려준다.
+static uint32_t restore_touch(Event* event, uint32_t seat_id, uint32_t applied_owner) {
+  uint32_t* base = &restore_base[event->id][seat_id - 1];
+  if (*base != 0) return *base - 1;
+
+  uint32_t version = SEAT_VERSION(atomic_load(&event->owner[seat_id - 1]));
+  *base = version + 1;
+  if (restore_touched_count == restore_touched_cap) {
+    size_t cap = restore_touched_cap ? restore_touched_cap * 2 : 1024;
+    RestoreSeat* grown = realloc(restore_touched, cap * sizeof(RestoreSeat));
+    if (grown == NULL) {
+      perror("seats_restore");
+      exit(EXIT_FAILURE);
+    }
+    restore_touched = grown;
+    restore_touched_cap = cap;
+  }
+  restore_touched[restore_touched_count++] =
+      (RestoreSeat){.event_id = event->id, .seat_id = seat_id, .applied_owner = applied_owner};
+  return version;
+}
+
+// 예약 하나를 가용 비트맵과 유저 예약 목록에 넣는다. 유저가 없거나 메모리가 없으면 false.
+static bool restore_apply(Event* event, uint32_t seat_id, uint32_t user_id) {
+  UserEntry* user = user_table_get(user_id);
+  if (user == NULL || !bookings_reserve(&user->bookings, 1)) return false;
+  availability_mark(event, seat_id, true);
+  bookings_insert(&user->bookings, event->id, seat_id);
+  return true;
+}
+
+void seats_restore_booking(Event* event, uint32_t seat_id, uint32_t user_id) {
+  if (seat_id < 1 || seat_id > event->n_seats) return;
+  // 스냅샷을 쓰는 사이 등록된 유저는 등록 레코드가 로그 꼬리에 있다. 재생이 끝난 뒤 맞춘다.
+  if (!restore_apply(event, seat_id, user_id)) restore_touch(event, seat_id, 0);
+}
+
+// WAL 재생: 레코드 하나를 유저 테이블과 좌석 상태에 반영한다.
+// 좌석은 가장 큰 버전의 레코드가 마지막 상태이고, 카운터는 스냅샷보다 새 레코드만 센다.
+// 스냅샷은 로그 위치를 먼저 읽고 나서 좌석을 복사하므로, 그 위치 뒤의 레코드 중
+// 일부는 이미 스냅샷에 들어 있다. 버전으로 거르므로 두 번 세지 않는다.
+void seats_restore_record(const WalRecord* record) {
+  if (record->type == WAL_RECORD_REGISTER) {
+    user_table_restore(record->user_id, record->username, record->hashed_password);
+    return;
+  }
+
+  Event* event = event_table_get(record->event_id);
+  if (event == NULL) return;  // --event 설정이 바뀌었다
+  bool book = record->type == WAL_RECORD_BOOK;
+  for (uint32_t i = 0; i < record->n_seats; i++) {
+    uint32_t seat_id = record->seats[i].seat_id;
+    uint32_t version = record->seats[i].version;
+    if (seat_id < 1 || seat_id > event->n_seats) continue;
+
+    // 처음 건드리는 좌석이면 스냅샷의 owner 가 이미 반영되어 있다 (seats_restore_booking)
+    uint64_t word = atomic_load(&event->owner[seat_id - 1]);
+    if (version > restore_touch(event, seat_id, SEAT_OWNER(word))) {
+      SeatCounters* counters = &event->counters[seat_id - 1];
+      atomic_fetch_add(book ? &counters->times_booked : &counters->times_canceled, 1);
+    }
+    if (version > SEAT_VERSION(word)) {
+      atomic_store(&event->owner[seat_id - 1], SEAT_WORD(book ? record->user_id + 1 : 0, version));
+    }
+  }
+}
+
+// WAL 재생이 끝난 뒤 건드린 좌석만 최종 owner 에 맞춰 가용 비트맵과 유저 예약
+// 목록을 고친다. 나머지 좌석은 스냅샷의 예약 목록에서 이미 채웠다.
+void seats_restore_finish(void) {
+  for (size_t i = 0; i < restore_touched_count; i++) {
+    const RestoreSeat* seat = &restore_touched[i];
+    Event* event = event_table_get(seat->event_id);
+    uint64_t word = atomic_load(&event->owner[seat->seat_id - 1]);
+    if (SEAT_OWNER(word) == seat->applied_owner) continue;
+
+    if (seat->applied_owner != 0) {
+      UserEntry* user = user_table_get(seat->applied_owner - 1);
+      bookings_remove(&user->bookings, event->id, seat->seat_id);
+      availability_mark(event, seat->seat_id, false);
+    }
+    if (SEAT_OWNER(word) != 0 && !restore_apply(event, seat->seat_id, SEAT_OWNER(word) - 1)) {
+      // 등록 레코드가 잘려 나갔다. 그 유저의 예약은 응답이 나간 적이 없다.
+      atomic_store(&event->owner[seat->seat_id - 1], SEAT_WORD(0, SEAT_VERSION(word)));
+    }
+  }
+
+  for (uint32_t event_id = 0; event_id < EVENT_MAX_EVENTS; event_id++) {
+    free(restore_base[event_id]);
+    restore_base[event_id] = NULL;
+  }
+  free(restore_touched);
+  restore_touched = NULL;
+  restore_touched_count = restore_touched_cap = 0;
+}
+
 int32_t handle_request(const Request* request,
                        Response* response,
                        Users* users,
                        Seat* seats) {
+  return handle_session_request(request, response, NULL, users, seats);
+}
+
+int32_t handle_session_request(const Request* request,
+                               Response* response,
+                               Session* session,
+                               Users* users,
+                               Seat* seats) {
   // 응답 데이터 초기화
   response->data = NULL;
   response->data_size = 0;
   
   int32_t ret_code;
 
-  switch (request->action) {
+  // ACTION_BOOK_MANY 같은 확장 action 도 있으므로 정수로 비교한다
+  switch ((int32_t)request->action) {
     case ACTION_LOGIN:
-      ret_code = handle_login_request(request, response, users);
+      ret_code = handle_login_request(request, response, session, users);
       break;
     case ACTION_BOOK:
-      ret_code = handle_book_request(request, response, users, seats);
+      ret_code = handle_book_request(request, response, session, users, seats);
+      break;
+    case ACTION_BOOK_MANY:
+      ret_code = handle_book_many_request(request, response, session, users, seats);
       break;
     case ACTION_CONFIRM_BOOKING:
-      ret_code = handle_confirm_booking_request(request, response, users, seats);
+      ret_code = handle_confirm_booking_request(request, response, session, users, seats);
       break;
     case ACTION_CANCEL_BOOKING:
-      ret_code = handle_cancel_booking_request(request, response, users, seats);
+      ret_code = handle_cancel_booking_request(request, response, session, users, seats);
       break;
     case ACTION_LOGOUT:
-      ret_code = handle_logout_request(request, response, users);
+      ret_code = handle_logout_request(request, response, session, users);
       break;
     case ACTION_QUERY:
-      ret_code = handle_query_request(request, response, seats);
+      ret_code = handle_query_request(request, response, session, seats);
+      break;
+    case ACTION_QUERY_RANGE:
+      ret_code = handle_query_range_request(request, response, session);
+      break;
+    case ACTION_SELECT_EVENT:
+      ret_code = handle_select_event_request(request, response, session);
       break;
     case ACTION_TERMINATION:
       // 서버는 TERMINATION 액션을 받으면 안됨 (PDF 명세 [cite: 147])
@@ -336,5 +1329,6 @@ int32_t handle_request(const Request* request,
   }
   
   response->code = ret_code;
-  return 0; // handle_request return value is typically 0 on success logic flow
+  // 서버는 반환값을 res.code 에 그대로 저장하므로 코드를 돌려줘야 한다
+  return ret_code;
 }
@@ -0,0 +1,85 @@
+#ifndef HANDLE_REQUEST_H
+#define HANDLE_REQUEST_H
+
+#include <helper.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "event_table.h"
+#include "protocol.h"
+#include "user_table.h"
+#include "wal.h"
+
+// 연결에 묶인 로그인 세션. LOGIN 이 성공하면 그 유저의 id 를 기억해 두고,
+// 같은 연결의 다음 요청은 username 을 찾지 않고 id 로 바로 유저를 얻는다.
+// 세션 유저가 (다른 연결에서) 로그아웃했으면 세션을 풀고 username 으로 찾는다.
+// protocol 은 이 연결이 협상한 와이어 버전으로, 요청 data 와 응답 data 의
+// 인코딩(문자열/바이너리 좌석 번호)을 정한다. event_id 는 SELECT_EVENT 로 고른
+// 이벤트로, 좌석 번호는 이 이벤트의 좌석 맵에서 찾는다.
+// wal_lsn 은 이 연결이 남긴 마지막 WAL 레코드의 위치로, 동기 모드에서 서버는
+// 이 위치까지 fsync 된 뒤에 응답을 내보낸다.
+typedef struct {
+  uint32_t user_id;   // 없으면 USER_ID_NONE
+  uint32_t event_id;  // 기본은 EVENT_DEFAULT_ID
+  uint8_t protocol;   // PROTOCOL_V1 또는 PROTOCOL_V2
+  uint64_t wal_lsn;   // 0 이면 기다릴 것 없음
+} Session;
+
+#define SESSION_INIT \
+  {.user_id = USER_ID_NONE, .event_id = EVENT_DEFAULT_ID, .protocol = PROTOCOL_V1}
+
+// handle_request 와 같지만 session 으로 로그인 상태를 이어 간다. session 은 NULL 이어도 된다.
+int32_t handle_session_request(const Request* request,
+                               Response* response,
+                               Session* session,
+                               Users* users,
+                               Seat* seats);
+
+// 로그인은 비밀번호 해시(CPU 를 많이 쓰는 부분)를 사이에 두고 세 단계로 나뉜다.
+// login_begin/login_finish 는 I/O 워커에서, login_run_hash 는 해시 풀에서 돈다.
+// handle_login_request 는 세 단계를 한 스레드에서 차례로 부른다.
+typedef enum {
+  LOGIN_STEP_DONE,      // 해시 없이 결과가 정해졌다 (code)
+  LOGIN_STEP_REGISTER,  // 신규 유저: password 를 해시해서 등록한다
+  LOGIN_STEP_VALIDATE,  // 기존 유저: password 를 저장된 해시와 비교한다
+} LoginStep;
+
+typedef struct {
+  LoginStep step;
+  int32_t code;
+  UserEntry* user;  // VALIDATE 대상
+  char* username;   // 요청에서 복사한 값 (login_finish 가 해제)
+  char* password;
+  char hashed_password[HASHED_PASSWORD_SIZE];  // REGISTER 결과
+  bool password_ok;                            // VALIDATE 결과
+} LoginJob;
+
+// handle_request 가 채운 응답 데이터를 놓는다. 응답 데이터는 호출한 스레드의
+// arena (thread_arena) 나 응답 캐시에 있으므로 free 하지 말고 이것을 부른다.
+// arena 메모리는 호출한 쪽이 요청 묶음을 끝낸 뒤 arena_reset 으로 되돌린다.
+void response_release(Response* response);
+// 이 스레드의 응답 캐시 ("available" 목록) 를 해제한다. handle_request 를 부르던
+// 스레드가 끝날 때 부른다.
+void response_cache_release(void);
+
+void login_begin(const Request* request, LoginJob* job);
+void login_run_hash(LoginJob* job);
+// 해시 결과를 반영해 로그인 상태를 바꾸고 응답 코드를 돌려준다.
+// 성공하면 session (NULL 이 아니면) 에 유저를 묶는다.
+int32_t login_finish(LoginJob* job, Session* session);
+
+// 시작할 때 스냅샷을 올리고 WAL 을 재생한다 (워커를 띄우기 전). 스냅샷을 읽기
+// 전에 seats_restore_begin 을 부르고, 스냅샷의 예약마다 seats_restore_booking,
+// 로그 레코드마다 seats_restore_record 를 부른 뒤 seats_restore_finish 로 로그가
+// 건드린 좌석의 가용 비트맵과 유저 예약 목록을 맞춘다. 좌석 전체를 훑지 않으므로
+// 시작 시간은 예약 수와 로그 꼬리 길이에 비례한다.
+void seats_restore_begin(void);
+void seats_restore_booking(Event* event, uint32_t seat_id, uint32_t user_id);
+void seats_restore_record(const WalRecord* record);
+void seats_restore_finish(void);
+
+// 스냅샷용: 이벤트의 좌석 [first, first + count) (0 부터 센 자리) 를 writer 가 없는
+// 한 시점의 값으로 복사한다. 워커를 멈추지 않고 이 구간의 writer 만 잠깐 기다린다.
+void seats_checkpoint(Event* event, uint32_t first, uint32_t count,
+                      uint64_t* owner, SeatCounters* counters);
+
+#endif
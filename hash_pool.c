@@ -0,0 +1,79 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "hash_pool.h"
+#include "lockprof.h"
+
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static HashTask* queue_head = NULL;
+static HashTask* queue_tail = NULL;
+static bool stopping = false;
+
+static pthread_t* threads = NULL;
+static size_t n_threads_started = 0;
+
+static void* hash_thread_func(void* arg) {
+  while (true) {
+    pthread_mutex_lock(&queue_mutex);
+    while (queue_head == NULL && !stopping) {
+      pthread_cond_wait(&queue_cond, &queue_mutex);
+    }
+    // 멈출 때도 이미 받은 task 는 끝까지 처리해서 돌려준다
+    if (queue_head == NULL) {
+      pthread_mutex_unlock(&queue_mutex);
+      break;
+    }
+    HashTask* task = queue_head;
+    queue_head = task->next;
+    if (queue_head == NULL) queue_tail = NULL;
+    pthread_mutex_unlock(&queue_mutex);
+
+    task->next = NULL;
+    login_run_hash(&task->job);
+    task->done(task);
+  }
+  return NULL;
+}
+
+bool hash_pool_start(size_t n_threads) {
+  threads = malloc(sizeof(pthread_t) * n_threads);
+  if (threads == NULL) return false;
+
+  for (size_t i = 0; i < n_threads; i++) {
+    if (pthread_create(&threads[i], NULL, hash_thread_func, NULL) != 0) {
+      perror("pthread_create (hash pool)");
+      hash_pool_stop();
+      return false;
+    }
+    n_threads_started++;
+  }
+  return true;
+}
+
+void hash_pool_submit(HashTask* task) {
+  task->next = NULL;
+  LOCKPROF_LOCK(&queue_mutex, LOCK_SITE_HASH_QUEUE);
+  if (queue_tail != NULL) {
+    queue_tail->next = task;
+  } else {
+    queue_head = task;
+  }
+  queue_tail = task;
+  pthread_cond_signal(&queue_cond);
+  LOCKPROF_UNLOCK(&queue_mutex, LOCK_SITE_HASH_QUEUE);
+}
+
+void hash_pool_stop(void) {
+  pthread_mutex_lock(&queue_mutex);
+  stopping = true;
+  pthread_cond_broadcast(&queue_cond);
+  pthread_mutex_unlock(&queue_mutex);
+
+  for (size_t i = 0; i < n_threads_started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  threads = NULL;
+  n_threads_started = 0;
+}
@@ -0,0 +1,27 @@
+#ifndef HASH_POOL_H
+#define HASH_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "handle_request.h"
+
+// 로그인 비밀번호 해시를 I/O 워커 대신 처리하는 전용 스레드 풀.
+// 워커는 task 를 넘기고 연결을 멈춰 두었다가, done 콜백으로 돌려받은
+// task 에 login_finish 를 불러 응답을 마무리한다.
+typedef struct HashTask {
+  LoginJob job;
+  void (*done)(struct HashTask* task);  // 해시가 끝나면 풀 스레드에서 호출
+  void* owner;                          // 호출한 쪽이 쓰는 값 (연결 등)
+  size_t worker;                        // 완료를 받을 워커
+  uint64_t started_ns;                  // 요청을 받은 시각 (metrics_now)
+  struct HashTask* next;
+} HashTask;
+
+bool hash_pool_start(size_t n_threads);
+void hash_pool_submit(HashTask* task);
+// 이미 받은 task 를 모두 처리해 done 으로 돌려준 뒤 스레드를 종료한다.
+// task 를 넘기는 쪽 (워커) 이 모두 끝난 뒤에 부른다.
+void hash_pool_stop(void);
+
+#endif
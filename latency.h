@@ -0,0 +1,60 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// 지연을 재는 데 쓰는 시계와 히스토그램. 서버 (metrics, trace, 연결 재분배),
+// handle_bench, pa3_bench 가 함께 쓴다.
+
+// 단조 시계 (ns)
+static inline uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// log-linear 히스토그램 (HDR 히스토그램처럼): 2^sub_bits 미만은 값마다 버킷
+// 하나, 그 위로는 2의 거듭제곱 구간마다 하위 버킷 2^(sub_bits - 1) 개. 상대
+// 오차는 2^-(sub_bits - 1) 이하이고 크기는 고정이다. sub_bits 는 쓰는 쪽의 상수라
+// 인라인되면 나눗셈 없이 시프트로 바뀐다.
+#define HIST_BUCKETS(sub_bits) \
+  ((1u << (sub_bits)) + (64 - (sub_bits)) * (1u << ((sub_bits) - 1)))
+
+static inline size_t hist_index(uint64_t value, uint32_t sub_bits) {
+  uint64_t sub_count = 1ull << sub_bits;
+  uint64_t half_count = sub_count / 2;
+  if (value < sub_count) return value;
+  int32_t shift = 63 - __builtin_clzll(value) - (int32_t)(sub_bits - 1);
+  return sub_count + (size_t)(shift - 1) * half_count + ((value >> shift) - half_count);
+}
+
+// 버킷에 들어가는 가장 큰 값
+static inline uint64_t hist_value(size_t index, uint32_t sub_bits) {
+  size_t sub_count = (size_t)1 << sub_bits;
+  size_t half_count = sub_count / 2;
+  if (index < sub_count) return index;
+  size_t shift = (index - sub_count) / half_count + 1;
+  uint64_t top = (index - sub_count) % half_count + half_count;
+  return ((top + 1) << shift) - 1;
+}
+
+// counts (HIST_BUCKETS(sub_bits) 개) 의 q 분위 값. 버킷의 상한을 돌려주되 max 를
+// 넘지 않는다. 비었으면 0.
+static inline uint64_t hist_percentile(const uint64_t* counts, uint32_t sub_bits,
+                                       uint64_t max, double q) {
+  uint64_t total = 0;
+  for (size_t i = 0; i < HIST_BUCKETS(sub_bits); i++) total += counts[i];
+  if (total == 0) return 0;
+  uint64_t rank = (uint64_t)(q * total + 0.999999);
+  if (rank == 0) rank = 1;
+  uint64_t seen = 0;
+  for (size_t i = 0; i < HIST_BUCKETS(sub_bits); i++) {
+    seen += counts[i];
+    if (seen >= rank) return hist_value(i, sub_bits) < max ? hist_value(i, sub_bits) : max;
+  }
+  return max;
+}
+
+#endif
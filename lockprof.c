@@ -0,0 +1,258 @@
+#include <stdlib.h>
+#include "lockprof.h"
+
+#ifdef LOCK_PROFILE
+
+#include <stdatomic.h>
+#include <string.h>
+#include "latency.h"
+
+// 경합 좌석 표의 칸 수와 보고서에 싣는 좌석 수
+#define LOCKPROF_SEAT_SLOTS 4096
+#define LOCKPROF_SEAT_PROBES 16
+#define LOCKPROF_TOP_SEATS 16
+
+typedef struct {
+  _Atomic uint64_t acquired;
+  _Atomic uint64_t contended;  // trylock 이 실패해서 기다린 횟수
+  _Atomic uint64_t wait_ns;
+  _Atomic uint64_t wait_max_ns;
+  _Atomic uint64_t hold_ns;
+  _Atomic uint64_t hold_max_ns;
+} SiteStats;
+
+// 스레드 하나의 칸. 주인 스레드만 쓰고 (relaxed load + store) 보고서는 relaxed 로
+// 읽어 합친다. 스레드가 끝나도 값이 남도록 해제하지 않는다.
+typedef struct ThreadStats {
+  _Alignas(64) SiteStats sites[LOCK_N_SITES];
+  uint64_t held_since[LOCK_N_SITES];  // 주인 스레드만 읽고 쓴다
+  struct ThreadStats* next;
+} ThreadStats;
+
+// 좌석 칸. key 는 (이벤트 id << 32 | 좌석 번호) + 1, 0 은 빈 칸.
+typedef struct {
+  _Atomic uint64_t key;
+  _Atomic uint64_t retries;
+  _Atomic uint64_t refused;
+} SeatStats;
+
+static struct {
+  pthread_mutex_t mutex;  // threads 목록 (프로파일하지 않는다)
+  ThreadStats* threads;
+  SeatStats seats[LOCKPROF_SEAT_SLOTS];
+  _Atomic uint64_t seats_dropped;  // 표가 차서 못 센 좌석 기록
+} lockprof = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+static _Thread_local ThreadStats* local_stats;
+
+static const char* site_names[LOCK_N_SITES] = {
+  "bookings/book", "bookings/book_many", "bookings/confirm", "bookings/cancel",
+  "seat_write", "user_insert", "wal_append", "wal_flush",
+  "hash_queue", "worker_inbox", "poll_set",
+};
+
+uint64_t lockprof_now(void) {
+  return now_ns();
+}
+
+static ThreadStats* thread_stats(void) {
+  if (local_stats != NULL) return local_stats;
+  ThreadStats* stats = aligned_alloc(64, sizeof(ThreadStats));
+  if (stats == NULL) {
+    perror("lockprof");
+    exit(EXIT_FAILURE);
+  }
+  memset(stats, 0, sizeof(ThreadStats));
+  pthread_mutex_lock(&lockprof.mutex);
+  stats->next = lockprof.threads;
+  lockprof.threads = stats;
+  pthread_mutex_unlock(&lockprof.mutex);
+  local_stats = stats;
+  return stats;
+}
+
+static inline void add(_Atomic uint64_t* counter, uint64_t value) {
+  atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value,
+                        memory_order_relaxed);
+}
+
+static inline void raise_max(_Atomic uint64_t* counter, uint64_t value) {
+  if (value > atomic_load_explicit(counter, memory_order_relaxed)) {
+    atomic_store_explicit(counter, value, memory_order_relaxed);
+  }
+}
+
+void lockprof_acquired(LockSite site, uint64_t wait_started) {
+  ThreadStats* stats = thread_stats();
+  SiteStats* s = &stats->sites[site];
+  uint64_t now = lockprof_now();
+  add(&s->acquired, 1);
+  if (wait_started != 0) {
+    uint64_t waited = now - wait_started;
+    add(&s->contended, 1);
+    add(&s->wait_ns, waited);
+    raise_max(&s->wait_max_ns, waited);
+  }
+  stats->held_since[site] = now;
+}
+
+void lockprof_released(LockSite site) {
+  ThreadStats* stats = thread_stats();
+  SiteStats* s = &stats->sites[site];
+  uint64_t held = lockprof_now() - stats->held_since[site];
+  add(&s->hold_ns, held);
+  raise_max(&s->hold_max_ns, held);
+}
+
+void lockprof_lock(pthread_mutex_t* mutex, LockSite site) {
+  uint64_t wait_started = 0;
+  if (pthread_mutex_trylock(mutex) != 0) {
+    wait_started = lockprof_now();
+    pthread_mutex_lock(mutex);
+  }
+  lockprof_acquired(site, wait_started);
+}
+
+void lockprof_unlock(pthread_mutex_t* mutex, LockSite site) {
+  lockprof_released(site);
+  pthread_mutex_unlock(mutex);
+}
+
+// 경합이 있었던 좌석만 공유 표에 적으므로 경합이 없으면 표도 건드리지 않는다
+void lockprof_seat(uint32_t event_id, int64_t seat_id, uint32_t retries, bool refused) {
+  if (retries == 0 && !refused) return;
+  uint64_t key = (((uint64_t)event_id << 32) | (uint32_t)seat_id) + 1;
+  uint64_t slot = (key * 0x9e3779b97f4a7c15ull) >> 52;  // LOCKPROF_SEAT_SLOTS == 2^12
+  for (size_t probe = 0; probe < LOCKPROF_SEAT_PROBES; probe++) {
+    SeatStats* seat = &lockprof.seats[(slot + probe) % LOCKPROF_SEAT_SLOTS];
+    uint64_t cur = atomic_load_explicit(&seat->key, memory_order_relaxed);
+    if (cur == 0 && atomic_compare_exchange_strong(&seat->key, &cur, key)) cur = key;
+    if (cur != key) continue;
+    atomic_fetch_add_explicit(&seat->retries, retries, memory_order_relaxed);
+    if (refused) atomic_fetch_add_explicit(&seat->refused, 1, memory_order_relaxed);
+    return;
+  }
+  atomic_fetch_add_explicit(&lockprof.seats_dropped, 1, memory_order_relaxed);
+}
+
+void lockprof_reset(void) {
+  pthread_mutex_lock(&lockprof.mutex);
+  for (ThreadStats* stats = lockprof.threads; stats != NULL; stats = stats->next) {
+    memset(stats->sites, 0, sizeof(stats->sites));
+  }
+  pthread_mutex_unlock(&lockprof.mutex);
+  memset(lockprof.seats, 0, sizeof(lockprof.seats));
+  atomic_store(&lockprof.seats_dropped, 0);
+}
+
+// -------------------------------------
+// report
+// -------------------------------------
+typedef struct {
+  LockSite site;
+  uint64_t acquired;
+  uint64_t contended;
+  uint64_t wait_ns;
+  uint64_t wait_max_ns;
+  uint64_t hold_ns;
+  uint64_t hold_max_ns;
+} SiteTotals;
+
+typedef struct {
+  uint64_t key;
+  uint64_t retries;
+  uint64_t refused;
+} SeatTotals;
+
+#define LOAD(x) atomic_load_explicit(&(x), memory_order_relaxed)
+
+static void collect_sites(SiteTotals* totals) {
+  memset(totals, 0, sizeof(SiteTotals) * LOCK_N_SITES);
+  pthread_mutex_lock(&lockprof.mutex);
+  for (ThreadStats* stats = lockprof.threads; stats != NULL; stats = stats->next) {
+    for (size_t i = 0; i < LOCK_N_SITES; i++) {
+      SiteStats* s = &stats->sites[i];
+      SiteTotals* t = &totals[i];
+      t->acquired += LOAD(s->acquired);
+      t->contended += LOAD(s->contended);
+      t->wait_ns += LOAD(s->wait_ns);
+      t->hold_ns += LOAD(s->hold_ns);
+      uint64_t wait_max = LOAD(s->wait_max_ns), hold_max = LOAD(s->hold_max_ns);
+      if (wait_max > t->wait_max_ns) t->wait_max_ns = wait_max;
+      if (hold_max > t->hold_max_ns) t->hold_max_ns = hold_max;
+    }
+  }
+  pthread_mutex_unlock(&lockprof.mutex);
+  for (size_t i = 0; i < LOCK_N_SITES; i++) totals[i].site = (LockSite)i;
+}
+
+// 기다린 시간이 긴 순서, 같으면 경합 횟수, 잡은 횟수 순서
+static int compare_sites(const void* a, const void* b) {
+  const SiteTotals* x = a;
+  const SiteTotals* y = b;
+  if (x->wait_ns != y->wait_ns) return x->wait_ns < y->wait_ns ? 1 : -1;
+  if (x->contended != y->contended) return x->contended < y->contended ? 1 : -1;
+  if (x->acquired != y->acquired) return x->acquired < y->acquired ? 1 : -1;
+  return 0;
+}
+
+static uint64_t seat_score(const SeatTotals* seat) {
+  return seat->retries + seat->refused;
+}
+
+static int compare_seats(const void* a, const void* b) {
+  uint64_t x = seat_score(a), y = seat_score(b);
+  return x == y ? 0 : x < y ? 1 : -1;
+}
+
+void lockprof_report(FILE* out) {
+  SiteTotals sites[LOCK_N_SITES];
+  collect_sites(sites);
+  qsort(sites, LOCK_N_SITES, sizeof(SiteTotals), compare_sites);
+
+  fprintf(out, "%-20s %12s %10s %7s %11s %9s %9s %11s %9s %9s\n", "lock site", "acquired",
+          "contended", "cont%", "wait(ms)", "avg(us)", "max(us)", "hold(ms)", "avg(us)",
+          "max(us)");
+  for (size_t i = 0; i < LOCK_N_SITES; i++) {
+    const SiteTotals* t = &sites[i];
+    if (t->acquired == 0) continue;
+    fprintf(out, "%-20s %12llu %10llu %6.2f%% %11.3f %9.2f %9.1f %11.3f %9.2f %9.1f\n",
+            site_names[t->site], (unsigned long long)t->acquired,
+            (unsigned long long)t->contended, 100.0 * t->contended / t->acquired,
+            t->wait_ns / 1e6, t->contended ? t->wait_ns / 1e3 / t->contended : 0,
+            t->wait_max_ns / 1e3, t->hold_ns / 1e6, t->hold_ns / 1e3 / t->acquired,
+            t->hold_max_ns / 1e3);
+  }
+
+  SeatTotals* seats = malloc(sizeof(SeatTotals) * LOCKPROF_SEAT_SLOTS);
+  if (seats == NULL) return;
+  size_t n_seats = 0;
+  for (size_t i = 0; i < LOCKPROF_SEAT_SLOTS; i++) {
+    SeatStats* seat = &lockprof.seats[i];
+    uint64_t key = LOAD(seat->key);
+    if (key == 0) continue;
+    seats[n_seats++] = (SeatTotals){key - 1, LOAD(seat->retries), LOAD(seat->refused)};
+  }
+  qsort(seats, n_seats, sizeof(SeatTotals), compare_seats);
+
+  fprintf(out, "\nhot seats (CAS retries and transfers refused by another owner)\n");
+  fprintf(out, "%-8s %10s %12s %12s\n", "event", "seat", "retries", "refused");
+  for (size_t i = 0; i < n_seats && i < LOCKPROF_TOP_SEATS; i++) {
+    fprintf(out, "%-8u %10u %12llu %12llu\n", (uint32_t)(seats[i].key >> 32),
+            (uint32_t)seats[i].key, (unsigned long long)seats[i].retries,
+            (unsigned long long)seats[i].refused);
+  }
+  uint64_t dropped = LOAD(lockprof.seats_dropped);
+  if (dropped > 0) {
+    fprintf(out, "(%llu seat records dropped: table full)\n", (unsigned long long)dropped);
+  }
+  free(seats);
+}
+
+#else
+
+void lockprof_report(FILE* out) {
+  fprintf(out, "lock profiling is disabled (rebuild with -DLOCK_PROFILE)\n");
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef LOCKPROF_H
+#define LOCKPROF_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// 락 경합 프로파일러. -DLOCK_PROFILE 로 빌드했을 때만 켜진다.
+//
+// 락 자리(site)마다 잡은 횟수, 바로 못 잡은 횟수, 기다린 시간, 잡고 있던 시간을
+// 센다. 좌석 owner 는 락이 아니라 CAS 이므로 좌석마다 CAS 가 밀려난 횟수를
+// 따로 세서 경합이 몰리는 좌석을 찾는다.
+//
+// 꺼져 있으면 아래 매크로는 pthread_mutex_lock/unlock 그대로이거나 아무것도
+// 하지 않으므로 계측 코드가 바이너리에 남지 않는다. 인자는 (void) 로 평가만 해서
+// site 를 넘겨받는 함수가 쓰지 않는 매개변수 경고를 내지 않게 한다.
+// 결과는 관리 소켓의 "locks" 명령과 서버 종료 시 stderr 로 볼 수 있다.
+
+typedef enum {
+  LOCK_SITE_BOOK,          // 유저 예약 목록: BOOK
+  LOCK_SITE_BOOK_MANY,     // 유저 예약 목록: BOOK_MANY
+  LOCK_SITE_CONFIRM,       // 유저 예약 목록: CONFIRM_BOOKING
+  LOCK_SITE_CANCEL,        // 유저 예약 목록: CANCEL_BOOKING
+  LOCK_SITE_SEAT_WRITE,    // 좌석 epoch 의 writer 구간 (스냅샷 reader 를 기다림)
+  LOCK_SITE_USER_INSERT,   // 유저 테이블 샤드: 로그인 시 새 유저 등록
+  LOCK_SITE_WAL_APPEND,    // WAL 버퍼에 레코드 붙이기
+  LOCK_SITE_WAL_FLUSH,     // WAL 스레드의 버퍼 교체 / durable 알림
+  LOCK_SITE_HASH_QUEUE,    // 해시 풀 작업 큐에 넣기
+  LOCK_SITE_WORKER_INBOX,  // 해시 풀 -> 워커 inbox
+  LOCK_SITE_POLL_SET,      // poll 백엔드의 PollSet
+  LOCK_N_SITES,
+} LockSite;
+
+#ifdef LOCK_PROFILE
+
+uint64_t lockprof_now(void);
+void lockprof_lock(pthread_mutex_t* mutex, LockSite site);
+void lockprof_unlock(pthread_mutex_t* mutex, LockSite site);
+// 락이 아닌 동기화(seqlock 등)용. wait_started 는 기다리기 시작한 시각, 바로
+// 들어갔으면 0.
+void lockprof_acquired(LockSite site, uint64_t wait_started);
+void lockprof_released(LockSite site);
+// 좌석 owner CAS 가 retries 번 다시 돌았고, refused 면 다른 owner 때문에 실패했다
+void lockprof_seat(uint32_t event_id, int64_t seat_id, uint32_t retries, bool refused);
+// 지금까지 센 값을 지운다. 계측 중인 스레드가 없을 때만 부른다.
+void lockprof_reset(void);
+
+#define LOCKPROF_LOCK(mutex, site) lockprof_lock(mutex, site)
+#define LOCKPROF_UNLOCK(mutex, site) lockprof_unlock(mutex, site)
+#define LOCKPROF_NOW() lockprof_now()
+#define LOCKPROF_ACQUIRED(site, wait_started) lockprof_acquired(site, wait_started)
+#define LOCKPROF_RELEASED(site) lockprof_released(site)
+#define LOCKPROF_SEAT(event_id, seat_id, retries, refused) \
+  lockprof_seat(event_id, seat_id, retries, refused)
+
+#else
+
+#define LOCKPROF_LOCK(mutex, site) ((void)(site), pthread_mutex_lock(mutex))
+#define LOCKPROF_UNLOCK(mutex, site) ((void)(site), pthread_mutex_unlock(mutex))
+#define LOCKPROF_NOW() ((uint64_t)0)
+#define LOCKPROF_ACQUIRED(site, wait_started) ((void)(site), (void)(wait_started))
+#define LOCKPROF_RELEASED(site) ((void)(site))
+#define LOCKPROF_SEAT(event_id, seat_id, retries, refused) ((void)(retries))
+
+#endif
+
+// 경합이 심한 순서로 락 자리와 좌석을 적는다. 꺼져 있으면 그렇다고만 적는다.
+void lockprof_report(FILE* out);
+
+#endif
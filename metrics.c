@@ -0,0 +1,411 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "latency.h"
+#include "lockprof.h"
+#include "metrics.h"
+#include "trace.h"
+
+// 지연 히스토그램 (latency.h): 2의 거듭제곱 구간마다 하위 버킷 32 개
+// (상대 오차 약 3%). ns 단위.
+#define METRICS_HIST_BITS 6
+#define METRICS_HIST_BUCKETS HIST_BUCKETS(METRICS_HIST_BITS)
+
+#define ADMIN_COMMAND_SIZE 64
+
+typedef struct {
+  _Atomic uint64_t count;
+  _Atomic uint64_t codes[METRICS_N_CODES];
+  _Atomic uint64_t max_ns;
+  _Atomic uint64_t latency[METRICS_HIST_BUCKETS];
+} ActionMetrics;
+
+// 워커 하나의 칸. 다른 워커의 칸과 캐시 라인을 나누지 않는다.
+typedef struct {
+  _Alignas(64) ActionMetrics actions[METRICS_N_ACTIONS];
+} WorkerMetrics;
+
+// 관리 스레드가 스냅샷마다 합친 값
+typedef struct {
+  uint64_t count;
+  uint64_t codes[METRICS_N_CODES];
+  uint64_t max_ns;
+  uint64_t latency[METRICS_HIST_BUCKETS];
+} ActionTotals;
+
+static struct {
+  bool enabled;
+  size_t n_workers;
+  WorkerMetrics* workers;
+  uint64_t started_ns;
+
+  // 관리 소켓
+  const char* path;
+  int32_t listen_fd;
+  int32_t stop_pipe[2];
+  pthread_t thread;
+  bool running;
+  void (*load)(size_t worker, MetricsLoad* out);
+  // 지난번 스냅샷 (처리량 계산용, 관리 스레드만 쓴다)
+  uint64_t last_ns;
+  uint64_t last_counts[METRICS_N_ACTIONS];
+} metrics = {.listen_fd = -1, .stop_pipe = {-1, -1}};
+
+static const char* action_names[METRICS_N_ACTIONS] = {
+  "termination", "login", "book", "confirm", "cancel", "logout",
+  "query", "book_many", "query_range", "select_event", "other",
+};
+
+static uint64_t totals_percentile(const ActionTotals* totals, double q) {
+  return hist_percentile(totals->latency, METRICS_HIST_BITS, totals->max_ns, q);
+}
+
+// 이 칸의 writer 는 한 스레드뿐이므로 RMW 대신 읽고 쓴다
+static inline void bump(_Atomic uint64_t* counter) {
+  atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + 1,
+                        memory_order_relaxed);
+}
+
+bool metrics_init(size_t n_workers) {
+  metrics.workers = aligned_alloc(64, sizeof(WorkerMetrics) * n_workers);
+  if (metrics.workers == NULL) return false;
+  memset(metrics.workers, 0, sizeof(WorkerMetrics) * n_workers);
+  metrics.n_workers = n_workers;
+  metrics.started_ns = now_ns();
+  metrics.last_ns = metrics.started_ns;
+  metrics.enabled = true;
+  return true;
+}
+
+uint64_t metrics_now(void) {
+  return metrics.enabled ? now_ns() : 0;
+}
+
+void metrics_record(size_t worker, int32_t action, int32_t code, uint64_t started_ns) {
+  if (!metrics.enabled) return;
+  size_t action_slot = action >= 0 && action <= METRICS_MAX_ACTION ? (size_t)action
+                                                                   : METRICS_N_ACTIONS - 1;
+  size_t code_slot = code >= -1 && code <= METRICS_MAX_CODE ? (size_t)(code + 1)
+                                                            : METRICS_N_CODES - 1;
+  ActionMetrics* m = &metrics.workers[worker].actions[action_slot];
+  uint64_t latency = now_ns() - started_ns;
+
+  bump(&m->count);
+  bump(&m->codes[code_slot]);
+  bump(&m->latency[hist_index(latency, METRICS_HIST_BITS)]);
+  if (latency > atomic_load_explicit(&m->max_ns, memory_order_relaxed)) {
+    atomic_store_explicit(&m->max_ns, latency, memory_order_relaxed);
+  }
+}
+
+// -------------------------------------
+// snapshot
+// -------------------------------------
+static void collect(ActionTotals* totals) {
+  memset(totals, 0, sizeof(ActionTotals) * METRICS_N_ACTIONS);
+  for (size_t w = 0; w < metrics.n_workers; w++) {
+    for (size_t a = 0; a < METRICS_N_ACTIONS; a++) {
+      ActionMetrics* m = &metrics.workers[w].actions[a];
+      ActionTotals* t = &totals[a];
+      t->count += atomic_load_explicit(&m->count, memory_order_relaxed);
+      for (size_t c = 0; c < METRICS_N_CODES; c++) {
+        t->codes[c] += atomic_load_explicit(&m->codes[c], memory_order_relaxed);
+      }
+      uint64_t max_ns = atomic_load_explicit(&m->max_ns, memory_order_relaxed);
+      if (max_ns > t->max_ns) t->max_ns = max_ns;
+      for (size_t i = 0; i < METRICS_HIST_BUCKETS; i++) {
+        t->latency[i] += atomic_load_explicit(&m->latency[i], memory_order_relaxed);
+      }
+    }
+  }
+}
+
+// 코드 칸 번호를 출력용 이름으로
+static void code_name(size_t slot, char* out, size_t size) {
+  if (slot == METRICS_N_CODES - 1) {
+    snprintf(out, size, "other");
+  } else {
+    snprintf(out, size, "%d", (int32_t)slot - 1);
+  }
+}
+
+static void write_text(FILE* out, const ActionTotals* totals, const uint64_t* interval_counts,
+                       double uptime, double interval) {
+  uint64_t total = 0, interval_total = 0;
+  for (size_t a = 0; a < METRICS_N_ACTIONS; a++) {
+    total += totals[a].count;
+    interval_total += interval_counts[a];
+  }
+  fprintf(out, "uptime %.1f s, %zu workers\n", uptime, metrics.n_workers);
+  fprintf(out, "throughput %.0f req/s over the last %.1f s, %llu requests in total\n\n",
+          interval > 0 ? interval_total / interval : 0, interval, (unsigned long long)total);
+
+  fprintf(out, "%-13s %10s %10s %9s %9s %9s %9s  %s\n", "action", "count", "req/s", "p50(us)",
+          "p99(us)", "p999(us)", "max(us)", "codes");
+  for (size_t a = 0; a < METRICS_N_ACTIONS; a++) {
+    const ActionTotals* t = &totals[a];
+    if (t->count == 0) continue;
+    fprintf(out, "%-13s %10llu %10.0f %9.1f %9.1f %9.1f %9.1f ", action_names[a],
+            (unsigned long long)t->count, interval > 0 ? interval_counts[a] / interval : 0,
+            totals_percentile(t, 0.50) / 1e3, totals_percentile(t, 0.99) / 1e3,
+            totals_percentile(t, 0.999) / 1e3, t->max_ns / 1e3);
+    for (size_t c = 0; c < METRICS_N_CODES; c++) {
+      if (t->codes[c] == 0) continue;
+      char name[16];
+      code_name(c, name, sizeof(name));
+      fprintf(out, " %s:%llu", name, (unsigned long long)t->codes[c]);
+    }
+    fprintf(out, "\n");
+  }
+
+  fprintf(out, "\n%-6s %8s %8s %12s\n", "worker", "conns", "moved", "poll slots");
+  for (size_t w = 0; w < metrics.n_workers; w++) {
+    MetricsLoad load = {0};
+    if (metrics.load != NULL) metrics.load(w, &load);
+    if (load.slots_capacity > 0) {
+      fprintf(out, "%-6zu %8zu %8llu %7zu/%zu\n", w, load.conns,
+              (unsigned long long)load.migrated, load.slots_used, load.slots_capacity);
+    } else {
+      fprintf(out, "%-6zu %8zu %8llu %12s\n", w, load.conns,
+              (unsigned long long)load.migrated, "-");
+    }
+  }
+}
+
+static void write_json(FILE* out, const ActionTotals* totals, const uint64_t* interval_counts,
+                       double uptime, double interval) {
+  fprintf(out, "{\"uptime_s\":%.3f,\"interval_s\":%.3f,\"actions\":{", uptime, interval);
+  bool first = true;
+  for (size_t a = 0; a < METRICS_N_ACTIONS; a++) {
+    const ActionTotals* t = &totals[a];
+    if (t->count == 0) continue;
+    fprintf(out,
+            "%s\"%s\":{\"count\":%llu,\"rate\":%.1f,\"p50_ns\":%llu,\"p99_ns\":%llu,"
+            "\"p999_ns\":%llu,\"max_ns\":%llu,\"codes\":{",
+            first ? "" : ",", action_names[a], (unsigned long long)t->count,
+            interval > 0 ? interval_counts[a] / interval : 0,
+            (unsigned long long)totals_percentile(t, 0.50),
+            (unsigned long long)totals_percentile(t, 0.99),
+            (unsigned long long)totals_percentile(t, 0.999), (unsigned long long)t->max_ns);
+    bool first_code = true;
+    for (size_t c = 0; c < METRICS_N_CODES; c++) {
+      if (t->codes[c] == 0) continue;
+      char name[16];
+      code_name(c, name, sizeof(name));
+      fprintf(out, "%s\"%s\":%llu", first_code ? "" : ",", name,
+              (unsigned long long)t->codes[c]);
+      first_code = false;
+    }
+    fprintf(out, "}}");
+    first = false;
+  }
+  fprintf(out, "},\"workers\":[");
+  for (size_t w = 0; w < metrics.n_workers; w++) {
+    MetricsLoad load = {0};
+    if (metrics.load != NULL) metrics.load(w, &load);
+    fprintf(out, "%s{\"conns\":%zu,\"migrated\":%llu,\"slots_used\":%zu,\"slots_capacity\":%zu}",
+            w ? "," : "", load.conns, (unsigned long long)load.migrated, load.slots_used,
+            load.slots_capacity);
+  }
+  fprintf(out, "]}\n");
+}
+
+static void send_all(int32_t fd, const char* text, size_t size) {
+  size_t sent = 0;
+  while (sent < size) {
+    ssize_t n = send(fd, text + sent, size - sent, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    sent += n;
+  }
+}
+
+// 스냅샷을 만들어 fd 로 보낸다
+static void serve_admin(int32_t fd, bool json) {
+  ActionTotals* totals = malloc(sizeof(ActionTotals) * METRICS_N_ACTIONS);
+  char* text = NULL;
+  size_t text_size = 0;
+  FILE* out = open_memstream(&text, &text_size);
+  if (totals == NULL || out == NULL) {
+    free(totals);
+    if (out != NULL) fclose(out);
+    free(text);
+    return;
+  }
+
+  collect(totals);
+  uint64_t now = now_ns();
+  uint64_t interval_counts[METRICS_N_ACTIONS];
+  for (size_t a = 0; a < METRICS_N_ACTIONS; a++) {
+    interval_counts[a] = totals[a].count - metrics.last_counts[a];
+    metrics.last_counts[a] = totals[a].count;
+  }
+  double uptime = (now - metrics.started_ns) / 1e9;
+  double interval = (now - metrics.last_ns) / 1e9;
+  metrics.last_ns = now;
+
+  if (json) {
+    write_json(out, totals, interval_counts, uptime, interval);
+  } else {
+    write_text(out, totals, interval_counts, uptime, interval);
+  }
+  fclose(out);
+
+  send_all(fd, text, text_size);
+  free(text);
+  free(totals);
+}
+
+// --trace 링 버퍼를 파일로 내보내고 결과를 한 줄로 알려 준다
+static void serve_trace(int32_t fd) {
+  char line[4200];
+  if (trace_path() == NULL) {
+    snprintf(line, sizeof(line), "tracing is off (start the server with --trace=N)\n");
+  } else {
+    int64_t n_traces = trace_dump();
+    if (n_traces < 0) {
+      snprintf(line, sizeof(line), "cannot write %s\n", trace_path());
+    } else {
+      snprintf(line, sizeof(line), "wrote %lld traces to %s\n", (long long)n_traces,
+               trace_path());
+    }
+  }
+  send_all(fd, line, strlen(line));
+}
+
+static void serve_locks(int32_t fd) {
+  char* text = NULL;
+  size_t text_size = 0;
+  FILE* out = open_memstream(&text, &text_size);
+  if (out == NULL) return;
+  lockprof_report(out);
+  fclose(out);
+  send_all(fd, text, text_size);
+  free(text);
+}
+
+// 한 줄짜리 명령을 읽는다 (오래 걸리면 기본 명령으로 본다)
+static void read_command(int32_t fd, char* command, size_t size) {
+  size_t len = 0;
+  struct pollfd pfd = {.fd = fd, .events = POLLIN};
+  while (len + 1 < size && poll(&pfd, 1, 1000) > 0) {
+    ssize_t n = recv(fd, command + len, size - 1 - len, 0);
+    if (n <= 0) break;
+    len += n;
+    if (memchr(command, '\n', len) != NULL) break;
+  }
+  command[len] = '\0';
+  command[strcspn(command, "\r\n")] = '\0';
+}
+
+static void* admin_thread_func(void* arg) {
+  struct pollfd fds[2] = {
+    {.fd = metrics.listen_fd, .events = POLLIN},
+    {.fd = metrics.stop_pipe[0], .events = POLLIN},
+  };
+  while (true) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) continue;
+      perror("metrics poll");
+      break;
+    }
+    if (fds[1].revents) break;
+    if (!(fds[0].revents & POLLIN)) continue;
+
+    int32_t fd = accept4(metrics.listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) continue;
+    char command[ADMIN_COMMAND_SIZE];
+    read_command(fd, command, sizeof(command));
+    if (command[0] == '\0' || strcmp(command, "stats") == 0 || strcmp(command, "json") == 0) {
+      serve_admin(fd, strcmp(command, "json") == 0);
+    } else if (strcmp(command, "locks") == 0) {
+      serve_locks(fd);
+    } else if (strcmp(command, "trace") == 0) {
+      serve_trace(fd);
+    } else {
+      const char* usage = "unknown command (stats, json, locks, trace)\n";
+      send(fd, usage, strlen(usage), MSG_NOSIGNAL);
+    }
+    close(fd);
+  }
+  return NULL;
+}
+
+// 누가 이 주소에서 듣고 있으면 true
+static bool admin_socket_in_use(const struct sockaddr_un* addr) {
+  int32_t fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return false;
+  bool in_use = connect(fd, (const struct sockaddr*)addr, sizeof(*addr)) == 0;
+  close(fd);
+  return in_use;
+}
+
+bool metrics_start_admin(const char* path, void (*load)(size_t worker, MetricsLoad* out)) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "admin socket path is too long: %s\n", path);
+    return false;
+  }
+  strcpy(addr.sun_path, path);
+
+  // 이전 실행이 남긴 소켓 파일만 지운다. 소켓이 아닌 파일이나 다른 서버가 듣고
+  // 있는 소켓이면 시작하지 않는다.
+  struct stat st;
+  if (lstat(path, &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      fprintf(stderr, "admin socket path exists and is not a socket: %s\n", path);
+      return false;
+    }
+    if (admin_socket_in_use(&addr)) {
+      fprintf(stderr, "admin socket is in use by another process: %s\n", path);
+      return false;
+    }
+    unlink(path);
+  } else if (errno != ENOENT) {
+    perror("admin socket");
+    return false;
+  }
+  metrics.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (metrics.listen_fd < 0 ||
+      bind(metrics.listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+      listen(metrics.listen_fd, 8) < 0 || pipe2(metrics.stop_pipe, O_CLOEXEC) < 0) {
+    perror("admin socket");
+    if (metrics.listen_fd >= 0) close(metrics.listen_fd);
+    metrics.listen_fd = -1;
+    return false;
+  }
+
+  metrics.path = path;
+  metrics.load = load;
+  if (pthread_create(&metrics.thread, NULL, admin_thread_func, NULL) != 0) {
+    perror("pthread_create (metrics)");
+    return false;
+  }
+  metrics.running = true;
+  return true;
+}
+
+void metrics_stop_admin(void) {
+  if (!metrics.running) return;
+  char byte = 0;
+  write(metrics.stop_pipe[1], &byte, 1);
+  pthread_join(metrics.thread, NULL);
+  metrics.running = false;
+  close(metrics.listen_fd);
+  close(metrics.stop_pipe[0]);
+  close(metrics.stop_pipe[1]);
+  unlink(metrics.path);
+}
@@ -0,0 +1,52 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 워커별 요청 카운터와 지연 히스토그램, 관리용 Unix 소켓.
+//
+// 워커마다 자기 칸에만 쓰므로 (단일 writer) 카운터는 relaxed load + store 로
+// 올린다. lock 접두사가 붙는 RMW 도, 워커끼리 같이 쓰는 캐시 라인도 없다.
+// 관리 스레드는 같은 값을 relaxed 로 읽어 합치므로 값이 서로 조금 어긋날 수는
+// 있어도 찢어진 값은 읽지 않는다.
+//
+// 관리 소켓에 연결해서 한 줄을 보내면 합친 스냅샷을 받고 연결이 닫힌다.
+//   "stats" (또는 빈 줄): 사람이 읽는 표
+//   "json": 한 줄 JSON
+//   "locks": 락 경합 보고서 (-DLOCK_PROFILE 빌드에서만, lockprof.h)
+//   "trace": --trace 레코드를 --trace-file 로 내보낸다 (trace.h)
+// 예) echo stats | nc -U /tmp/pa3.sock
+// 처리량은 지난번 스냅샷 이후의 구간으로 계산한다.
+
+// action 0..METRICS_MAX_ACTION 은 자기 칸, 나머지는 other 칸에 센다
+#define METRICS_MAX_ACTION 9
+#define METRICS_N_ACTIONS (METRICS_MAX_ACTION + 2)
+// 응답 코드 -1..METRICS_MAX_CODE 는 자기 칸, 나머지는 other 칸
+#define METRICS_MAX_CODE 7
+#define METRICS_N_CODES (METRICS_MAX_CODE + 3)
+
+// 관리 스냅샷에 싣는 워커의 연결 부하 (서버가 채운다)
+typedef struct {
+  size_t conns;          // 맡은 연결 수
+  uint64_t migrated;     // --rebalance 로 다른 워커에 옮겨 보낸 연결 수
+  size_t slots_used;     // poll 백엔드: fd 목록에 올라 있는 fd 수 (알림용 fd 포함)
+  size_t slots_capacity; // poll 백엔드: 지금 잡아 둔 fd 목록 크기 (가득 차면 늘어난다), epoll 은 0
+} MetricsLoad;
+
+// 워커 수만큼 칸을 만든다. 부르지 않으면 아래 기록 함수는 아무것도 하지 않는다.
+bool metrics_init(size_t n_workers);
+
+// 요청 처리를 시작한 시각 (ns). 꺼져 있으면 0.
+uint64_t metrics_now(void);
+// worker 스레드에서만 부른다. started_ns 는 metrics_now 의 값.
+void metrics_record(size_t worker, int32_t action, int32_t code, uint64_t started_ns);
+
+// path 에 관리 소켓을 만들고 요청을 받는 스레드를 띄운다. path 에 이전 실행이
+// 남긴 소켓이 있으면 지우고, 소켓이 아닌 파일이나 듣고 있는 소켓이 있으면 false.
+// load 는 관리 스레드에서 불리므로 워커 상태를 락이나 atomic 으로 읽어야 한다.
+bool metrics_start_admin(const char* path, void (*load)(size_t worker, MetricsLoad* out));
+void metrics_stop_admin(void);
+
+#endif
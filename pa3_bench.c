@@ -0,0 +1,896 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "helper.h"
+#include "latency.h"
+#include "protocol.h"
+
+// 부하 생성기.
+//
+// 연결 여러 개를 스레드에 나눠 맡기고 정해진 시간 동안 요청을 보낸 뒤 action 별
+// 처리량과 지연 분포 (p50/p99/p999) 를 낸다. 프레임은 pa3_client 와 같은 v1/v2
+// 형식이고 (protocol.h), 연결마다 응답은 보낸 순서대로 온다.
+//
+// - closed loop (기본): 연결마다 -w 개의 요청이 떠 있도록 응답이 오면 바로 다음을 보낸다.
+// - open loop (-r RATE): 응답과 상관없이 전체 RATE 요청/초를 포아송 간격으로 보낸다.
+//   지연은 보내려던 시각부터 재므로 서버가 밀리면 기다린 시간까지 들어간다
+//   (coordinated omission 보정).
+// 시작할 때 모든 연결이 한꺼번에 로그인한다 (login storm). 이 지연은 따로 낸다.
+
+bool sigint_received = false;
+
+#define BENCH_PASSWORD "bench"
+#define BENCH_MAX_INFLIGHT 1024  // 연결마다 답을 기다리는 요청 수 (2의 거듭제곱)
+#define BENCH_MAX_EVENTS 256
+#define BENCH_N_ACTIONS 16       // action 번호로 바로 인덱스한다
+#define BENCH_MANY_SEATS 4       // many 한 번에 잡는 좌석 수
+#define BENCH_RANGE_SEATS 16     // range 한 번에 보는 좌석 수
+#define BENCH_DRAIN_NS (5ull * 1000 * 1000 * 1000)
+#define RECV_BUFFER_INITIAL_SIZE 4096
+
+// -------------------------------------
+// histogram
+// -------------------------------------
+// latency.h 의 히스토그램. 값 (ns) 의 상대 오차는 2^-(BENCH_HIST_BITS-1) 이하다.
+#define BENCH_HIST_BITS 8
+#define BENCH_HIST_BUCKETS HIST_BUCKETS(BENCH_HIST_BITS)
+
+typedef struct {
+    uint64_t counts[BENCH_HIST_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+} Histogram;
+
+static void hist_record(Histogram* hist, uint64_t value) {
+    hist->counts[hist_index(value, BENCH_HIST_BITS)]++;
+    hist->total++;
+    if (value > hist->max) hist->max = value;
+}
+
+static void hist_merge(Histogram* into, const Histogram* from) {
+    for (size_t i = 0; i < BENCH_HIST_BUCKETS; i++) into->counts[i] += from->counts[i];
+    into->total += from->total;
+    if (from->max > into->max) into->max = from->max;
+}
+
+static uint64_t histogram_percentile(const Histogram* hist, double q) {
+    return hist_percentile(hist->counts, BENCH_HIST_BITS, hist->max, q);
+}
+
+// -------------------------------------
+// options
+// -------------------------------------
+typedef enum {
+    OP_BOOK,
+    OP_CANCEL,
+    OP_QUERY,
+    OP_CONFIRM,
+    OP_MANY,     // ACTION_BOOK_MANY
+    OP_RANGE,    // ACTION_QUERY_RANGE
+    OP_RELOGIN,  // logout 다음 login (해시 비용이 드는 요청)
+    OP_COUNT,
+} Op;
+
+static const char* op_names[OP_COUNT] = {
+    "book", "cancel", "query", "confirm", "many", "range", "relogin",
+};
+
+typedef struct {
+    const char* host;
+    const char* port;
+    size_t n_threads;
+    size_t n_conns;
+    double duration_sec;
+    double rate;          // 0 이면 closed loop
+    size_t window;        // closed loop 에서 연결마다 떠 있는 요청 수
+    uint32_t n_seats;
+    double hot_seats;     // 좌석 중 이 비율이 hot
+    double hot_ops;       // 요청 중 이 비율이 hot 좌석으로 간다
+    uint32_t mix[OP_COUNT];  // 누적 가중치
+    uint8_t protocol;
+    const char* user_prefix;
+} BenchConfig;
+
+static BenchConfig config = {
+    .n_threads = 4,
+    .n_conns = 64,
+    .duration_sec = 10,
+    .rate = 0,
+    .window = 1,
+    .n_seats = NUM_SEATS,
+    .hot_seats = 1,
+    .hot_ops = 1,
+    .protocol = PROTOCOL_V1,
+    .user_prefix = "bench",
+};
+
+// "book=40,cancel=30,..." 를 누적 가중치로 바꾼다.
+static bool parse_mix(const char* spec) {
+    char* copy = strdup(spec);
+    if (copy == NULL) return false;
+    uint32_t weights[OP_COUNT] = {0};
+    bool ok = true;
+    char* save = NULL;
+    for (char* item = strtok_r(copy, ",", &save); item != NULL && ok;
+         item = strtok_r(NULL, ",", &save)) {
+        char* eq = strchr(item, '=');
+        ok = false;
+        if (eq == NULL) break;
+        *eq = '\0';
+        for (size_t op = 0; op < OP_COUNT; op++) {
+            if (strcmp(item, op_names[op]) == 0) {
+                weights[op] = strtoul(eq + 1, NULL, 10);
+                ok = true;
+            }
+        }
+    }
+    free(copy);
+
+    uint32_t sum = 0;
+    for (size_t op = 0; op < OP_COUNT; op++) {
+        sum += weights[op];
+        config.mix[op] = sum;
+    }
+    return ok && sum > 0;
+}
+
+// "10:90" = 좌석의 10% 에 요청의 90% 가 몰린다
+static bool parse_hot(const char* spec) {
+    double seats_pct, ops_pct;
+    if (sscanf(spec, "%lf:%lf", &seats_pct, &ops_pct) != 2) return false;
+    if (seats_pct <= 0 || seats_pct > 100 || ops_pct < 0 || ops_pct > 100) return false;
+    config.hot_seats = seats_pct / 100;
+    config.hot_ops = ops_pct / 100;
+    return true;
+}
+
+// -------------------------------------
+// connections
+// -------------------------------------
+typedef struct {
+    uint64_t start_ns;  // closed loop 는 보낸 시각, open loop 는 보내려던 시각
+    uint8_t action;
+} Inflight;
+
+typedef enum {
+    PHASE_LOGIN,  // storm 지연을 따로 모은다
+    PHASE_RUN,
+    PHASE_DRAIN,  // 더 보내지 않고 남은 응답만 받는다
+    PHASE_LOGOUT, // 기록하지 않는다
+} Phase;
+
+typedef struct {
+    int32_t fd;
+    char username[64];
+    size_t username_length;
+    uint8_t protocol;
+    uint32_t next_request_id;
+    // 수신 버퍼: 응답 프레임이 여러 개 또는 일부만 들어 있을 수 있다
+    uint8_t* rbuf;
+    size_t rlen;
+    size_t rcap;
+    // 아직 소켓에 쓰지 못한 요청들
+    uint8_t* wbuf;
+    size_t whead;
+    size_t wlen;
+    size_t wcap;
+    bool want_out;
+    Inflight inflight[BENCH_MAX_INFLIGHT];
+    size_t head;
+    size_t count;
+} Conn;
+
+typedef struct {
+    size_t index;
+    pthread_t tid;
+    Conn* conns;
+    size_t n_conns;
+    int32_t epoll_fd;
+    uint64_t rng;
+    Phase phase;
+    size_t next_conn;  // open loop 에서 돌아가며 고르는 연결
+
+    Histogram* hist;   // BENCH_N_ACTIONS 개
+    Histogram storm;
+    uint64_t failed[BENCH_N_ACTIONS];  // 응답 code 가 0 이 아닌 것
+    uint64_t storm_failed;
+    uint64_t storm_ns;  // 모든 연결이 로그인하기까지 걸린 시간
+    uint64_t completed;
+    uint64_t dropped;   // open loop 에서 연결의 in-flight 가 가득 차서 못 보낸 것
+    uint64_t disconnects;
+} BenchWorker;
+
+static pthread_barrier_t phase_barrier;
+
+// xorshift64*
+static uint64_t next_random(BenchWorker* w) {
+    w->rng ^= w->rng >> 12;
+    w->rng ^= w->rng << 25;
+    w->rng ^= w->rng >> 27;
+    return w->rng * 2685821657736338717ull;
+}
+
+static double next_uniform(BenchWorker* w) {
+    return (next_random(w) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static uint32_t pick_seat(BenchWorker* w) {
+    uint32_t n_hot = (uint32_t)(config.n_seats * config.hot_seats);
+    if (n_hot == 0) n_hot = 1;
+    if (n_hot >= config.n_seats || next_uniform(w) < config.hot_ops) {
+        return 1 + next_random(w) % n_hot;
+    }
+    return n_hot + 1 + next_random(w) % (config.n_seats - n_hot);
+}
+
+static bool buffer_reserve(uint8_t** buf, size_t* cap, size_t needed) {
+    if (needed <= *cap) return true;
+    size_t new_cap = *cap ? *cap : RECV_BUFFER_INITIAL_SIZE;
+    while (new_cap < needed) new_cap *= 2;
+    uint8_t* new_buf = realloc(*buf, new_cap);
+    if (new_buf == NULL) return false;
+    *buf = new_buf;
+    *cap = new_cap;
+    return true;
+}
+
+// -------------------------------------
+// get_socket
+// -------------------------------------
+static int32_t get_socket(const char* hostname, const char* port) {
+    struct addrinfo hints;
+    struct addrinfo* result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    int32_t rc = getaddrinfo(hostname, port, &hints, &result);
+    if (rc != 0) {
+        fprintf(stderr, "invalid address %s:%s: %s\n", hostname, port, gai_strerror(rc));
+        return -1;
+    }
+
+    int32_t sockfd = socket(result->ai_family, result->ai_socktype | SOCK_CLOEXEC, 0);
+    if (sockfd < 0 || connect(sockfd, result->ai_addr, result->ai_addrlen) < 0) {
+        perror("connection failed");
+        if (sockfd >= 0) close(sockfd);
+        freeaddrinfo(result);
+        return -1;
+    }
+    freeaddrinfo(result);
+
+    int32_t one = 1;
+    setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return sockfd;
+}
+
+// -------------------------------------
+// serialize_request
+// -------------------------------------
+// v1 TLV(action, username_length, data_size, username, data). pa3_client 와 같다.
+static size_t request_wire_size_v1(const Request* request) {
+    return sizeof(int32_t) + 2 * sizeof(uint64_t) + request->username_length +
+           request->data_size;
+}
+
+static void serialize_request_v1(const Request* request, uint8_t* out) {
+    int32_t action_val = (int32_t)request->action;
+    memcpy(out, &action_val, sizeof(int32_t));
+    out += sizeof(int32_t);
+    memcpy(out, &request->username_length, sizeof(uint64_t));
+    out += sizeof(uint64_t);
+    memcpy(out, &request->data_size, sizeof(uint64_t));
+    out += sizeof(uint64_t);
+    if (request->username_length > 0) memcpy(out, request->username, request->username_length);
+    out += request->username_length;
+    if (request->data_size > 0) memcpy(out, request->data, request->data_size);
+}
+
+// -------------------------------------
+// send_request / receive_response
+// -------------------------------------
+// 연결을 논블로킹으로 바꾸기 전 (프로토콜 협상) 에만 쓰는 블로킹 v1 송수신.
+void send_request(int32_t sockfd, Request* request) {
+    size_t size = request_wire_size_v1(request);
+    uint8_t* buf = malloc(size);
+    if (buf == NULL) {
+        perror("malloc failed");
+        return;
+    }
+    serialize_request_v1(request, buf);
+    size_t sent = 0;
+    while (sent < size) {
+        ssize_t n = send(sockfd, buf + sent, size - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        sent += n;
+    }
+    free(buf);
+}
+
+void receive_response(int32_t sockfd, Response* response) {
+    memset(response, 0, sizeof(Response));
+    uint64_t size_buf = 0;
+    int32_t code_buf = 0;
+    if (recv(sockfd, &size_buf, sizeof(uint64_t), MSG_WAITALL) <= 0) return;
+    if (recv(sockfd, &code_buf, sizeof(int32_t), MSG_WAITALL) <= 0) return;
+    response->code = code_buf;
+    if (size_buf == 0 || size_buf > 10 * 1024 * 1024) return;
+
+    response->data = malloc(size_buf);
+    if (response->data == NULL) return;
+    if (recv(sockfd, response->data, size_buf, MSG_WAITALL) <= 0) {
+        free(response->data);
+        response->data = NULL;
+        return;
+    }
+    response->data_size = size_buf;
+}
+
+// 요청 하나를 연결의 송신 버퍼 뒤에 붙인다. data 는 이미 그 버전의 형식이다.
+// v2 는 login 이 아니면 username 을 싣지 않는다 (서버가 세션 유저를 쓴다).
+static bool serialize_request(Conn* conn, uint8_t action, const void* data, size_t data_size) {
+    Request request = {
+        .action = (Action)action,
+        .username_length = conn->username_length,
+        .data_size = data_size,
+        .username = conn->username,
+        .data = (char*)data,
+    };
+
+    if (conn->protocol == PROTOCOL_V1) {
+        size_t size = request_wire_size_v1(&request);
+        if (!buffer_reserve(&conn->wbuf, &conn->wcap, conn->wlen + size)) return false;
+        serialize_request_v1(&request, conn->wbuf + conn->wlen);
+        conn->wlen += size;
+        return true;
+    }
+
+    V2RequestHeader header = {
+        .action = action,
+        .username_length = action == ACTION_LOGIN ? (uint8_t)conn->username_length : 0,
+        .data_size = (uint16_t)data_size,
+        .request_id = conn->next_request_id++,
+    };
+    size_t size = V2_REQUEST_HEADER_SIZE + header.username_length + data_size;
+    if (!buffer_reserve(&conn->wbuf, &conn->wcap, conn->wlen + size)) return false;
+    uint8_t* out = conn->wbuf + conn->wlen;
+    v2_pack_request_header(out, &header);
+    memcpy(out + V2_REQUEST_HEADER_SIZE, conn->username, header.username_length);
+    if (data_size > 0) memcpy(out + V2_REQUEST_HEADER_SIZE + header.username_length, data, data_size);
+    conn->wlen += size;
+    return true;
+}
+
+// 좌석 번호 목록을 v1 은 공백으로 구분한 10진 문자열, v2 는 u32 배열로 싣는다.
+static bool send_seats(Conn* conn, uint8_t action, const uint32_t* seats, size_t n) {
+    char text[16 * BENCH_RANGE_SEATS];
+    if (conn->protocol == PROTOCOL_V2) {
+        return serialize_request(conn, action, seats, n * sizeof(uint32_t));
+    }
+    size_t len = 0;
+    for (size_t i = 0; i < n; i++) {
+        len += snprintf(text + len, sizeof(text) - len, i ? " %u" : "%u", seats[i]);
+    }
+    return serialize_request(conn, action, text, len);
+}
+
+static void conn_track(Conn* conn, uint8_t action, uint64_t start_ns) {
+    Inflight* slot = &conn->inflight[(conn->head + conn->count) % BENCH_MAX_INFLIGHT];
+    slot->action = action;
+    slot->start_ns = start_ns;
+    conn->count++;
+}
+
+static bool conn_send(Conn* conn, uint8_t action, const uint32_t* seats, size_t n,
+                      uint64_t start_ns) {
+    bool ok;
+    if (action == ACTION_LOGIN) {
+        ok = serialize_request(conn, action, BENCH_PASSWORD, strlen(BENCH_PASSWORD));
+    } else if (action == ACTION_LOGOUT) {
+        ok = serialize_request(conn, action, NULL, 0);
+    } else if (action == ACTION_CONFIRM_BOOKING) {
+        uint8_t kind = (uint8_t)seats[0];
+        const char* text = kind == V2_CONFIRM_BOOKED ? "booked" : "available";
+        ok = conn->protocol == PROTOCOL_V2 ? serialize_request(conn, action, &kind, 1)
+                                           : serialize_request(conn, action, text, strlen(text));
+    } else {
+        ok = send_seats(conn, action, seats, n);
+    }
+    if (ok) conn_track(conn, action, start_ns);
+    return ok;
+}
+
+static void conn_close(BenchWorker* w, Conn* conn) {
+    if (conn->fd < 0) return;
+    epoll_ctl(w->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    conn->fd = -1;
+    conn->count = 0;
+    w->disconnects++;
+}
+
+static void conn_flush(BenchWorker* w, Conn* conn) {
+    while (conn->fd >= 0 && conn->whead < conn->wlen) {
+        ssize_t n = send(conn->fd, conn->wbuf + conn->whead, conn->wlen - conn->whead,
+                         MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                conn_close(w, conn);
+                return;
+            }
+            break;
+        }
+        conn->whead += n;
+    }
+    if (conn->whead == conn->wlen) conn->whead = conn->wlen = 0;
+
+    // 다 못 쓴 요청이 있을 때만 EPOLLOUT 을 켠다
+    bool want_out = conn->wlen > 0;
+    if (conn->fd >= 0 && want_out != conn->want_out) {
+        struct epoll_event ev = {.events = EPOLLIN | (want_out ? EPOLLOUT : 0), .data.ptr = conn};
+        epoll_ctl(w->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+        conn->want_out = want_out;
+    }
+}
+
+// 섞인 비율대로 요청 하나 (relogin 은 둘) 를 고른다. in-flight 가 가득 차면 false.
+static bool issue_op(BenchWorker* w, Conn* conn, uint64_t start_ns) {
+    if (conn->fd < 0 || conn->count + 2 > BENCH_MAX_INFLIGHT) return false;
+
+    uint32_t pick = next_random(w) % config.mix[OP_COUNT - 1];
+    Op op = OP_BOOK;
+    while (pick >= config.mix[op]) op++;
+
+    uint32_t seats[BENCH_MANY_SEATS];
+    switch (op) {
+        case OP_BOOK:
+            seats[0] = pick_seat(w);
+            return conn_send(conn, ACTION_BOOK, seats, 1, start_ns);
+        case OP_CANCEL:
+            seats[0] = pick_seat(w);
+            return conn_send(conn, ACTION_CANCEL_BOOKING, seats, 1, start_ns);
+        case OP_QUERY:
+            seats[0] = pick_seat(w);
+            return conn_send(conn, ACTION_QUERY, seats, 1, start_ns);
+        case OP_CONFIRM:
+            seats[0] = next_random(w) & 1 ? V2_CONFIRM_BOOKED : V2_CONFIRM_AVAILABLE;
+            return conn_send(conn, ACTION_CONFIRM_BOOKING, seats, 1, start_ns);
+        case OP_MANY:
+            for (size_t i = 0; i < BENCH_MANY_SEATS; i++) seats[i] = pick_seat(w);
+            return conn_send(conn, ACTION_BOOK_MANY, seats, BENCH_MANY_SEATS, start_ns);
+        case OP_RANGE:
+            seats[0] = pick_seat(w);
+            seats[1] = seats[0] + BENCH_RANGE_SEATS - 1 < config.n_seats
+                           ? seats[0] + BENCH_RANGE_SEATS - 1
+                           : config.n_seats;
+            return conn_send(conn, ACTION_QUERY_RANGE, seats, 2, start_ns);
+        case OP_RELOGIN:
+            return conn_send(conn, ACTION_LOGOUT, NULL, 0, start_ns) &&
+                   conn_send(conn, ACTION_LOGIN, NULL, 0, start_ns);
+        default:
+            return false;
+    }
+}
+
+static void record_response(BenchWorker* w, const Inflight* sent, int32_t code, uint64_t now) {
+    uint64_t latency = now > sent->start_ns ? now - sent->start_ns : 0;
+    if (w->phase == PHASE_LOGIN) {
+        hist_record(&w->storm, latency);
+        if (code != 0) w->storm_failed++;
+    } else if (w->phase != PHASE_LOGOUT) {
+        hist_record(&w->hist[sent->action % BENCH_N_ACTIONS], latency);
+        if (code != 0) w->failed[sent->action % BENCH_N_ACTIONS]++;
+        w->completed++;
+    }
+}
+
+// 수신 버퍼에서 끝까지 들어온 응답을 모두 꺼낸다.
+static void parse_responses(BenchWorker* w, Conn* conn, uint64_t now) {
+    size_t offset = 0;
+    while (conn->count > 0) {
+        size_t header_size, data_size;
+        int32_t code;
+        uint8_t* p = conn->rbuf + offset;
+        size_t avail = conn->rlen - offset;
+        if (conn->protocol == PROTOCOL_V2) {
+            if (avail < V2_RESPONSE_HEADER_SIZE) break;
+            V2ResponseHeader header;
+            v2_unpack_response_header(p, &header);
+            header_size = V2_RESPONSE_HEADER_SIZE;
+            data_size = header.data_size;
+            code = header.code;
+        } else {
+            header_size = sizeof(uint64_t) + sizeof(int32_t);
+            if (avail < header_size) break;
+            uint64_t size_val;
+            memcpy(&size_val, p, sizeof(uint64_t));
+            memcpy(&code, p + sizeof(uint64_t), sizeof(int32_t));
+            data_size = size_val;
+        }
+        if (avail < header_size + data_size) break;
+
+        record_response(w, &conn->inflight[conn->head], code, now);
+        conn->head = (conn->head + 1) % BENCH_MAX_INFLIGHT;
+        conn->count--;
+        offset += header_size + data_size;
+    }
+    memmove(conn->rbuf, conn->rbuf + offset, conn->rlen - offset);
+    conn->rlen -= offset;
+}
+
+static void conn_read(BenchWorker* w, Conn* conn) {
+    while (conn->fd >= 0) {
+        if (!buffer_reserve(&conn->rbuf, &conn->rcap, conn->rlen + RECV_BUFFER_INITIAL_SIZE)) {
+            conn_close(w, conn);
+            return;
+        }
+        ssize_t n = recv(conn->fd, conn->rbuf + conn->rlen, conn->rcap - conn->rlen, 0);
+        if (n > 0) {
+            conn->rlen += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        conn_close(w, conn);
+        return;
+    }
+    parse_responses(w, conn, now_ns());
+
+    // closed loop: 응답이 빠진 만큼 바로 채운다
+    if (w->phase == PHASE_RUN && config.rate == 0) {
+        uint64_t now = now_ns();
+        while (conn->fd >= 0 && conn->count < config.window && issue_op(w, conn, now)) {
+        }
+    }
+    conn_flush(w, conn);
+}
+
+static void worker_poll(BenchWorker* w, int64_t timeout_ns) {
+    struct epoll_event events[BENCH_MAX_EVENTS];
+    struct timespec timeout = {
+        .tv_sec = timeout_ns / 1000000000,
+        .tv_nsec = timeout_ns % 1000000000,
+    };
+    int32_t n = epoll_pwait2(w->epoll_fd, events, BENCH_MAX_EVENTS,
+                             timeout_ns < 0 ? NULL : &timeout, NULL);
+    for (int32_t i = 0; i < n; i++) {
+        Conn* conn = events[i].data.ptr;
+        if (events[i].events & EPOLLOUT) conn_flush(w, conn);
+        if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) conn_read(w, conn);
+    }
+}
+
+static bool worker_idle(const BenchWorker* w) {
+    for (size_t i = 0; i < w->n_conns; i++) {
+        if (w->conns[i].fd >= 0 && w->conns[i].count > 0) return false;
+    }
+    return true;
+}
+
+// 모든 연결의 응답을 받을 때까지 (최대 limit_ns) 기다린다
+static void worker_wait_idle(BenchWorker* w, uint64_t limit_ns) {
+    uint64_t deadline = now_ns() + limit_ns;
+    while (!worker_idle(w) && now_ns() < deadline) worker_poll(w, 100 * 1000 * 1000);
+}
+
+// -------------------------------------
+// phases
+// -------------------------------------
+// HELLO 로 프로토콜을 맞추고 (pa3_client 의 negotiate_protocol 과 같다) 논블로킹으로 바꾼다.
+static bool conn_open(BenchWorker* w, Conn* conn, size_t global_index) {
+    conn->fd = get_socket(config.host, config.port);
+    if (conn->fd < 0) return false;
+    conn->protocol = PROTOCOL_V1;
+    conn->username_length = snprintf(conn->username, sizeof(conn->username), "%s%zu",
+                                     config.user_prefix, global_index);
+
+    if (config.protocol > PROTOCOL_V1) {
+        char version = (char)config.protocol;
+        Request req;
+        memset(&req, 0, sizeof(Request));
+        req.action = (Action)PROTOCOL_HELLO_ACTION;
+        req.data = &version;
+        req.data_size = sizeof(version);
+        send_request(conn->fd, &req);
+
+        // v2 를 모르는 서버는 실패 코드를 돌려주므로 v1 로 남는다
+        Response res;
+        receive_response(conn->fd, &res);
+        if (res.code == 0 && res.data_size == 1 && res.data[0] >= PROTOCOL_V1 &&
+            res.data[0] <= PROTOCOL_MAX_VERSION) {
+            conn->protocol = res.data[0];
+        }
+        free(res.data);
+    }
+
+    int32_t flags = fcntl(conn->fd, F_GETFL, 0);
+    fcntl(conn->fd, F_SETFL, flags | O_NONBLOCK);
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = conn};
+    return epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, conn->fd, &ev) == 0;
+}
+
+static void run_phase(BenchWorker* w) {
+    uint64_t start = now_ns();
+    uint64_t deadline = start + (uint64_t)(config.duration_sec * 1e9);
+    uint64_t now = start;
+
+    if (config.rate == 0) {
+        for (size_t i = 0; i < w->n_conns; i++) {
+            Conn* conn = &w->conns[i];
+            while (conn->fd >= 0 && conn->count < config.window && issue_op(w, conn, now)) {
+            }
+            conn_flush(w, conn);
+        }
+        while (now < deadline && !sigint_received) {
+            worker_poll(w, deadline - now);
+            now = now_ns();
+        }
+        return;
+    }
+
+    // open loop: 스레드마다 rate / n_threads 의 포아송 도착
+    double per_thread_rate = config.rate / config.n_threads;
+    uint64_t next_arrival = start;
+    while (now < deadline && !sigint_received) {
+        while (next_arrival <= now) {
+            Conn* conn = &w->conns[w->next_conn++ % w->n_conns];
+            if (issue_op(w, conn, next_arrival)) {
+                conn_flush(w, conn);
+            } else {
+                w->dropped++;
+            }
+            next_arrival += (uint64_t)(-log(1.0 - next_uniform(w)) / per_thread_rate * 1e9);
+        }
+        uint64_t until = next_arrival < deadline ? next_arrival : deadline;
+        worker_poll(w, until > now ? until - now : 0);
+        now = now_ns();
+    }
+}
+
+static void* worker_main(void* arg) {
+    BenchWorker* w = arg;
+    bool ok = true;
+    for (size_t i = 0; i < w->n_conns && ok; i++) {
+        ok = conn_open(w, &w->conns[i], w->index + i * config.n_threads);
+    }
+    if (!ok) {
+        fprintf(stderr, "thread %zu: cannot open its connections\n", w->index);
+        for (size_t i = 0; i < w->n_conns; i++) conn_close(w, &w->conns[i]);
+        w->disconnects = 0;
+    }
+
+    // 1. login storm: 모든 스레드가 연결을 다 연 뒤 한꺼번에 로그인한다
+    pthread_barrier_wait(&phase_barrier);
+    w->phase = PHASE_LOGIN;
+    uint64_t storm_start = now_ns();
+    for (size_t i = 0; i < w->n_conns; i++) {
+        Conn* conn = &w->conns[i];
+        if (conn->fd >= 0 && conn_send(conn, ACTION_LOGIN, NULL, 0, storm_start)) {
+            conn_flush(w, conn);
+        }
+    }
+    worker_wait_idle(w, BENCH_DRAIN_NS);
+    w->storm_ns = now_ns() - storm_start;
+
+    // 2. 측정 구간
+    pthread_barrier_wait(&phase_barrier);
+    w->phase = PHASE_RUN;
+    run_phase(w);
+    w->phase = PHASE_DRAIN;
+    worker_wait_idle(w, BENCH_DRAIN_NS);
+
+    // 3. 다음 실행이 같은 이름으로 로그인할 수 있게 로그아웃한다
+    w->phase = PHASE_LOGOUT;
+    for (size_t i = 0; i < w->n_conns; i++) {
+        Conn* conn = &w->conns[i];
+        if (conn->fd >= 0 && conn_send(conn, ACTION_LOGOUT, NULL, 0, 0)) conn_flush(w, conn);
+    }
+    worker_wait_idle(w, BENCH_DRAIN_NS);
+    for (size_t i = 0; i < w->n_conns; i++) {
+        if (w->conns[i].fd >= 0) close(w->conns[i].fd);
+        free(w->conns[i].rbuf);
+        free(w->conns[i].wbuf);
+    }
+    return NULL;
+}
+
+// -------------------------------------
+// report
+// -------------------------------------
+static const char* action_name(size_t action) {
+    switch (action) {
+        case ACTION_LOGIN: return "login";
+        case ACTION_BOOK: return "book";
+        case ACTION_CONFIRM_BOOKING: return "confirm";
+        case ACTION_CANCEL_BOOKING: return "cancel";
+        case ACTION_LOGOUT: return "logout";
+        case ACTION_QUERY: return "query";
+        case ACTION_BOOK_MANY: return "book_many";
+        case ACTION_QUERY_RANGE: return "query_range";
+        default: return "?";
+    }
+}
+
+static void print_row(const char* name, const Histogram* hist, uint64_t failed) {
+    printf("%-14s %10llu %10llu %10.1f %10.1f %10.1f %10.1f\n", name,
+           (unsigned long long)hist->total, (unsigned long long)failed,
+           histogram_percentile(hist, 0.50) / 1e3, histogram_percentile(hist, 0.99) / 1e3,
+           histogram_percentile(hist, 0.999) / 1e3, hist->max / 1e3);
+}
+
+static void print_report(BenchWorker* workers) {
+    Histogram* total = calloc(BENCH_N_ACTIONS + 2, sizeof(Histogram));
+    if (total == NULL) {
+        perror("calloc failed");
+        return;
+    }
+    Histogram* all = &total[BENCH_N_ACTIONS];
+    Histogram* storm = &total[BENCH_N_ACTIONS + 1];
+    uint64_t failed[BENCH_N_ACTIONS] = {0};
+    uint64_t all_failed = 0, storm_failed = 0, completed = 0, dropped = 0, disconnects = 0;
+    uint64_t storm_ns = 0;
+
+    for (size_t t = 0; t < config.n_threads; t++) {
+        BenchWorker* w = &workers[t];
+        for (size_t a = 0; a < BENCH_N_ACTIONS; a++) {
+            hist_merge(&total[a], &w->hist[a]);
+            hist_merge(all, &w->hist[a]);
+            failed[a] += w->failed[a];
+            all_failed += w->failed[a];
+        }
+        hist_merge(storm, &w->storm);
+        storm_failed += w->storm_failed;
+        completed += w->completed;
+        dropped += w->dropped;
+        disconnects += w->disconnects;
+        if (w->storm_ns > storm_ns) storm_ns = w->storm_ns;
+    }
+
+    printf("%zu threads, %zu connections, protocol v%u, %.1f s, ", config.n_threads,
+           config.n_conns, config.protocol, config.duration_sec);
+    if (config.rate > 0) {
+        printf("open loop at %.0f req/s\n", config.rate);
+    } else {
+        printf("closed loop (window %zu)\n", config.window);
+    }
+    printf("throughput: %.0f req/s (%llu responses", completed / config.duration_sec,
+           (unsigned long long)completed);
+    if (dropped > 0) printf(", %llu not sent: in-flight limit", (unsigned long long)dropped);
+    if (disconnects > 0) printf(", %llu disconnects", (unsigned long long)disconnects);
+    printf(")\n");
+    printf("login storm: %.1f ms for %llu logins\n\n", storm_ns / 1e6,
+           (unsigned long long)storm->total);
+
+    printf("%-14s %10s %10s %10s %10s %10s %10s\n", "action", "count", "failed", "p50(us)",
+           "p99(us)", "p999(us)", "max(us)");
+    print_row("login (storm)", storm, storm_failed);
+    for (size_t a = 0; a < BENCH_N_ACTIONS; a++) {
+        if (total[a].total > 0) print_row(action_name(a), &total[a], failed[a]);
+    }
+    print_row("all", all, all_failed);
+    free(total);
+}
+
+// -------------------------------------
+// main
+// -------------------------------------
+static void print_usage(const char* prog) {
+    fprintf(stderr,
+            "usage: %s [options] <IP address> <port>\n"
+            "  -t, --threads=N        threads (default 4)\n"
+            "  -c, --connections=N    connections, spread over the threads (default 64)\n"
+            "  -d, --duration=SEC     measured time (default 10)\n"
+            "  -r, --rate=N           open loop at N req/s in total (default: closed loop)\n"
+            "  -w, --window=N         closed loop requests in flight per connection (default 1)\n"
+            "  -m, --mix=SPEC         e.g. book=40,cancel=30,query=20,confirm=10\n"
+            "                         (also many, range, relogin)\n"
+            "  -s, --seats=N          seats in the event (default %d)\n"
+            "  -H, --hot=SEATS:OPS    OPS%% of requests go to the first SEATS%% of seats\n"
+            "  -p, --protocol=V       highest protocol version to negotiate (default 1)\n"
+            "  -u, --user-prefix=STR  usernames are STR0, STR1, ... (default bench)\n",
+            prog, NUM_SEATS);
+}
+
+int main(int argc, char* argv[]) {
+    signal(SIGPIPE, SIG_IGN);
+    setup_sigint_handler();
+
+    static const struct option long_options[] = {
+        {"threads", required_argument, NULL, 't'},
+        {"connections", required_argument, NULL, 'c'},
+        {"duration", required_argument, NULL, 'd'},
+        {"rate", required_argument, NULL, 'r'},
+        {"window", required_argument, NULL, 'w'},
+        {"mix", required_argument, NULL, 'm'},
+        {"seats", required_argument, NULL, 's'},
+        {"hot", required_argument, NULL, 'H'},
+        {"protocol", required_argument, NULL, 'p'},
+        {"user-prefix", required_argument, NULL, 'u'},
+        {NULL, 0, NULL, 0},
+    };
+
+    bool bad_args = !parse_mix("book=40,cancel=30,query=20,confirm=10");
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:c:d:r:w:m:s:H:p:u:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 't': config.n_threads = strtoull(optarg, NULL, 10); break;
+            case 'c': config.n_conns = strtoull(optarg, NULL, 10); break;
+            case 'd': config.duration_sec = atof(optarg); break;
+            case 'r': config.rate = atof(optarg); break;
+            case 'w': config.window = strtoull(optarg, NULL, 10); break;
+            case 'm': bad_args |= !parse_mix(optarg); break;
+            case 's': config.n_seats = strtoul(optarg, NULL, 10); break;
+            case 'H': bad_args |= !parse_hot(optarg); break;
+            case 'p': config.protocol = atoi(optarg); break;
+            case 'u': config.user_prefix = optarg; break;
+            default: bad_args = true; break;
+        }
+    }
+    if (config.n_threads == 0 || config.n_conns < config.n_threads ||
+        config.duration_sec <= 0 || config.rate < 0 || config.window == 0 ||
+        config.window > BENCH_MAX_INFLIGHT / 2 || config.n_seats == 0 ||
+        config.protocol < PROTOCOL_V1 || config.protocol > PROTOCOL_MAX_VERSION) {
+        bad_args = true;
+    }
+    if (bad_args || argc - optind != 2) {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    config.host = argv[optind];
+    config.port = argv[optind + 1];
+
+    BenchWorker* workers = calloc(config.n_threads, sizeof(BenchWorker));
+    if (workers == NULL) {
+        perror("calloc failed");
+        exit(EXIT_FAILURE);
+    }
+    pthread_barrier_init(&phase_barrier, NULL, config.n_threads);
+    for (size_t t = 0; t < config.n_threads; t++) {
+        BenchWorker* w = &workers[t];
+        w->index = t;
+        w->n_conns = config.n_conns / config.n_threads + (t < config.n_conns % config.n_threads);
+        w->conns = calloc(w->n_conns, sizeof(Conn));
+        w->hist = calloc(BENCH_N_ACTIONS, sizeof(Histogram));
+        w->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        w->rng = 0x9e3779b97f4a7c15ull * (t + 1) ^ (uint64_t)now_ns();
+        if (w->conns == NULL || w->hist == NULL || w->epoll_fd < 0) {
+            perror("worker setup failed");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < w->n_conns; i++) w->conns[i].fd = -1;
+    }
+    for (size_t t = 0; t < config.n_threads; t++) {
+        if (pthread_create(&workers[t].tid, NULL, worker_main, &workers[t]) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (size_t t = 0; t < config.n_threads; t++) pthread_join(workers[t].tid, NULL);
+
+    print_report(workers);
+
+    for (size_t t = 0; t < config.n_threads; t++) {
+        close(workers[t].epoll_fd);
+        free(workers[t].conns);
+        free(workers[t].hist);
+    }
+    free(workers);
+    pthread_barrier_destroy(&phase_barrier);
+    return 0;
+}
@@ -2,7 +2,9 @@
 #include <ctype.h>
 #include <editline/readline.h>
 #include <errno.h>
+#include <getopt.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 #include <pa3_error.h>
 #include <signal.h>
@@ -13,10 +15,21 @@
 #include <unistd.h>
 #include "handle_response.h"
 #include "helper.h"
+#include "protocol.h"
 
 const char* active_user = NULL;
 bool sigint_received = false;
 
+// 서버와 협상한 와이어 프로토콜 버전 (protocol.h). 협상 전이나 -p 1 이면 v1.
+static uint8_t protocol_version = PROTOCOL_V1;
+
+// v2 응답은 action 을 싣지 않으므로, 응답을 v1 과 같은 Response 로 되돌릴 때
+// 쓰려고 보낸 요청의 action 을 request id 로 기억해 둔다. 응답은 보낸 순서대로 온다.
+#define INFLIGHT_ACTIONS 65536
+static uint8_t inflight_actions[INFLIGHT_ACTIONS];
+static uint32_t next_request_id = 0;
+static uint32_t next_response_id = 0;
+
 // -------------------------------------
 // get_socket
 // -------------------------------------
@@ -51,52 +64,227 @@ int32_t get_socket(char* hostname, uint64_t port) {
 }
 
 // -------------------------------------
-// send_request
+// write_fully
 // -------------------------------------
-void send_request(int32_t sockfd, Request* request) {
-    // 1. Action (int32_t로 명시적 변환)
-    int32_t action_val = (int32_t)request->action;
-    if (write(sockfd, &action_val, sizeof(int32_t)) <= 0) return;
-
-    // 2. Lengths
-    if (write(sockfd, &request->username_length, sizeof(uint64_t)) <= 0) return;
-    if (write(sockfd, &request->data_size, sizeof(uint64_t)) <= 0) return;
-
-    // 3. Username
-    if (request->username_length > 0 && request->username != NULL) {
-        size_t sent = 0;
-        while (sent < request->username_length) {
-            ssize_t n = write(sockfd, request->username + sent, request->username_length - sent);
-            if (n < 0) { 
-                if (errno == EINTR) continue; 
-                return; 
-            }
-            if (n == 0) return;
-            sent += n;
+static bool write_fully(int32_t sockfd, const uint8_t* buf, size_t count) {
+    size_t sent = 0;
+    while (sent < count) {
+        ssize_t n = write(sockfd, buf + sent, count - sent);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
         }
+        if (n == 0) return false;
+        sent += n;
     }
+    return true;
+}
 
-    // 4. Data
-    if (request->data_size > 0 && request->data != NULL) {
-        size_t sent = 0;
-        while (sent < request->data_size) {
-            ssize_t n = write(sockfd, request->data + sent, request->data_size - sent);
-            if (n < 0) { 
-                if (errno == EINTR) continue; 
-                return; 
-            }
-            if (n == 0) return;
-            sent += n;
+// -------------------------------------
+// v2 encoding
+// -------------------------------------
+// v2 에서 요청 data 로 실릴 바이트를 정한다. 좌석 번호는 u32, confirm 종류는 u8 로
+// scratch (4 바이트 이상) 에 만들고, 나머지 (비밀번호) 는 문자열 그대로 보낸다.
+static size_t v2_request_data(const Request* request, const uint8_t** data, uint8_t* scratch) {
+    *data = NULL;
+    if (request->data == NULL || request->data_size == 0) return 0;
+
+    switch (request->action) {
+        case ACTION_BOOK:
+        case ACTION_CANCEL_BOOKING:
+        case ACTION_QUERY: {
+            // 숫자가 아니거나 u32 를 넘으면 서버가 범위 밖으로 답하도록 0 번 좌석을 보낸다
+            char* end;
+            unsigned long long value = strtoull(request->data, &end, 10);
+            uint32_t seat_id = (*end == '\0' && value <= UINT32_MAX) ? (uint32_t)value
+                                                                      : V2_SEAT_INVALID;
+            memcpy(scratch, &seat_id, sizeof(uint32_t));
+            *data = scratch;
+            return sizeof(uint32_t);
         }
+        case ACTION_CONFIRM_BOOKING:
+            if (strcmp(request->data, "available") == 0) {
+                scratch[0] = V2_CONFIRM_AVAILABLE;
+            } else if (strcmp(request->data, "booked") == 0) {
+                scratch[0] = V2_CONFIRM_BOOKED;
+            } else {
+                scratch[0] = V2_CONFIRM_INVALID;
+            }
+            *data = scratch;
+            return 1;
+        default:
+            *data = (const uint8_t*)request->data;
+            return request->data_size < V2_MAX_DATA_SIZE ? request->data_size
+                                                         : V2_MAX_DATA_SIZE;
     }
 }
 
+// v2 헤더에 담을 수 없는 긴 username 은 보내지 않는다 (서버는 세션 유저를 쓴다).
+static size_t v2_username_length(const Request* request) {
+    if (request->username == NULL || request->username_length > V2_MAX_USERNAME_LENGTH) {
+        return 0;
+    }
+    return request->username_length;
+}
+
+// -------------------------------------
+// serialize_request
+// -------------------------------------
+// 요청 하나를 TLV(action, username_length, data_size, username, data) 로
+// out 에 직렬화한다. out 에는 request_wire_size() 만큼 공간이 있어야 한다.
+// v2 로 협상했으면 v2 프레임으로 직렬화하고 request id 를 붙인다.
+static size_t request_wire_size(const Request* request) {
+    if (protocol_version == PROTOCOL_V2) {
+        const uint8_t* data;
+        uint8_t scratch[sizeof(uint32_t)];
+        return V2_REQUEST_HEADER_SIZE + v2_username_length(request) +
+               v2_request_data(request, &data, scratch);
+    }
+
+    size_t size = sizeof(int32_t) + 2 * sizeof(uint64_t);
+    if (request->username != NULL) size += request->username_length;
+    if (request->data != NULL) size += request->data_size;
+    return size;
+}
+
+static void serialize_request_v2(const Request* request, uint8_t* out) {
+    const uint8_t* data;
+    uint8_t scratch[sizeof(uint32_t)];
+    V2RequestHeader header = {
+        .action = (uint8_t)request->action,
+        .username_length = (uint8_t)v2_username_length(request),
+        .data_size = (uint16_t)v2_request_data(request, &data, scratch),
+        .request_id = next_request_id++,
+    };
+    inflight_actions[header.request_id % INFLIGHT_ACTIONS] = header.action;
+
+    v2_pack_request_header(out, &header);
+    out += V2_REQUEST_HEADER_SIZE;
+    memcpy(out, request->username, header.username_length);
+    out += header.username_length;
+    if (header.data_size > 0) {
+        memcpy(out, data, header.data_size);
+    }
+}
+
+static void serialize_request(const Request* request, uint8_t* out) {
+    if (protocol_version == PROTOCOL_V2) {
+        serialize_request_v2(request, out);
+        return;
+    }
+
+    int32_t action_val = (int32_t)request->action;
+    uint64_t username_length = request->username != NULL ? request->username_length : 0;
+    uint64_t data_size = request->data != NULL ? request->data_size : 0;
+
+    memcpy(out, &action_val, sizeof(int32_t));
+    out += sizeof(int32_t);
+    memcpy(out, &username_length, sizeof(uint64_t));
+    out += sizeof(uint64_t);
+    memcpy(out, &data_size, sizeof(uint64_t));
+    out += sizeof(uint64_t);
+    if (username_length > 0) {
+        memcpy(out, request->username, username_length);
+        out += username_length;
+    }
+    if (data_size > 0) {
+        memcpy(out, request->data, data_size);
+    }
+}
+
+// -------------------------------------
+// send_request
+// -------------------------------------
+void send_request(int32_t sockfd, Request* request) {
+    // 헤더와 본문을 한 번의 write 로 보낸다 (작은 패킷 여러 개 방지)
+    size_t size = request_wire_size(request);
+    uint8_t* buf = malloc(size);
+    if (buf == NULL) {
+        perror("malloc failed");
+        return;
+    }
+    serialize_request(request, buf);
+    write_fully(sockfd, buf, size);
+    free(buf);
+}
+
 // -------------------------------------
 // receive_response
 // -------------------------------------
+// v2 응답을 받아 v1 과 같은 모양의 Response 로 만든다 (handle_response 는 v1 만 안다).
+// confirm 의 u32 좌석 목록은 size_t 배열로 넓히고, query 의 SeatRecord 는 Seat 로 바꾼다.
+static void receive_response_v2(int32_t sockfd, Response* response) {
+    uint8_t buf[V2_RESPONSE_HEADER_SIZE];
+    if (recv(sockfd, buf, sizeof(buf), MSG_WAITALL) <= 0) return;
+
+    V2ResponseHeader header;
+    v2_unpack_response_header(buf, &header);
+    uint32_t expected_id = next_response_id++;
+    if (header.request_id != expected_id) {
+        fprintf(stderr, "unexpected response id %u (expected %u)\n",
+                header.request_id, expected_id);
+    }
+    uint8_t action = inflight_actions[header.request_id % INFLIGHT_ACTIONS];
+    response->code = header.code;
+    if (header.data_size == 0) return;
+
+    uint8_t* data = malloc(header.data_size);
+    if (data == NULL) {
+        perror("malloc failed");
+        return;
+    }
+    if (recv(sockfd, data, header.data_size, MSG_WAITALL) <= 0) {
+        free(data);
+        return;
+    }
+
+    if (action == ACTION_CONFIRM_BOOKING) {
+        size_t count = header.data_size / sizeof(uint32_t);
+        size_t* seat_ids = malloc(count * sizeof(size_t) + 1);
+        if (seat_ids == NULL) {
+            perror("malloc failed");
+            free(data);
+            return;
+        }
+        for (size_t i = 0; i < count; i++) {
+            uint32_t seat_id;
+            memcpy(&seat_id, data + i * sizeof(uint32_t), sizeof(uint32_t));
+            seat_ids[i] = seat_id;
+        }
+        free(data);
+        response->data = (uint8_t*)seat_ids;
+        response->data_size = count * sizeof(size_t);
+        return;
+    }
+
+    if (action == ACTION_QUERY && header.data_size == sizeof(SeatRecord)) {
+        SeatRecord record;
+        memcpy(&record, data, sizeof(SeatRecord));
+        free(data);
+        Seat* seat = calloc(1, sizeof(Seat));
+        if (seat == NULL) {
+            perror("calloc failed");
+            return;
+        }
+        seat->id = record.id;
+        seat->amount_of_times_booked = record.times_booked;
+        seat->amount_of_times_canceled = record.times_canceled;
+        response->data = (uint8_t*)seat;
+        response->data_size = sizeof(Seat);
+        return;
+    }
+
+    response->data = data;
+    response->data_size = header.data_size;
+}
+
 void receive_response(int32_t sockfd, Response* response) {
     // 구조체 초기화 (쓰레기 값 방지)
     memset(response, 0, sizeof(Response));
+    if (protocol_version == PROTOCOL_V2) {
+        receive_response_v2(sockfd, response);
+        return;
+    }
 
     uint64_t size_buf = 0;
     // recv가 0이나 -1을 반환하면 연결 종료/에러
@@ -132,6 +320,31 @@ void receive_response(int32_t sockfd, Response* response) {
     }
 }
 
+// -------------------------------------
+// negotiate_protocol
+// -------------------------------------
+// v1 HELLO 프레임으로 원하는 버전을 알리고 서버가 고른 버전으로 바꾼다.
+// v2 를 모르는 서버는 모르는 action 이라 실패 코드를 돌려주므로 v1 로 남는다.
+static void negotiate_protocol(int32_t sockfd, uint8_t wanted) {
+    if (wanted <= PROTOCOL_V1) return;
+
+    char version = (char)wanted;
+    Request req;
+    memset(&req, 0, sizeof(Request));
+    req.action = (Action)PROTOCOL_HELLO_ACTION;
+    req.data = &version;
+    req.data_size = sizeof(version);
+    send_request(sockfd, &req);
+
+    Response res;
+    receive_response(sockfd, &res);
+    if (res.code == 0 && res.data_size == 1 && res.data[0] >= PROTOCOL_V1 &&
+        res.data[0] <= PROTOCOL_MAX_VERSION) {
+        protocol_version = res.data[0];
+    }
+    free(res.data);
+}
+
 // -------------------------------------
 // terminate
 // -------------------------------------
@@ -168,6 +381,184 @@ void terminate(int32_t sockfd, const char* active_user) {
     }
 }
 
+// -------------------------------------
+// pipelined file mode
+// -------------------------------------
+// 파일 모드에서 응답을 기다리지 않고 최대 window 개의 요청을 먼저 보낸다.
+// 응답은 보낸 순서대로 오므로 in-flight 큐의 맨 앞 요청과 짝지어 처리한다.
+// 이 모드에서는 앞선 login 이 성공했다고 가정하고 그 username 으로 이어지는
+// 요청을 보낸다. 직접 해석할 수 없는 줄을 만나면 in-flight 요청을 모두
+// 비운 뒤 evaluate 로 동기 처리한다.
+typedef struct {
+    Request* ring;     // in-flight 요청 (username/data 는 복사본)
+    size_t window;
+    size_t head;
+    size_t count;
+    uint8_t* batch;    // 아직 소켓에 쓰지 않은 직렬화된 요청들
+    size_t batch_len;
+    size_t batch_cap;
+    char* next_user;   // 다음 요청에 실을 username (login/logout 을 앞서 반영)
+} Pipeline;
+
+#define PIPELINE_BATCH_FLUSH_SIZE (64 * 1024)
+
+static bool pipeline_flush(Pipeline* p, int32_t sockfd) {
+    bool ok = write_fully(sockfd, p->batch, p->batch_len);
+    p->batch_len = 0;
+    return ok;
+}
+
+// 가장 오래된 in-flight 요청의 응답을 받아 처리한다.
+static void pipeline_complete_one(Pipeline* p, int32_t sockfd) {
+    Request* req = &p->ring[p->head];
+    Response res;
+    receive_response(sockfd, &res);
+    handle_response(req->action, req, &res, &active_user);
+
+    free(req->username);
+    free(req->data);
+    if (res.data != NULL) free(res.data);
+    p->head = (p->head + 1) % p->window;
+    p->count--;
+}
+
+static void pipeline_drain(Pipeline* p, int32_t sockfd) {
+    pipeline_flush(p, sockfd);
+    while (p->count > 0) pipeline_complete_one(p, sockfd);
+}
+
+static bool pipeline_submit(Pipeline* p, int32_t sockfd, const Request* request) {
+    if (p->count == p->window) {
+        pipeline_flush(p, sockfd);
+        pipeline_complete_one(p, sockfd);
+    }
+
+    size_t size = request_wire_size(request);
+    if (p->batch_len + size > p->batch_cap) {
+        size_t new_cap = p->batch_cap ? p->batch_cap : 4096;
+        while (new_cap < p->batch_len + size) new_cap *= 2;
+        uint8_t* new_batch = realloc(p->batch, new_cap);
+        if (new_batch == NULL) return false;
+        p->batch = new_batch;
+        p->batch_cap = new_cap;
+    }
+    serialize_request(request, p->batch + p->batch_len);
+    p->batch_len += size;
+
+    Request* slot = &p->ring[(p->head + p->count) % p->window];
+    *slot = *request;
+    slot->username = request->username ? strdup(request->username) : NULL;
+    slot->data = request->data ? strdup(request->data) : NULL;
+    p->count++;
+
+    if (p->batch_len >= PIPELINE_BATCH_FLUSH_SIZE) return pipeline_flush(p, sockfd);
+    return true;
+}
+
+static void pipeline_set_user(Pipeline* p, const char* username) {
+    free(p->next_user);
+    p->next_user = username ? strdup(username) : NULL;
+}
+
+// 파이프라인으로 직접 보낼 수 있는 명령이면 req 를 채우고 true.
+// 인자는 line 안을 가리킨다. exit 명령이면 *is_exit 를 설정한다.
+static bool parse_pipelined_command(char* line, const char* username,
+                                    Request* req, bool* is_exit) {
+    char* save = NULL;
+    char* cmd = strtok_r(line, " \t\r", &save);
+    char* arg1 = strtok_r(NULL, " \t\r", &save);
+    char* arg2 = strtok_r(NULL, " \t\r", &save);
+    char* extra = strtok_r(NULL, " \t\r", &save);
+    if (cmd == NULL || extra != NULL) return false;
+
+    memset(req, 0, sizeof(Request));
+    req->username = (char*)username;
+    *is_exit = false;
+
+    if (strcmp(cmd, "login") == 0 && arg1 && arg2) {
+        req->action = ACTION_LOGIN;
+        req->username = arg1;
+        req->data = arg2;
+    } else if (strcmp(cmd, "book") == 0 && arg1 && !arg2) {
+        req->action = ACTION_BOOK;
+        req->data = arg1;
+    } else if ((strcmp(cmd, "confirm") == 0 || strcmp(cmd, "confirm_booking") == 0) &&
+               arg1 && !arg2) {
+        req->action = ACTION_CONFIRM_BOOKING;
+        req->data = arg1;
+    } else if ((strcmp(cmd, "cancel") == 0 || strcmp(cmd, "cancel_booking") == 0) &&
+               arg1 && !arg2) {
+        req->action = ACTION_CANCEL_BOOKING;
+        req->data = arg1;
+    } else if (strcmp(cmd, "query") == 0 && arg1 && !arg2) {
+        req->action = ACTION_QUERY;
+        req->data = arg1;
+    } else if (strcmp(cmd, "logout") == 0 && !arg1) {
+        req->action = ACTION_LOGOUT;
+    } else if ((strcmp(cmd, "exit") == 0 || strcmp(cmd, "quit") == 0) && !arg1) {
+        *is_exit = true;
+        return true;
+    } else {
+        return false;
+    }
+
+    req->username_length = req->username ? strlen(req->username) : 0;
+    req->data_size = req->data ? strlen(req->data) : 0;
+    return true;
+}
+
+// 파일 전체(또는 exit 까지)를 파이프라인으로 실행한다.
+static void run_pipelined(FILE* file, int32_t sockfd, size_t window) {
+    // 요청이 배치 단위로 나가므로 Nagle 로 마지막 조각이 붙잡히지 않게 한다
+    int32_t one = 1;
+    setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    Pipeline p;
+    memset(&p, 0, sizeof(p));
+    p.window = window;
+    p.ring = calloc(window, sizeof(Request));
+    if (p.ring == NULL) {
+        perror("calloc failed");
+        return;
+    }
+    pipeline_set_user(&p, active_user);
+
+    char* line = NULL;
+    size_t len = 0;
+    ssize_t nread;
+    bool keep_going = true;
+
+    while (keep_going && (nread = getline(&line, &len, file)) != -1) {
+        if (nread > 0 && line[nread - 1] == '\n') line[nread - 1] = '\0';
+        if (line_is_empty(line)) continue;
+
+        char* copy = strdup(line);
+        Request req;
+        bool is_exit = false;
+        if (copy != NULL && parse_pipelined_command(copy, p.next_user, &req, &is_exit)) {
+            if (is_exit) {
+                keep_going = false;
+            } else {
+                pipeline_submit(&p, sockfd, &req);
+                if (req.action == ACTION_LOGIN) pipeline_set_user(&p, req.username);
+                if (req.action == ACTION_LOGOUT) pipeline_set_user(&p, NULL);
+            }
+        } else {
+            // 해석할 수 없는 줄은 순서를 지키기 위해 앞의 응답을 다 받은 뒤 처리
+            pipeline_drain(&p, sockfd);
+            keep_going = evaluate(line, sockfd, &active_user);
+            pipeline_set_user(&p, active_user);
+        }
+        free(copy);
+    }
+
+    pipeline_drain(&p, sockfd);
+    free(line);
+    free(p.batch);
+    free(p.ring);
+    free(p.next_user);
+}
+
 // -------------------------------------
 // main
 // -------------------------------------
@@ -176,17 +567,39 @@ int main(int argc, char* argv[]) {
     signal(SIGPIPE, SIG_IGN);
     setup_sigint_handler();
 
-    if (argc < 3) {
-        fprintf(stderr, "usage: %s <IP address> <port>\n", argv[0]);
+    // -w N: 파일 모드에서 응답을 기다리지 않고 N 개까지 요청을 먼저 보낸다
+    // -p V: 서버와 협상할 최고 프로토콜 버전 (1 이면 협상하지 않음)
+    size_t window = 1;
+    uint8_t wanted_protocol = PROTOCOL_MAX_VERSION;
+    bool bad_args = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "w:p:")) != -1) {
+        if (opt == 'w' && strtoull(optarg, NULL, 10) > 0) {
+            window = strtoull(optarg, NULL, 10);
+        } else if (opt == 'p' && atoi(optarg) >= PROTOCOL_V1 &&
+                   atoi(optarg) <= PROTOCOL_MAX_VERSION) {
+            wanted_protocol = atoi(optarg);
+        } else {
+            bad_args = true;
+        }
+    }
+    // 응답을 request id 로 짝지으므로 in-flight 요청은 그 범위를 넘지 않게 한다
+    if (window > INFLIGHT_ACTIONS) window = INFLIGHT_ACTIONS;
+
+    if (bad_args || argc - optind < 2 || argc - optind > 3) {
+        fprintf(stderr, "usage: %s [-w window] [-p protocol] <IP address> <port> [file]\n",
+                argv[0]);
         exit(EXIT_FAILURE);
     }
+    char** args = argv + optind;
 
-    int32_t sockfd = get_socket(argv[1], strtoull(argv[2], NULL, 10));
+    int32_t sockfd = get_socket(args[0], strtoull(args[1], NULL, 10));
     if (sockfd < 0) exit(EXIT_FAILURE);
+    negotiate_protocol(sockfd, wanted_protocol);
 
-    if (argc > 3) {
+    if (argc - optind > 2) {
         // --- FILE MODE ---
-        const char* filename = argv[3];
+        const char* filename = args[2];
         FILE* file = fopen(filename, "r");
         if (file == NULL) {
             fprintf(stderr, "%s: %s: %s\n", argv[0], filename, strerror(errno));
@@ -194,6 +607,14 @@ int main(int argc, char* argv[]) {
             exit(1);
         }
        
+        if (window > 1) {
+            run_pipelined(file, sockfd, window);
+            fclose(file);
+            terminate(sockfd, active_user);
+            close(sockfd);
+            return 0;
+        }
+
         char* line = NULL;
         size_t len = 0;
         ssize_t nread;
@@ -1,5 +1,9 @@
+#define _GNU_SOURCE
+
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
 #include <helper.h>
 #include <netinet/in.h>
 #include <pa3_error.h>
@@ -10,13 +14,189 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include "arena.h"
+#include "event_table.h"
+#include "handle_request.h"
+#include "hash_pool.h"
 #include "helper.h"
+#include "latency.h"
+#include "lockprof.h"
+#include "metrics.h"
+#include "snapshot.h"
+#include "trace.h"
+#include "user_table.h"
+#include "wal.h"
 
 bool sigint_received = false;
 
+// 워커가 어떤 I/O multiplexing 방식을 쓸지 (시작 시 --backend 로 선택)
+typedef enum {
+  BACKEND_EPOLL,
+  BACKEND_POLL,
+} IoBackend;
+
+typedef struct {
+  IoBackend backend;
+  size_t max_frame_size;  // username + data 의 최대 길이 (헤더 제외)
+  int32_t backlog;        // listen() backlog
+  bool reuseport;         // 워커마다 SO_REUSEPORT listen 소켓을 따로 둔다
+  int32_t hash_threads;   // 로그인 해시 전용 스레드 수. 0 이면 워커가 직접, -1 이면 코어 수의 절반
+  const char* wal_path;   // NULL 이면 WAL 없이 메모리에만 둔다
+  WalMode wal_mode;       // --durability
+  uint32_t wal_window_us; // group commit 으로 더 모을 시간
+  const char* snapshot_path;      // NULL 이면 스냅샷 없이 로그 전체를 재생한다
+  uint32_t snapshot_interval_sec; // 0 이면 종료할 때만 쓴다
+  const char* admin_path;         // 관리 Unix 소켓. NULL 이면 지표를 모으지 않는다
+  uint32_t trace_every;           // 요청 N 개 중 하나를 단계별로 추적한다. 0 이면 끈다
+  const char* trace_path;         // 추적 레코드를 내보낼 파일
+  uint32_t rebalance_ms;          // 워커 사이에서 연결을 옮길지 보는 주기. 0 이면 옮기지 않는다
+} ServerConfig;
+
+static ServerConfig config = {
+  .backend = BACKEND_EPOLL,
+  .max_frame_size = 64 * 1024,
+  .backlog = SOMAXCONN,
+  .reuseport = false,
+  .hash_threads = -1,
+  .wal_path = NULL,
+  .wal_mode = WAL_MODE_SYNC,
+  .wal_window_us = 0,
+  .snapshot_path = NULL,
+  .snapshot_interval_sec = 60,
+  .admin_path = NULL,
+  .trace_every = 0,
+  .trace_path = "pa3_trace.bin",
+  .rebalance_ms = 1000,
+};
+
+#define EPOLL_MAX_EVENTS 256
+#define POLL_FDS_INITIAL_SIZE 64
+
+// poll 백엔드의 워커별 fd 목록. helper 의 PollSet 은 CLIENTS_PER_THREAD 로
+// 고정이라 연결을 더 받을 수 없으므로, 가득 차면 두 배로 늘리는 목록을 따로 둔다.
+// 고치는 건 워커 스레드뿐이고 (새 연결도 arrivals 를 거쳐 워커가 넣는다)
+// 관리 스레드가 크기를 읽으므로 mutex 로 보호한다.
+typedef struct {
+  pthread_mutex_t mutex;
+  struct pollfd* set;
+  size_t size;
+  size_t cap;
+} PollFds;
+
+// 워커별 상태. thread_index 로 접근한다.
+typedef struct {
+  int32_t epoll_fd;
+  PollFds poll_fds;        // poll 백엔드
+  int32_t listen_fd;       // --reuseport 일 때 이 워커 전용 listen 소켓, 아니면 -1
+  _Atomic size_t n_conns;  // 배치(placement)용 연결 수
+  struct Conn* conns;      // 맡은 연결 목록 (워커 스레드만 만진다)
+  // 해시 풀이 끝낸 로그인 task 와, 새로 배치되거나 다른 워커에서 옮겨 온 연결을
+  // 받는 곳. event_fd 로 워커를 깨운다.
+  int32_t event_fd;
+  pthread_mutex_t inbox_mutex;
+  HashTask* inbox;
+  struct Conn* arrivals;
+  // 처리한 요청 수 (워커만 쓴다). 메인 스레드가 주기마다 읽어 처리율을 낸다.
+  _Atomic uint64_t n_requests;
+  // 메인 스레드의 이동 요청: 초당 migrate_rate 요청 이하인 연결 하나를
+  // migrate_to 워커로 넘긴다. 없으면 -1.
+  _Atomic int32_t migrate_to;
+  _Atomic uint64_t migrate_rate;
+  _Atomic uint64_t n_migrated;  // 다른 워커로 옮겨 보낸 연결 수 (관리 소켓에 보인다)
+  // 동기 WAL: fsync 를 기다리며 응답을 붙잡아 둔 연결 (워커 스레드만 만진다).
+  // wal_wakeup 이 켜져 있으면 WAL 스레드가 fsync 뒤에 event_fd 로 깨운다.
+  struct Conn* wal_waiters;
+  _Atomic bool wal_wakeup;
+  uint64_t woken_ns;  // --trace: 마지막으로 poll 이 돌아온 시각 (워커 스레드만 쓴다)
+} Worker;
+
+static Worker* workers = NULL;
+static size_t n_workers = 0;
+
+// v1 요청 프레임 헤더: action(int32) + username_length(u64) + data_size(u64)
+// v2 헤더는 protocol.h 참고 (연결마다 HELLO 로 협상)
+#define FRAME_HEADER_SIZE (sizeof(int32_t) + 2 * sizeof(uint64_t))
+#define RECV_BUFFER_INITIAL_SIZE 4096
+#define SEND_BUFFER_INITIAL_SIZE 256  // 2의 거듭제곱이어야 한다
+// 보내지 못한 응답이 이만큼 쌓이면 클라이언트가 읽어갈 때까지 요청을 받지 않는다
+#define SEND_BUFFER_HIGH_WATER (1024 * 1024)
+
+// 연결별 수신 상태 머신. 한 번에 다 오지 않은 프레임도 이어서 받는다.
+// 파이프라이닝된 요청은 rbuf 에 여러 프레임이 연달아 쌓일 수 있다.
+typedef enum {
+  RECV_HEADER,
+  RECV_BODY,
+} RecvState;
+
+// 연결별 송신 링 버퍼. head/tail 은 계속 증가하는 값이고 cap 으로 mask 해서 쓴다.
+// 직렬화된 응답이 쌓이고, 한 번의 sendmsg 로 (감긴 부분까지) 내보낸다.
+typedef struct {
+  uint8_t* data;
+  size_t cap;
+  size_t head;  // 아직 보내지 않은 첫 바이트
+  size_t tail;  // 다음에 쓸 위치
+} SendBuffer;
+
+// --trace: 표본으로 고른 요청 하나를 응답이 나갈 때까지 연결이 들고 있는다.
+// 한 연결에서 동시에 하나만 추적한다.
+typedef struct {
+  bool active;
+  TraceRecord record;
+  uint64_t hash_ns;    // 해시 풀에 넘긴 시각
+  uint64_t queued_ns;  // 응답을 송신 버퍼에 쌓은 시각. 아직이면 0
+  uint64_t wal_ns;     // fsync 를 기다리기 시작한 시각. 기다리지 않으면 0
+} ConnTrace;
+
+typedef struct Conn {
+  int32_t fd;
+  SendBuffer out;
+  int16_t poll_events;  // poll 백엔드에서 fd 목록에 등록된 events
+  bool read_paused;  // 송신 버퍼가 가득 차서 읽기를 멈췄는지
+  bool parked;       // 로그인 해시를 기다리는 중. 끝날 때까지 다음 프레임을 처리하지 않는다
+  bool closed;       // parked/wal_waiting 상태에서 연결이 끊겼다. 돌아오면 해제한다
+  bool wal_waiting;  // 워커의 wal_waiters 목록에 올라 있다
+  struct Conn* wal_next;
+  Session session;   // 이 연결로 로그인한 유저와 협상한 프로토콜 버전
+  RecvState state;
+  uint8_t* rbuf;  // 받은 바이트. 프레임은 헤더 + username + data 순서
+  size_t rcap;
+  size_t rpos;    // 처리 중인 프레임의 시작 위치
+  size_t rlen;    // rbuf 에 받아 둔 바이트 끝
+  size_t need;    // 현재 상태를 끝내기 위해 rpos 부터 필요한 바이트
+  int32_t action;
+  uint64_t username_length;
+  uint64_t data_size;
+  uint32_t request_id;  // v2: 처리 중인 요청의 id (응답에 그대로 싣는다)
+  // 워커 배치와 이동 (맡고 있는 워커는 conn_owner 참고)
+  struct Conn* worker_prev;  // 워커의 연결 목록
+  struct Conn* worker_next;
+  struct Conn* arrival_next;
+  uint64_t n_requests;       // 처리한 요청 수
+  uint64_t requests_mark;    // 지난번 이동할 연결을 고를 때의 n_requests 와 시각
+  uint64_t mark_ns;
+  // --trace: 마지막 read() 의 시각들 (poll 반환, read 시작, read 끝)
+  uint64_t woken_ns;
+  uint64_t read_ns;
+  uint64_t read_done_ns;
+  ConnTrace trace;
+} Conn;
+
+// fd -> Conn. 연결은 맡은 워커만 만진다.
+// conn_owner[fd] 는 그 fd 의 연결을 지금 맡은 워커 (없으면 SIZE_MAX) 이다. 자기
+// 번호로 올리는 것도 (worker_attach_conn) 자기 번호에서 내리는 것도
+// (worker_detach_conn) 그 워커뿐이므로, 워커가 자기 번호를 읽으면 conn_table[fd]
+// 는 자기 연결이다. 아니면 Conn 을 건드리지 않는다 (닫혀서 fd 가 다른 워커의 새
+// 연결에 재사용되었을 수 있다).
+static _Atomic(Conn*)* conn_table = NULL;
+static _Atomic size_t* conn_owner = NULL;
+static size_t conn_table_size = 0;
+
 // Helper function: can write to fd safely even when sigint is received
 ssize_t sigint_safe_write(int32_t fd, void* buf, size_t count) {
   ssize_t n_written;
@@ -36,16 +216,24 @@ ssize_t sigint_safe_read(int32_t fd, void* buf, size_t count) {
 }
 
 // Use pthread_mutex_lock when accessing 'PollSet'
-void add_to_pollset(PollSet* poll_set,
-                    int32_t notification_fd,
-                    int32_t connfd) {
-  pthread_mutex_lock(&poll_set->mutex);
+// 자리가 없으면 false.
+static bool pollset_append(PollSet* poll_set, int32_t fd) {
+  bool added = false;
+  LOCKPROF_LOCK(&poll_set->mutex, LOCK_SITE_POLL_SET);
   if (poll_set->size < CLIENTS_PER_THREAD) {
-    poll_set->set[poll_set->size].fd = connfd;
+    poll_set->set[poll_set->size].fd = fd;
     poll_set->set[poll_set->size].events = POLLIN;
     poll_set->size++;
+    added = true;
   }
-  pthread_mutex_unlock(&poll_set->mutex);
+  LOCKPROF_UNLOCK(&poll_set->mutex, LOCK_SITE_POLL_SET);
+  return added;
+}
+
+void add_to_pollset(PollSet* poll_set,
+                    int32_t notification_fd,
+                    int32_t connfd) {
+  pollset_append(poll_set, connfd);
   notify_pollset(notification_fd);
 }
 
@@ -64,18 +252,818 @@ void remove_from_pollset(ThreadData* data, size_t* i_ptr) {
   else (*i_ptr) = 0; // 0번 인덱스일 경우 처리 주의 (보통 0번은 파이프라 삭제 안 되지만 방어 코드)
 }
 
-void* thread_func(void* arg) {
-  ThreadData* data = (ThreadData*)arg;
-  
-  // 로컬 폴링 배열 (PollSet 복사본)
-  struct pollfd local_fds[CLIENTS_PER_THREAD];
-  
+static bool poll_fds_init(PollFds* poll_fds) {
+  pthread_mutex_init(&poll_fds->mutex, NULL);
+  poll_fds->set = malloc(sizeof(struct pollfd) * POLL_FDS_INITIAL_SIZE);
+  poll_fds->size = 0;
+  poll_fds->cap = POLL_FDS_INITIAL_SIZE;
+  return poll_fds->set != NULL;
+}
+
+// 가득 차 있으면 두 배로 늘린다. 메모리가 없으면 false.
+static bool poll_fds_append(PollFds* poll_fds, int32_t fd, int16_t events) {
+  bool added = true;
+  LOCKPROF_LOCK(&poll_fds->mutex, LOCK_SITE_POLL_SET);
+  if (poll_fds->size == poll_fds->cap) {
+    struct pollfd* grown = realloc(poll_fds->set, sizeof(struct pollfd) * poll_fds->cap * 2);
+    if (grown != NULL) {
+      poll_fds->set = grown;
+      poll_fds->cap *= 2;
+    }
+  }
+  if (poll_fds->size < poll_fds->cap) {
+    poll_fds->set[poll_fds->size].fd = fd;
+    poll_fds->set[poll_fds->size].events = events;
+    poll_fds->set[poll_fds->size].revents = 0;
+    poll_fds->size++;
+  } else {
+    added = false;
+  }
+  LOCKPROF_UNLOCK(&poll_fds->mutex, LOCK_SITE_POLL_SET);
+  return added;
+}
+
+static void poll_fds_remove(PollFds* poll_fds, int32_t fd) {
+  LOCKPROF_LOCK(&poll_fds->mutex, LOCK_SITE_POLL_SET);
+  for (size_t k = 0; k < poll_fds->size; k++) {
+    if (poll_fds->set[k].fd == fd) {
+      poll_fds->set[k] = poll_fds->set[poll_fds->size - 1];
+      poll_fds->size--;
+      break;
+    }
+  }
+  LOCKPROF_UNLOCK(&poll_fds->mutex, LOCK_SITE_POLL_SET);
+}
+
+static bool set_nonblocking(int32_t fd) {
+  int32_t flags = fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static void conn_table_init(void) {
+  struct rlimit rl;
+  conn_table_size = 1024;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) {
+    conn_table_size = rl.rlim_cur;
+  }
+  conn_table = calloc(conn_table_size, sizeof(_Atomic(Conn*)));
+  conn_owner = malloc(conn_table_size * sizeof(_Atomic size_t));
+  if (conn_table == NULL || conn_owner == NULL) {
+    free(conn_table);
+    free(conn_owner);
+    conn_table = NULL;
+    conn_owner = NULL;
+    conn_table_size = 0;
+    return;
+  }
+  for (size_t fd = 0; fd < conn_table_size; fd++) atomic_init(&conn_owner[fd], SIZE_MAX);
+}
+
+// 이 워커가 맡은 fd 의 연결. 아니면 NULL (이번 묶음에서 닫았거나 옮긴 연결 등).
+static Conn* worker_conn(ThreadData* data, int32_t fd) {
+  if (atomic_load(&conn_owner[fd]) != (size_t)data->thread_index) return NULL;
+  return atomic_load_explicit(&conn_table[fd], memory_order_relaxed);
+}
+
+// accept 한 소켓을 논블로킹으로 바꾸고 연결 상태를 만든다.
+static Conn* conn_create(int32_t fd) {
+  if ((size_t)fd >= conn_table_size || !set_nonblocking(fd)) return NULL;
+
+  Conn* conn = calloc(1, sizeof(Conn));
+  if (conn == NULL) return NULL;
+  conn->rbuf = malloc(RECV_BUFFER_INITIAL_SIZE);
+  if (conn->rbuf == NULL) {
+    free(conn);
+    return NULL;
+  }
+  conn->out.data = malloc(SEND_BUFFER_INITIAL_SIZE);
+  if (conn->out.data == NULL) {
+    free(conn->rbuf);
+    free(conn);
+    return NULL;
+  }
+  conn->out.cap = SEND_BUFFER_INITIAL_SIZE;
+  conn->poll_events = POLLIN;
+  conn->fd = fd;
+  conn->rcap = RECV_BUFFER_INITIAL_SIZE;
+  conn->state = RECV_HEADER;
+  conn->need = FRAME_HEADER_SIZE;
+  conn->session = (Session)SESSION_INIT;
+  atomic_store(&conn_table[fd], conn);
+  return conn;
+}
+
+static void conn_free(Conn* conn) {
+  free(conn->rbuf);
+  free(conn->out.data);
+  free(conn);
+}
+
+// fd 가 재사용되기 전에 테이블에서 먼저 지운 뒤 닫는다.
+// 해시 풀에 task 가 나가 있거나 WAL 대기 목록에 있으면 Conn 은 그쪽이 끝날 때 해제한다.
+static void conn_destroy(Conn* conn) {
+  atomic_store(&conn_table[conn->fd], NULL);
+  close(conn->fd);
+  conn->fd = -1;
+  if (conn->parked || conn->wal_waiting) {
+    conn->closed = true;
+    return;
+  }
+  conn_free(conn);
+}
+
+static size_t send_buffer_pending(const SendBuffer* out) {
+  return out->tail - out->head;
+}
+
+// 링 버퍼 끝에 바이트를 덧붙인다. 공간이 모자라면 두 배씩 키운다.
+static bool send_buffer_append(SendBuffer* out, const void* src, size_t count) {
+  size_t pending = send_buffer_pending(out);
+  if (pending + count > out->cap) {
+    size_t new_cap = out->cap;
+    while (new_cap < pending + count) new_cap *= 2;
+    uint8_t* new_data = malloc(new_cap);
+    if (new_data == NULL) return false;
+
+    // 감겨 있던 내용을 새 버퍼 앞쪽으로 펴서 옮긴다
+    size_t start = out->head & (out->cap - 1);
+    size_t first = pending < out->cap - start ? pending : out->cap - start;
+    memcpy(new_data, out->data + start, first);
+    memcpy(new_data + first, out->data, pending - first);
+    free(out->data);
+    out->data = new_data;
+    out->cap = new_cap;
+    out->head = 0;
+    out->tail = pending;
+  }
+
+  const uint8_t* p = src;
+  size_t start = out->tail & (out->cap - 1);
+  size_t first = count < out->cap - start ? count : out->cap - start;
+  memcpy(out->data + start, p, first);
+  memcpy(out->data, p + first, count - first);
+  out->tail += count;
+  return true;
+}
+
+// 쌓인 응답을 sendmsg 한 번으로 보낸다 (버퍼가 감겨 있으면 iovec 2개).
+// write 대신 sendmsg 를 쓰는 건 MSG_NOSIGNAL 로 SIGPIPE 를 피하기 위해서다.
+// 소켓이 가득 차면 남은 바이트는 그대로 두고 writable 이벤트 때 다시 보낸다.
+// 연결에 오류가 나면 false.
+static bool conn_flush(Conn* conn) {
+  SendBuffer* out = &conn->out;
+  while (send_buffer_pending(out) > 0) {
+    size_t pending = send_buffer_pending(out);
+    size_t start = out->head & (out->cap - 1);
+    size_t first = pending < out->cap - start ? pending : out->cap - start;
+
+    struct iovec iov[2] = {
+      {.iov_base = out->data + start, .iov_len = first},
+      {.iov_base = out->data, .iov_len = pending - first},
+    };
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = pending > first ? 2 : 1};
+    ssize_t n_written = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+    if (n_written < 0) {
+      if (errno == EINTR) continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    out->head += n_written;
+  }
+  out->head = out->tail = 0;
+  return true;
+}
+
+// --trace: 이 프레임을 추적하기 시작한다. 처리 전까지의 단계는 마지막 read 의
+// 시각들로 채우고, handle_request 안의 단계가 이 레코드에 더해지게 한다.
+static uint64_t conn_trace_begin(Conn* conn, int32_t action) {
+  ConnTrace* trace = &conn->trace;
+  memset(trace, 0, sizeof(ConnTrace));
+  trace->active = true;
+  TraceRecord* record = &trace->record;
+  uint64_t now = trace_now();
+  record->started_ns = conn->woken_ns;
+  record->action = action;
+  record->stage_ns[TRACE_STAGE_POLL] = trace_span(conn->woken_ns, conn->read_ns);
+  record->stage_ns[TRACE_STAGE_READ] = trace_span(conn->read_ns, conn->read_done_ns);
+  record->stage_ns[TRACE_STAGE_QUEUE] = trace_span(conn->read_done_ns, now);
+  trace_set_current(record);
+  return now;
+}
+
+// 처리가 끝났다. 응답이 송신 버퍼에 쌓였으면 (queued) 보내는 시간을 재기 시작한다.
+static void conn_trace_handled(Conn* conn, uint64_t handle_ns, int32_t code, bool queued) {
+  trace_set_current(NULL);
+  ConnTrace* trace = &conn->trace;
+  uint64_t now = trace_now();
+  trace->record.stage_ns[TRACE_STAGE_HANDLE] += trace_span(handle_ns, now);
+  trace->record.code = code;
+  if (queued) {
+    trace->queued_ns = now;
+  } else {
+    trace->hash_ns = now;
+  }
+}
+
+// 응답이 다 나갔다. 보내는 데 걸린 시간과 전체 시간을 채워 링 버퍼에 넣는다.
+static void conn_trace_finish(ThreadData* data, Conn* conn) {
+  ConnTrace* trace = &conn->trace;
+  TraceRecord* record = &trace->record;
+  uint64_t now = trace_now();
+  uint32_t sent = trace_span(trace->queued_ns, now);
+  uint32_t wal = record->stage_ns[TRACE_STAGE_WAL];
+  record->stage_ns[TRACE_STAGE_WRITE] = sent > wal ? sent - wal : 0;
+  record->total_ns = trace_span(record->started_ns, now);
+  trace_commit(data->thread_index, record);
+  trace->active = false;
+}
+
+// 동기 WAL: 이 연결이 남긴 레코드가 아직 fsync 되지 않았으면 응답을 내보내지 않고
+// 워커의 대기 목록에 올린다. fsync 가 끝나면 worker_release_durable 이 다시 부른다.
+// 대기 플래그를 켠 뒤 durable 위치를 다시 읽으므로, WAL 스레드가 위치를 올린 뒤
+// 플래그를 보는 순서와 엇갈려도 깨우기를 놓치지 않는다.
+static bool conn_release(ThreadData* data, Conn* conn) {
+  ConnTrace* trace = &conn->trace;
+  if (conn->session.wal_lsn > wal_durable_lsn()) {
+    Worker* worker = &workers[data->thread_index];
+    atomic_store(&worker->wal_wakeup, true);
+    if (conn->session.wal_lsn > wal_durable_lsn()) {
+      if (!conn->wal_waiting) {
+        conn->wal_waiting = true;
+        conn->wal_next = worker->wal_waiters;
+        worker->wal_waiters = conn;
+      }
+      if (trace->active && trace->queued_ns != 0 && trace->wal_ns == 0) {
+        trace->wal_ns = trace_now();
+      }
+      return true;
+    }
+  }
+  if (trace->wal_ns != 0) {
+    trace->record.stage_ns[TRACE_STAGE_WAL] += trace_span(trace->wal_ns, trace_now());
+    trace->wal_ns = 0;
+  }
+  if (!conn_flush(conn)) return false;
+  if (trace->active && trace->queued_ns != 0 && send_buffer_pending(&conn->out) == 0) {
+    conn_trace_finish(data, conn);
+  }
+  return true;
+}
+
+// 응답을 TLV (data_size, code, data) 로 직렬화해 송신 버퍼에 쌓는다.
+// v2 연결이면 8 바이트 헤더 (request_id, code|data_size) 를 쓴다.
+static bool conn_queue_response(Conn* conn, const Response* res) {
+  uint64_t data_size = res->data != NULL ? res->data_size : 0;
+  uint8_t header[sizeof(uint64_t) + sizeof(int32_t)];
+  size_t header_size = sizeof(header);
+
+  if (conn->session.protocol == PROTOCOL_V2) {
+    if (data_size > V2_MAX_RESPONSE_DATA_SIZE) return false;
+    V2ResponseHeader v2 = {
+        .request_id = conn->request_id, .code = res->code, .data_size = data_size};
+    v2_pack_response_header(header, &v2);
+    header_size = V2_RESPONSE_HEADER_SIZE;
+  } else {
+    memcpy(header, &data_size, sizeof(uint64_t));
+    memcpy(header + sizeof(uint64_t), &res->code, sizeof(int32_t));
+  }
+
+  return send_buffer_append(&conn->out, header, header_size) &&
+         (data_size == 0 ||
+          send_buffer_append(&conn->out, res->data, data_size));
+}
+
+static size_t frame_header_size(const Conn* conn) {
+  return conn->session.protocol == PROTOCOL_V2 ? V2_REQUEST_HEADER_SIZE
+                                               : FRAME_HEADER_SIZE;
+}
+
+// 헤더를 다 받았을 때 호출. 길이를 검사하고 본문을 받을 준비를 한다.
+// 프레임이 너무 크면 false (스트림을 다시 맞출 방법이 없으므로 연결을 끊는다).
+static bool parse_frame_header(Conn* conn) {
+  const uint8_t* header = conn->rbuf + conn->rpos;
+  if (conn->session.protocol == PROTOCOL_V2) {
+    V2RequestHeader v2;
+    v2_unpack_request_header(header, &v2);
+    conn->action = v2.action;
+    conn->username_length = v2.username_length;
+    conn->data_size = v2.data_size;
+    conn->request_id = v2.request_id;
+  } else {
+    memcpy(&conn->action, header, sizeof(int32_t));
+    memcpy(&conn->username_length, header + sizeof(int32_t), sizeof(uint64_t));
+    memcpy(&conn->data_size, header + sizeof(int32_t) + sizeof(uint64_t),
+           sizeof(uint64_t));
+  }
+
+  if (conn->username_length > config.max_frame_size ||
+      conn->data_size > config.max_frame_size - conn->username_length) {
+    fprintf(stderr, "frame too large (username %lu, data %lu), closing fd %d\n",
+            (unsigned long)conn->username_length, (unsigned long)conn->data_size,
+            conn->fd);
+    return false;
+  }
+
+  conn->state = RECV_BODY;
+  conn->need = frame_header_size(conn) + conn->username_length + conn->data_size;
+  return true;
+}
+
+// 다음 read 전에 처리가 끝난 앞부분을 버리고, 현재 프레임이
+// 통째로 들어갈 만큼 버퍼를 키운다.
+static bool conn_prepare_read(Conn* conn) {
+  if (conn->rpos > 0) {
+    memmove(conn->rbuf, conn->rbuf + conn->rpos, conn->rlen - conn->rpos);
+    conn->rlen -= conn->rpos;
+    conn->rpos = 0;
+  }
+  if (conn->need > conn->rcap) {
+    size_t new_cap = conn->rcap;
+    while (new_cap < conn->need) new_cap *= 2;
+    uint8_t* new_buf = realloc(conn->rbuf, new_cap);
+    if (new_buf == NULL) return false;
+    conn->rbuf = new_buf;
+    conn->rcap = new_cap;
+  }
+  return true;
+}
+
+// 해시 풀 스레드에서 호출된다. task 를 워커의 inbox 에 넣고 깨운다.
+static void on_hash_done(HashTask* task) {
+  Worker* worker = &workers[task->worker];
+  LOCKPROF_LOCK(&worker->inbox_mutex, LOCK_SITE_WORKER_INBOX);
+  task->next = worker->inbox;
+  worker->inbox = task;
+  LOCKPROF_UNLOCK(&worker->inbox_mutex, LOCK_SITE_WORKER_INBOX);
+
+  uint64_t one = 1;
+  write(worker->event_fd, &one, sizeof(one));
+}
+
+// 로그인을 해시 풀로 넘긴다. 해시 없이 결과가 정해지면 바로 응답한다.
+// 넘긴 경우 연결은 parked 가 되어 응답이 나갈 때까지 다음 프레임을 처리하지 않는다.
+static bool dispatch_login(ThreadData* data, Conn* conn, const Request* req,
+                           uint64_t started_ns) {
+  HashTask* task = calloc(1, sizeof(HashTask));
+  if (task == NULL) return false;
+
+  login_begin(req, &task->job);
+  if (task->job.step == LOGIN_STEP_DONE) {
+    Response res;
+    memset(&res, 0, sizeof(Response));
+    res.code = login_finish(&task->job, &conn->session);
+    free(task);
+    metrics_record(data->thread_index, ACTION_LOGIN, res.code, started_ns);
+    return conn_queue_response(conn, &res);
+  }
+
+  task->started_ns = started_ns;
+  task->done = on_hash_done;
+  task->owner = conn;
+  task->worker = data->thread_index;
+  conn->parked = true;
+  hash_pool_submit(task);
+  return true;
+}
+
+// 버전 협상. 클라이언트가 원하는 최고 버전과 서버 최고 버전 중 작은 쪽을
+// v1 응답으로 알려 주고, 다음 프레임부터 그 버전으로 주고받는다.
+static bool dispatch_hello(Conn* conn, const Request* req) {
+  uint8_t version = PROTOCOL_V1;
+  if (req->data_size >= 1 && (uint8_t)req->data[0] > PROTOCOL_V1) {
+    version = (uint8_t)req->data[0] < PROTOCOL_MAX_VERSION ? (uint8_t)req->data[0]
+                                                            : PROTOCOL_MAX_VERSION;
+  }
+
+  Response res;
+  memset(&res, 0, sizeof(Response));
+  res.data = &version;
+  res.data_size = sizeof(version);
+  if (!conn_queue_response(conn, &res)) return false;
+
+  conn->session.protocol = version;
+  return true;
+}
+
+// 완성된 프레임 하나를 Request 로 만들어 처리하고 응답을 송신 버퍼에 쌓는다.
+static bool dispatch_frame(ThreadData* data, Conn* conn) {
+  Request req;
+  Response res;
+  memset(&req, 0, sizeof(Request));
+  memset(&res, 0, sizeof(Response));
+
+  req.action = (Action)conn->action;
+  req.username_length = conn->username_length;
+  req.data_size = conn->data_size;
+
+  // 문자열 사본은 워커 arena 에서 받는다 (conn_read 가 묶음마다 reset)
+  Arena* arena = thread_arena();
+  const uint8_t* body = conn->rbuf + conn->rpos + frame_header_size(conn);
+  if (req.username_length > 0) {
+    req.username = arena_alloc(arena, req.username_length + 1);
+    if (req.username == NULL) return false;
+    memcpy(req.username, body, req.username_length);
+    req.username[req.username_length] = '\0';
+  }
+  if (req.data_size > 0) {
+    req.data = arena_alloc(arena, req.data_size + 1);
+    if (req.data == NULL) return false;
+    memcpy(req.data, body + req.username_length, req.data_size);
+    req.data[req.data_size] = '\0';
+  }
+
+  // --- Process Request ---
+  // 재배치용 처리량. 워커 카운터를 쓰는 건 이 워커뿐이다.
+  _Atomic uint64_t* n_requests = &workers[data->thread_index].n_requests;
+  atomic_store_explicit(n_requests, atomic_load_explicit(n_requests, memory_order_relaxed) + 1,
+                        memory_order_relaxed);
+  conn->n_requests++;
+
+  bool ok;
+  uint64_t started_ns = metrics_now();
+  bool traced = !conn->trace.active && trace_sample(data->thread_index);
+  uint64_t handle_ns = traced ? conn_trace_begin(conn, req.action) : 0;
+  if (req.action == PROTOCOL_HELLO_ACTION && conn->session.protocol == PROTOCOL_V1) {
+    ok = dispatch_hello(conn, &req);
+  } else if (req.action == ACTION_LOGIN && config.hash_threads > 0) {
+    ok = dispatch_login(data, conn, &req, started_ns);
+  } else {
+    res.code = handle_session_request(&req, &res, &conn->session, data->users, data->seats);
+    metrics_record(data->thread_index, req.action, res.code, started_ns);
+
+    // --- Queue Response (TLV) ---
+    ok = conn_queue_response(conn, &res);
+  }
+  if (traced) conn_trace_handled(conn, handle_ns, res.code, !conn->parked);
+
+  // --- Cleanup ---
+  // 요청 사본과 응답 데이터는 arena 에 있으므로 여기서는 놓기만 한다
+  response_release(&res);
+  return ok;
+}
+
+// rbuf 에 이미 완성되어 있는 프레임을 받은 순서대로 모두 처리한다.
+// 송신 버퍼가 high water 를 넘거나 로그인이 해시 풀에 나가 있으면 중간에 멈춘다.
+// 연결을 닫아야 하면 false.
+static bool conn_drain_frames(ThreadData* data, Conn* conn) {
+  while (!conn->parked && conn->rlen - conn->rpos >= conn->need) {
+    if (send_buffer_pending(&conn->out) >= SEND_BUFFER_HIGH_WATER) {
+      // 상대가 응답을 읽어가지 않으므로 더 처리하지 않는다. flush 가 끝나면 재개.
+      conn->read_paused = true;
+      return true;
+    }
+
+    if (conn->state == RECV_HEADER) {
+      if (!parse_frame_header(conn)) return false;
+      continue;
+    }
+
+    if (!dispatch_frame(data, conn)) return false;
+    conn->rpos += conn->need;
+    conn->state = RECV_HEADER;
+    conn->need = frame_header_size(conn);
+  }
+  return true;
+}
+
+// 소켓에서 읽을 수 있는 만큼 한꺼번에 읽고, 그 안에 들어 있는 프레임을
+// 모두 처리한다. 중간에 끊긴 프레임은 다음 이벤트에서 이어 받는다.
+// 연결을 닫아야 하면 false.
+static bool conn_read(ThreadData* data, Conn* conn) {
+  while (true) {
+    // 이번 묶음의 응답은 송신 버퍼에 복사됐으므로 arena 를 되돌린다
+    bool drained = conn_drain_frames(data, conn);
+    arena_reset(thread_arena());
+    if (!drained) return false;
+    // parked 인 동안에는 읽지 않는다. 응답이 나간 뒤 worker_drain_inbox 가 다시 읽는다.
+    if (conn->read_paused || conn->parked) return true;
+    if (!conn_prepare_read(conn)) return false;
+
+    uint64_t read_ns = trace_now();
+    ssize_t n_read = sigint_safe_read(conn->fd, conn->rbuf + conn->rlen,
+                                      conn->rcap - conn->rlen);
+    if (n_read == 0) return false;
+    if (n_read < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+    conn->rlen += n_read;
+    if (read_ns != 0) {
+      conn->woken_ns = workers[data->thread_index].woken_ns;
+      conn->read_ns = read_ns;
+      conn->read_done_ns = trace_now();
+    }
+  }
+}
+
+// 연결 하나의 readiness 이벤트 처리. 이번에 쌓인 응답들은 마지막에
+// 한 번의 flush 로 묶어서 보낸다. 연결을 닫아야 하면 false.
+static bool serve_client(ThreadData* data, Conn* conn, bool readable,
+                         bool writable) {
+  if (writable && !conn_release(data, conn)) return false;
+
+  // 읽기를 멈췄다가 버퍼가 비워진 경우에도 읽는다 (edge-triggered 라
+  // 이미 소켓에 와 있는 데이터에 대해서는 새 이벤트가 오지 않는다)
+  while (readable || (conn->read_paused &&
+                      send_buffer_pending(&conn->out) < SEND_BUFFER_HIGH_WATER)) {
+    readable = false;
+    conn->read_paused = false;
+    bool alive = conn_read(data, conn);
+    // 상대가 닫았더라도 이미 처리한 요청의 응답은 보내 본다
+    if (!conn_release(data, conn) || !alive) return false;
+  }
+  return true;
+}
+
+// poll 백엔드: 보낼 응답이 남아 있는 동안만 POLLOUT 을 등록하고,
+// 읽기를 멈춘 동안에는 POLLIN 을 빼서 poll 이 헛돌지 않게 한다.
+// fsync 를 기다리는 응답은 보낼 수 없으므로 POLLOUT 도 뺀다.
+static void pollset_update_events(PollFds* poll_fds, Conn* conn) {
+  int16_t events = (conn->read_paused || conn->parked ? 0 : POLLIN) |
+                   (send_buffer_pending(&conn->out) > 0 && !conn->wal_waiting ? POLLOUT : 0);
+  if (events == conn->poll_events) return;
+
+  LOCKPROF_LOCK(&poll_fds->mutex, LOCK_SITE_POLL_SET);
+  for (size_t k = 0; k < poll_fds->size; k++) {
+    if (poll_fds->set[k].fd == conn->fd) {
+      poll_fds->set[k].events = events;
+      break;
+    }
+  }
+  LOCKPROF_UNLOCK(&poll_fds->mutex, LOCK_SITE_POLL_SET);
+  conn->poll_events = events;
+}
+
+// 연결을 워커의 이벤트 셋과 연결 목록에 넣는다. 워커 스레드에서만 부른다.
+static bool worker_attach_conn(Worker* worker, Conn* conn) {
+  if (config.backend == BACKEND_EPOLL) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.fd = conn->fd;
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, conn->fd, &ev) < 0) {
+      perror("epoll_ctl");
+      return false;
+    }
+  } else {
+    conn->poll_events = POLLIN;
+    if (!poll_fds_append(&worker->poll_fds, conn->fd, POLLIN)) return false;
+  }
+  conn->worker_prev = NULL;
+  conn->worker_next = worker->conns;
+  if (worker->conns != NULL) worker->conns->worker_prev = conn;
+  worker->conns = conn;
+  conn->requests_mark = conn->n_requests;
+  conn->mark_ns = now_ns();
+  worker->n_conns++;
+  atomic_store(&conn_owner[conn->fd], (size_t)(worker - workers));
+  return true;
+}
+
+// 워커의 이벤트 셋과 연결 목록에서 뺀다 (닫거나 다른 워커로 넘기기 전에)
+static void worker_detach_conn(Worker* worker, Conn* conn) {
+  atomic_store(&conn_owner[conn->fd], SIZE_MAX);
+  if (config.backend == BACKEND_EPOLL) {
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+  } else {
+    poll_fds_remove(&worker->poll_fds, conn->fd);
+  }
+  if (conn->worker_prev != NULL) {
+    conn->worker_prev->worker_next = conn->worker_next;
+  } else {
+    worker->conns = conn->worker_next;
+  }
+  if (conn->worker_next != NULL) conn->worker_next->worker_prev = conn->worker_prev;
+  conn->worker_prev = conn->worker_next = NULL;
+  worker->n_conns--;
+}
+
+// 워커의 이벤트 셋에서 연결을 빼고 닫는다.
+static void worker_close_conn(ThreadData* data, Conn* conn) {
+  worker_detach_conn(&workers[data->thread_index], conn);
+  conn_destroy(conn);
+}
+
+// 해시 풀이 끝낸 로그인들을 마무리한다. 응답을 쌓은 뒤 멈춰 있던 연결의
+// 남은 프레임을 처리하고, 그동안 소켓에 온 데이터도 읽는다.
+static void worker_drain_inbox(ThreadData* data, Worker* worker) {
+  uint64_t count;
+  read(worker->event_fd, &count, sizeof(count));
+
+  LOCKPROF_LOCK(&worker->inbox_mutex, LOCK_SITE_WORKER_INBOX);
+  HashTask* task = worker->inbox;
+  worker->inbox = NULL;
+  LOCKPROF_UNLOCK(&worker->inbox_mutex, LOCK_SITE_WORKER_INBOX);
+
+  while (task != NULL) {
+    HashTask* next = task->next;
+    Conn* conn = task->owner;
+
+    Response res;
+    memset(&res, 0, sizeof(Response));
+    res.code = login_finish(&task->job, conn->closed ? NULL : &conn->session);
+    // 로그인 지연은 해시 풀에서 기다린 시간까지 포함한다
+    metrics_record(data->thread_index, ACTION_LOGIN, res.code, task->started_ns);
+    free(task);
+    if (conn->trace.active && conn->trace.queued_ns == 0) {
+      // 해시 풀에서 기다리고 해시한 시간. 처리 시간에도 들어간다.
+      ConnTrace* trace = &conn->trace;
+      uint32_t hashed = trace_span(trace->hash_ns, trace_now());
+      trace->record.stage_ns[TRACE_STAGE_HASH] += hashed;
+      trace->record.stage_ns[TRACE_STAGE_HANDLE] += hashed;
+      trace->record.code = res.code;
+      trace->queued_ns = trace_now();
+    }
+
+    conn->parked = false;
+    if (conn->closed) {
+      if (!conn->wal_waiting) conn_free(conn);
+    } else if (!conn_queue_response(conn, &res) ||
+               !serve_client(data, conn, true, false)) {
+      worker_close_conn(data, conn);
+    } else if (config.backend == BACKEND_POLL) {
+      pollset_update_events(&worker->poll_fds, conn);
+    }
+    task = next;
+  }
+}
+
+// 종료할 때: 워커가 끝난 뒤 해시 풀이 돌려준 로그인은 응답을 보낼 워커가 없으므로
+// 마무리만 하고 해제한다.
+static void workers_discard_logins(void) {
+  for (size_t i = 0; i < n_workers; i++) {
+    HashTask* task = workers[i].inbox;
+    workers[i].inbox = NULL;
+    while (task != NULL) {
+      HashTask* next = task->next;
+      login_finish(&task->job, NULL);
+      free(task);
+      task = next;
+    }
+  }
+}
+
+// WAL 스레드에서 fsync 가 끝날 때마다 호출된다. 응답을 붙잡아 둔 워커만 깨운다.
+static void on_wal_durable(void) {
+  for (size_t i = 0; i < n_workers; i++) {
+    if (atomic_exchange(&workers[i].wal_wakeup, false)) {
+      uint64_t one = 1;
+      write(workers[i].event_fd, &one, sizeof(one));
+    }
+  }
+}
+
+// fsync 가 끝난 연결들의 응답을 내보낸다. 아직 덮이지 않은 연결은
+// conn_release 가 다시 목록에 올린다.
+static void worker_release_durable(ThreadData* data, Worker* worker) {
+  Conn* conn = worker->wal_waiters;
+  worker->wal_waiters = NULL;
+  while (conn != NULL) {
+    Conn* next = conn->wal_next;
+    conn->wal_waiting = false;
+    if (conn->closed) {
+      if (!conn->parked) conn_free(conn);
+    } else if (!serve_client(data, conn, false, true)) {
+      worker_close_conn(data, conn);
+    } else if (config.backend == BACKEND_POLL) {
+      pollset_update_events(&worker->poll_fds, conn);
+    }
+    conn = next;
+  }
+}
+
+// conn 을 target 워커에 넘긴다. target 이 event_fd 로 깨어나 직접 자기 이벤트 셋에
+// 넣으므로 워커의 fd 목록은 그 워커 스레드만 고친다. 넘긴 뒤에는 conn 을 만지지 않는다.
+static void worker_hand_off(size_t target, Conn* conn) {
+  Worker* worker = &workers[target];
+  LOCKPROF_LOCK(&worker->inbox_mutex, LOCK_SITE_WORKER_INBOX);
+  conn->arrival_next = worker->arrivals;
+  worker->arrivals = conn;
+  LOCKPROF_UNLOCK(&worker->inbox_mutex, LOCK_SITE_WORKER_INBOX);
+  uint64_t one = 1;
+  write(worker->event_fd, &one, sizeof(one));
+}
+
+// 넘겨받은 연결을 등록한다. 이미 소켓에 와 있는 데이터는 epoll 이 ADD 할 때
+// 알려 주고, poll 은 level-triggered 라 따로 읽을 필요가 없다.
+static void worker_take_arrivals(Worker* worker) {
+  LOCKPROF_LOCK(&worker->inbox_mutex, LOCK_SITE_WORKER_INBOX);
+  Conn* conn = worker->arrivals;
+  worker->arrivals = NULL;
+  LOCKPROF_UNLOCK(&worker->inbox_mutex, LOCK_SITE_WORKER_INBOX);
+
+  while (conn != NULL) {
+    Conn* next = conn->arrival_next;
+    if (!worker_attach_conn(worker, conn)) {
+      fprintf(stderr, "cannot watch fd %d, closing\n", conn->fd);
+      conn_destroy(conn);
+    } else if (config.backend == BACKEND_POLL) {
+      pollset_update_events(&worker->poll_fds, conn);
+    }
+    conn = next;
+  }
+}
+
+// 메인 스레드가 이동을 요청했으면 초당 migrate_rate 요청 이하인 연결 중 가장
+// 바쁜 것 하나를 migrate_to 로 넘긴다. 로그인 해시나 fsync 를 기다리는 연결,
+// 읽기를 멈춘 연결은 이 워커가 곧 다시 만져야 하므로 옮기지 않는다.
+static void worker_migrate_out(ThreadData* data, Worker* worker) {
+  int32_t target = atomic_exchange(&worker->migrate_to, -1);
+  if (target < 0) return;
+  uint64_t budget = atomic_load(&worker->migrate_rate);
+
+  uint64_t now = now_ns();
+  Conn* best = NULL;
+  uint64_t best_rate = 0;
+  for (Conn* conn = worker->conns; conn != NULL; conn = conn->worker_next) {
+    uint64_t elapsed = now - conn->mark_ns;
+    uint64_t rate = elapsed > 0 ? (conn->n_requests - conn->requests_mark) * 1000000000ull / elapsed : 0;
+    conn->requests_mark = conn->n_requests;
+    conn->mark_ns = now;
+    if (conn->parked || conn->wal_waiting || conn->read_paused) continue;
+    if (rate <= budget && rate > best_rate) {
+      best = conn;
+      best_rate = rate;
+    }
+  }
+  // 하나뿐인 연결을 옮기면 부하가 자리만 바꾼다
+  if (best == NULL || worker->n_conns < 2) return;
+
+  worker_detach_conn(worker, best);
+  worker_hand_off(target, best);
+  atomic_fetch_add_explicit(&worker->n_migrated, 1, memory_order_relaxed);
+}
+
+// event_fd 로 깨어났다: 끝난 로그인, fsync 가 끝난 응답.
+// 넘겨받은 연결과 이동 요청은 worker_end_batch 에서 처리한다.
+static void worker_wakeup(ThreadData* data, Worker* worker) {
+  worker_drain_inbox(data, worker);
+  worker_release_durable(data, worker);
+}
+
+// 논블로킹 listen 소켓에서 연결 하나를 accept 해서 Conn 을 만든다.
+// 더 받을 연결이 없거나 오류가 나면 NULL 이고, errno 가 EAGAIN 이면
+// 대기 중이던 연결을 다 받은 것이다.
+static Conn* accept_conn(int32_t listenfd) {
+  while (true) {
+    int32_t connfd = accept4(listenfd, NULL, NULL, SOCK_CLOEXEC);
+    if (connfd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      return NULL;
+    }
+
+    printf("Accepted connection from client\n");
+    Conn* conn = conn_create(connfd);
+    if (conn != NULL) return conn;
+    fprintf(stderr, "cannot track connection fd %d, closing\n", connfd);
+    close(connfd);
+  }
+}
+
+// --reuseport: 이 워커의 listen 소켓에 쌓인 연결을 한 번에 모두 받아
+// 자기 이벤트 셋에 바로 등록한다 (다른 스레드를 거치지 않는다).
+static void worker_accept_pending(ThreadData* data, Worker* worker) {
+  Conn* conn;
+  while ((conn = accept_conn(worker->listen_fd)) != NULL) {
+    if (!worker_attach_conn(worker, conn)) {
+      fprintf(stderr, "cannot watch fd %d, closing\n", conn->fd);
+      conn_destroy(conn);
+    }
+  }
+  if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept");
+}
+
+// poll/epoll 이 한 번 돌려준 이벤트를 다 처리한 뒤에 부른다. 연결을 이 워커에
+// 새로 붙이거나 (accept, 넘겨받은 연결) 다른 워커로 내보내는 일은 여기서만 한다.
+// 그래야 같은 묶음의 뒤쪽 이벤트가 이번에 닫혀 재사용된 fd 의 새 연결이나 이미
+// 넘긴 연결을 만지지 않는다.
+static void worker_end_batch(ThreadData* data, Worker* worker, bool accept, bool woken) {
+  if (accept) worker_accept_pending(data, worker);
+  if (woken) {
+    worker_take_arrivals(worker);
+    worker_migrate_out(data, worker);
+  }
+}
+
+// poll 백엔드: 매 wakeup 마다 fd 목록을 복사해서 poll() 한다.
+static void poll_loop(ThreadData* data) {
+  Worker* worker = &workers[data->thread_index];
+  // 로컬 폴링 배열 (fd 목록 복사본). 목록이 늘어나면 같이 늘린다.
+  size_t local_cap = 0;
+  struct pollfd* local_fds = NULL;
+
   while (!sigint_received) {
-    // 1. 공유 자원(PollSet)을 로컬로 복사
-    pthread_mutex_lock(&data->poll_set->mutex);
-    size_t current_size = data->poll_set->size;
-    memcpy(local_fds, data->poll_set->set, current_size * sizeof(struct pollfd));
-    pthread_mutex_unlock(&data->poll_set->mutex);
+    // 1. 공유 자원(fd 목록)을 로컬로 복사
+    LOCKPROF_LOCK(&worker->poll_fds.mutex, LOCK_SITE_POLL_SET);
+    size_t current_size = worker->poll_fds.size;
+    if (current_size > local_cap) {
+      struct pollfd* grown = realloc(local_fds, sizeof(struct pollfd) * worker->poll_fds.cap);
+      if (grown == NULL) {
+        LOCKPROF_UNLOCK(&worker->poll_fds.mutex, LOCK_SITE_POLL_SET);
+        perror("realloc");
+        break;
+      }
+      local_fds = grown;
+      local_cap = worker->poll_fds.cap;
+    }
+    memcpy(local_fds, worker->poll_fds.set, current_size * sizeof(struct pollfd));
+    LOCKPROF_UNLOCK(&worker->poll_fds.mutex, LOCK_SITE_POLL_SET);
 
     // 2. poll 실행
     if (poll(local_fds, current_size, -1) < 0) {
@@ -83,10 +1071,12 @@ void* thread_func(void* arg) {
       perror("poll");
       break;
     }
+    worker->woken_ns = trace_now();
 
     // 3. 이벤트 처리
+    bool accept = false, woken = false;
     for (size_t i = 0; i < current_size; i++) {
-      if (local_fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+      if (local_fds[i].revents & (POLLIN | POLLOUT | POLLHUP | POLLERR)) {
         int fd = local_fds[i].fd;
 
         // Case A: 파이프 알림 (새 클라이언트 연결 등)
@@ -94,93 +1084,410 @@ void* thread_func(void* arg) {
           char buf[16];
           read(fd, buf, sizeof(buf)); // 파이프 비우기
           // 루프를 돌면서 다시 복사본을 갱신하러 감
-        } 
-        // Case B: 클라이언트 요청
+        }
+        // Case B: 이 워커의 listen 소켓 (--reuseport)
+        else if (fd == worker->listen_fd) {
+          accept = true;
+        }
+        // Case C: 해시 풀이 끝낸 로그인, fsync 가 끝난 응답, 새 연결, 이동 요청
+        else if (fd == worker->event_fd) {
+          worker_wakeup(data, worker);
+          woken = true;
+        }
+        // Case D: 클라이언트 요청
         else {
-          Request req;
-          Response res;
-          memset(&req, 0, sizeof(Request));
-          memset(&res, 0, sizeof(Response));
-          
-          bool connection_closed = false;
-
-          // --- Receive Request (TLV) ---
-          int32_t action_val;
-          if (sigint_safe_read(fd, &action_val, sizeof(int32_t)) <= 0) connection_closed = true;
-          req.action = (Action)action_val;
-
-          if (!connection_closed && sigint_safe_read(fd, &req.username_length, sizeof(uint64_t)) <= 0) connection_closed = true;
-          if (!connection_closed && sigint_safe_read(fd, &req.data_size, sizeof(uint64_t)) <= 0) connection_closed = true;
-
-          if (!connection_closed && req.username_length > 0) {
-            req.username = malloc(req.username_length + 1);
-            if (sigint_safe_read(fd, req.username, req.username_length) <= 0) connection_closed = true;
-            else req.username[req.username_length] = '\0';
-          }
+          // 이번 루프에서 이미 닫은 연결
+          Conn* conn = worker_conn(data, fd);
+          if (conn == NULL) continue;
 
-          if (!connection_closed && req.data_size > 0) {
-            req.data = malloc(req.data_size + 1);
-            if (sigint_safe_read(fd, req.data, req.data_size) <= 0) connection_closed = true;
-            else req.data[req.data_size] = '\0';
+          int16_t revents = local_fds[i].revents;
+          if ((revents & POLLERR) ||
+              !serve_client(data, conn, revents & (POLLIN | POLLHUP), revents & POLLOUT)) {
+            worker_close_conn(data, conn);
+          } else {
+            pollset_update_events(&worker->poll_fds, conn);
           }
+        }
+      }
+    }
+    worker_end_batch(data, worker, accept, woken);
+  }
+  free(local_fds);
+}
 
-          if (connection_closed) {
-            if (req.username) free(req.username);
-            if (req.data) free(req.data);
-            
-            // [중요] 실제 공유 PollSet에서 제거해야 함
-            pthread_mutex_lock(&data->poll_set->mutex);
-            for (size_t k = 0; k < data->poll_set->size; k++) {
-                if (data->poll_set->set[k].fd == fd) {
-                    // remove_from_pollset 함수 내부 로직을 직접 구현하거나 호출
-                    // 여기서는 안전하게 직접 구현 (인덱스 포인터 문제 방지)
-                    close(data->poll_set->set[k].fd);
-                    data->poll_set->set[k] = data->poll_set->set[data->poll_set->size - 1];
-                    data->poll_set->size--;
-                    break;
-                }
-            }
-            pthread_mutex_unlock(&data->poll_set->mutex);
-            continue;
-          }
+// epoll 백엔드: 연결은 워커가 event_fd 로 넘겨받아 직접 epoll_ctl 로 등록하므로
+// fd 목록 복사가 필요 없다. 파이프는 종료 알림용으로만 등록된다.
+static void epoll_loop(ThreadData* data) {
+  Worker* worker = &workers[data->thread_index];
+  struct epoll_event events[EPOLL_MAX_EVENTS];
 
-          // --- Process Request ---
-          // [수정] 반환값을 res.code에 저장해야 함
-          res.code = handle_request(&req, &res, data->users, data->seats);
+  while (!sigint_received) {
+    int32_t n_events = epoll_wait(worker->epoll_fd, events, EPOLL_MAX_EVENTS, -1);
+    if (n_events < 0) {
+      if (errno == EINTR) continue;
+      perror("epoll_wait");
+      break;
+    }
+    worker->woken_ns = trace_now();
 
-          // --- Send Response (TLV) ---
-          sigint_safe_write(fd, &res.data_size, sizeof(uint64_t));
-          sigint_safe_write(fd, &res.code, sizeof(int32_t));
-          if (res.data_size > 0 && res.data != NULL) {
-            sigint_safe_write(fd, res.data, res.data_size);
-          }
+    bool accept = false, woken = false;
+    for (int32_t i = 0; i < n_events; i++) {
+      int32_t fd = events[i].data.fd;
 
-          // --- Cleanup ---
-          if (req.username) free(req.username);
-          if (req.data) free(req.data);
-          if (res.data) free(res.data);
-        }
+      if (fd == data->pipe_out_fd) {
+        char buf[16];
+        read(fd, buf, sizeof(buf));
+        continue;
+      }
+
+      if (fd == worker->listen_fd) {
+        accept = true;
+        continue;
+      }
+
+      if (fd == worker->event_fd) {
+        worker_wakeup(data, worker);
+        woken = true;
+        continue;
+      }
+
+      // Edge-triggered 이므로 serve_client 가 EAGAIN 까지 읽어야
+      // 다음 이벤트를 받을 수 있다. EPOLLOUT 은 처음부터 등록해 두고
+      // 남은 응답이 있을 때만 flush 한다.
+      // 로그인 해시를 기다리는 중에 연결이 끊기면 (EPOLLERR) 바로 닫는다.
+      // 이번 루프에서 이미 닫은 연결
+      Conn* conn = worker_conn(data, fd);
+      if (conn == NULL) continue;
+
+      uint32_t ev = events[i].events;
+      if ((ev & EPOLLERR) ||
+          !serve_client(data, conn, ev & (EPOLLIN | EPOLLRDHUP | EPOLLHUP),
+                        ev & EPOLLOUT)) {
+        worker_close_conn(data, conn);
       }
     }
+    worker_end_batch(data, worker, accept, woken);
+  }
+}
+
+void* thread_func(void* arg) {
+  ThreadData* data = (ThreadData*)arg;
+
+  if (config.backend == BACKEND_EPOLL) {
+    epoll_loop(data);
+  } else {
+    poll_loop(data);
   }
+  response_cache_release();
+  arena_destroy(thread_arena());
   pthread_exit(NULL);
 }
 
+// 관리 스레드에서 불린다. poll 백엔드면 fd 목록 크기를 락 안에서 읽는다.
+static void worker_load(size_t i, MetricsLoad* load) {
+  load->conns = workers[i].n_conns;
+  load->migrated = atomic_load_explicit(&workers[i].n_migrated, memory_order_relaxed);
+  if (config.backend == BACKEND_EPOLL) return;
+  PollFds* poll_fds = &workers[i].poll_fds;
+  pthread_mutex_lock(&poll_fds->mutex);
+  load->slots_used = poll_fds->size;
+  load->slots_capacity = poll_fds->cap;
+  pthread_mutex_unlock(&poll_fds->mutex);
+}
+
+// -------------------------------------
+// 연결 배치와 재배치 (메인 스레드)
+// -------------------------------------
+// 주기마다 워커별 처리율 (초당 요청 수) 을 재서 새 연결은 처리율이 낮은 워커에
+// 보낸다. 연결 수가 같아도 한 워커의 연결들만 바쁠 수 있으므로, 가장 바쁜 워커와
+// 가장 한가한 워커의 차이가 REBALANCE_PATIENCE 주기 연속으로 크면 바쁜 워커에
+// 연결 하나를 한가한 워커로 옮기라고 요청한다.
+#define REBALANCE_DEFAULT_MS 1000
+#define REBALANCE_PATIENCE 3
+#define REBALANCE_RATIO 1.25
+#define REBALANCE_MIN_GAP 500.0  // req/s. 이보다 작은 차이는 옮길 가치가 없다
+
+typedef struct {
+  uint64_t last_requests;
+  double rate;      // 초당 요청 수 (EWMA)
+  size_t placed;    // 이번 주기에 보낸 새 연결 수 (아직 n_conns 에 안 잡혔을 수 있다)
+} WorkerRate;
+
+static struct {
+  WorkerRate* workers;
+  uint64_t last_ns;
+  uint32_t imbalanced;  // 연속으로 불균형했던 주기 수
+} balancer;
+
+static uint32_t balancer_interval_ms(void) {
+  return config.rebalance_ms > 0 ? config.rebalance_ms : REBALANCE_DEFAULT_MS;
+}
+
+static bool balancer_init(void) {
+  balancer.workers = calloc(n_workers, sizeof(WorkerRate));
+  balancer.last_ns = now_ns();
+  return balancer.workers != NULL;
+}
+
+// 다음 주기까지 남은 ms (메인 poll 의 timeout)
+static int32_t balancer_timeout_ms(void) {
+  uint64_t deadline = balancer.last_ns + balancer_interval_ms() * 1000000ull;
+  uint64_t now = now_ns();
+  return now >= deadline ? 0 : (int32_t)((deadline - now + 999999) / 1000000);
+}
+
+static void balancer_tick(void) {
+  uint64_t now = now_ns();
+  if (now < balancer.last_ns + balancer_interval_ms() * 1000000ull) return;
+  double seconds = (now - balancer.last_ns) / 1e9;
+  balancer.last_ns = now;
+
+  size_t hot = 0, cold = 0;
+  for (size_t i = 0; i < n_workers; i++) {
+    WorkerRate* w = &balancer.workers[i];
+    uint64_t requests = atomic_load_explicit(&workers[i].n_requests, memory_order_relaxed);
+    w->rate = 0.5 * w->rate + 0.5 * (requests - w->last_requests) / seconds;
+    w->last_requests = requests;
+    w->placed = 0;
+    if (w->rate > balancer.workers[hot].rate) hot = i;
+    if (w->rate < balancer.workers[cold].rate) cold = i;
+  }
+
+  double hot_rate = balancer.workers[hot].rate, cold_rate = balancer.workers[cold].rate;
+  if (hot_rate <= cold_rate * REBALANCE_RATIO || hot_rate - cold_rate < REBALANCE_MIN_GAP) {
+    balancer.imbalanced = 0;
+    return;
+  }
+  if (++balancer.imbalanced < REBALANCE_PATIENCE || config.rebalance_ms == 0) return;
+  balancer.imbalanced = 0;
+
+  // 차이의 절반 이하인 연결을 옮기면 넘친 쪽이 반대가 되지 않는다
+  atomic_store(&workers[hot].migrate_rate, (uint64_t)((hot_rate - cold_rate) / 2));
+  atomic_store(&workers[hot].migrate_to, (int32_t)cold);
+  uint64_t one = 1;
+  write(workers[hot].event_fd, &one, sizeof(one));
+}
+
+// 새 연결을 보낼 워커. 이번 주기에 이미 보낸 연결은 평균 연결 하나만큼의
+// 처리율로 치고, 처리율이 같으면 (처음이나 한가할 때) 연결 수가 적은 워커를 고른다.
+static size_t balancer_place(void) {
+  double total_rate = 0;
+  size_t total_conns = 0;
+  for (size_t i = 0; i < n_workers; i++) {
+    total_rate += balancer.workers[i].rate;
+    total_conns += workers[i].n_conns;
+  }
+  double per_conn = total_conns > 0 && total_rate > 0 ? total_rate / total_conns : 1;
+
+  size_t best = 0;
+  double best_score = 0;
+  size_t best_conns = 0;
+  for (size_t i = 0; i < n_workers; i++) {
+    WorkerRate* w = &balancer.workers[i];
+    size_t conns = workers[i].n_conns + w->placed;
+    double score = w->rate + w->placed * per_conn;
+    if (i == 0 || score < best_score || (score == best_score && conns < best_conns)) {
+      best = i;
+      best_score = score;
+      best_conns = conns;
+    }
+  }
+  balancer.workers[best].placed++;
+  return best;
+}
+
+// 논블로킹 listen 소켓을 만든다. 실패하면 -1.
+static int32_t create_listener(const char* port) {
+  int32_t listenfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listenfd < 0) {
+    perror("socket");
+    return -1;
+  }
+
+  int opt = 1;
+  setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+  if (config.reuseport &&
+      setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+    perror("setsockopt(SO_REUSEPORT)");
+    close(listenfd);
+    return -1;
+  }
+
+  struct sockaddr_in saddr;
+  memset(&saddr, 0, sizeof(saddr));
+  saddr.sin_family = AF_INET;
+  saddr.sin_addr.s_addr = htonl(INADDR_ANY);
+  saddr.sin_port = htons(strtoull(port, NULL, 10));
+
+  if (bind(listenfd, (struct sockaddr*)&saddr, sizeof(saddr)) < 0) {
+    perror("bind failed");
+    close(listenfd);
+    return -1;
+  }
+  if (listen(listenfd, config.backlog) < 0) {
+    perror("listen");
+    close(listenfd);
+    return -1;
+  }
+  return listenfd;
+}
+
+static void print_usage(const char* prog) {
+  fprintf(stderr,
+          "usage: %s <port> [--backend=epoll|poll] [--max-frame=BYTES]\n"
+          "       [--reuseport] [--backlog=N] [--hash-threads=N]\n"
+          "       [--event=ID:SEATS]... [--wal=PATH] [--durability=sync|async]\n"
+          "       [--wal-window=USEC] [--snapshot=PATH] [--snapshot-interval=SEC]\n"
+          "       [--admin=SOCKET_PATH] [--trace=N] [--trace-file=PATH]\n"
+          "       [--rebalance=MS]\n",
+          prog);
+}
+
+// 옵션을 파싱해서 config 를 채우고 port 문자열을 반환한다. 실패 시 NULL.
+static const char* parse_options(int argc, char* argv[]) {
+  static const struct option long_options[] = {
+    {"backend", required_argument, NULL, 'b'},
+    {"max-frame", required_argument, NULL, 'm'},
+    {"reuseport", no_argument, NULL, 'r'},
+    {"backlog", required_argument, NULL, 'l'},
+    {"hash-threads", required_argument, NULL, 'h'},
+    {"event", required_argument, NULL, 'e'},
+    {"wal", required_argument, NULL, 'w'},
+    {"durability", required_argument, NULL, 'd'},
+    {"wal-window", required_argument, NULL, 'W'},
+    {"snapshot", required_argument, NULL, 's'},
+    {"snapshot-interval", required_argument, NULL, 'S'},
+    {"admin", required_argument, NULL, 'a'},
+    {"trace", required_argument, NULL, 't'},
+    {"trace-file", required_argument, NULL, 'T'},
+    {"rebalance", required_argument, NULL, 'R'},
+    {NULL, 0, NULL, 0},
+  };
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "b:m:rl:e:w:d:W:s:S:a:t:T:R:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'b':
+        if (strcmp(optarg, "epoll") == 0) {
+          config.backend = BACKEND_EPOLL;
+        } else if (strcmp(optarg, "poll") == 0) {
+          config.backend = BACKEND_POLL;
+        } else {
+          fprintf(stderr, "unknown backend: %s\n", optarg);
+          return NULL;
+        }
+        break;
+      case 'm':
+        config.max_frame_size = strtoull(optarg, NULL, 10);
+        if (config.max_frame_size == 0) {
+          fprintf(stderr, "invalid --max-frame: %s\n", optarg);
+          return NULL;
+        }
+        break;
+      case 'r':
+        config.reuseport = true;
+        break;
+      case 'l':
+        config.backlog = atoi(optarg);
+        if (config.backlog <= 0) {
+          fprintf(stderr, "invalid --backlog: %s\n", optarg);
+          return NULL;
+        }
+        break;
+      case 'h':
+        config.hash_threads = atoi(optarg);
+        if (config.hash_threads < 0) {
+          fprintf(stderr, "invalid --hash-threads: %s\n", optarg);
+          return NULL;
+        }
+        break;
+      case 'e': {
+        // 이벤트 좌석 맵은 여기서 바로 만든다 (워커가 뜨기 전)
+        char* end;
+        unsigned long event_id = strtoul(optarg, &end, 10);
+        unsigned long n_seats = *end == ':' ? strtoul(end + 1, &end, 10) : 0;
+        if (*end != '\0' || event_id > UINT32_MAX || n_seats > UINT32_MAX ||
+            !event_table_create(event_id, n_seats)) {
+          fprintf(stderr, "invalid --event (ID < %d, 1..%d seats, once per ID): %s\n",
+                  EVENT_MAX_EVENTS, EVENT_MAX_SEATS, optarg);
+          return NULL;
+        }
+        break;
+      }
+      case 'w':
+        config.wal_path = optarg;
+        break;
+      case 'd':
+        if (strcmp(optarg, "sync") == 0) {
+          config.wal_mode = WAL_MODE_SYNC;
+        } else if (strcmp(optarg, "async") == 0) {
+          config.wal_mode = WAL_MODE_ASYNC;
+        } else {
+          fprintf(stderr, "unknown durability mode: %s\n", optarg);
+          return NULL;
+        }
+        break;
+      case 'W':
+        config.wal_window_us = strtoul(optarg, NULL, 10);
+        break;
+      case 's':
+        config.snapshot_path = optarg;
+        break;
+      case 'S':
+        config.snapshot_interval_sec = strtoul(optarg, NULL, 10);
+        break;
+      case 'a':
+        config.admin_path = optarg;
+        break;
+      case 't':
+        config.trace_every = strtoul(optarg, NULL, 10);
+        if (config.trace_every == 0) {
+          fprintf(stderr, "invalid --trace: %s\n", optarg);
+          return NULL;
+        }
+        break;
+      case 'T':
+        config.trace_path = optarg;
+        break;
+      case 'R':
+        // 0 이면 배치만 하고 연결을 옮기지 않는다
+        config.rebalance_ms = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        return NULL;
+    }
+  }
+
+  if (optind != argc - 1) return NULL;
+  // 스냅샷 위치는 로그 위치로 적으므로 로그 없이 쓸 수 없다
+  if (config.snapshot_path != NULL && config.wal_path == NULL) {
+    fprintf(stderr, "--snapshot requires --wal\n");
+    return NULL;
+  }
+  return argv[optind];
+}
+
 int main(int argc, char* argv[]) {
   setup_sigint_handler();
 
-  if (argc != 2) {
-    fprintf(stderr, "usage: %s <port>\n", argv[0]);
+  const char* port = parse_options(argc, argv);
+  if (port == NULL) {
+    print_usage(argv[0]);
     return 1;
   }
 
-  int listenfd;
-  struct sockaddr_in saddr, caddr;
+  int listenfd = -1;
 
   Users users;
   // [필수 수정] Users 초기화 (Garbage 제거)
   memset(&users, 0, sizeof(Users));
   setup_users(&users);
+  user_table_init();
+
+  if (event_table_get(EVENT_DEFAULT_ID) == NULL) {
+    fprintf(stderr, "failed to create the default event\n");
+    return 1;
+  }
 
   Seat* seats = default_seats();
 
@@ -189,6 +1496,75 @@ int main(int argc, char* argv[]) {
   pthread_t* tid_arr = malloc(sizeof(pthread_t) * n_cores);
   ThreadData* data_arr = malloc(sizeof(ThreadData) * n_cores);
   int32_t (*pipe_fds)[2] = malloc(sizeof(int32_t[2]) * n_cores);
+  workers = calloc(n_cores, sizeof(Worker));
+  n_workers = n_cores;
+  conn_table_init();
+  if (config.admin_path != NULL && !metrics_init(n_cores)) {
+    fprintf(stderr, "cannot allocate metrics\n");
+    exit(EXIT_FAILURE);
+  }
+  if (config.trace_every > 0 && !trace_init(n_cores, config.trace_every, config.trace_path)) {
+    fprintf(stderr, "cannot allocate trace buffers\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (config.hash_threads < 0) {
+    config.hash_threads = n_cores / 2 > 0 ? n_cores / 2 : 1;
+  }
+  if (config.hash_threads > 0 && !hash_pool_start(config.hash_threads)) {
+    config.hash_threads = 0;
+  }
+
+  // --reuseport: 커널이 워커별 listen 소켓으로 연결을 나눠 주므로
+  // 중앙 accept 스레드를 거치지 않는다
+  for (int i = 0; i < n_cores; i++) {
+    pthread_mutex_init(&workers[i].inbox_mutex, NULL);
+    atomic_init(&workers[i].migrate_to, -1);
+    workers[i].event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (workers[i].event_fd < 0) {
+      perror("eventfd");
+      exit(EXIT_FAILURE);
+    }
+    workers[i].listen_fd = -1;
+    if (config.reuseport) {
+      workers[i].listen_fd = create_listener(port);
+      if (workers[i].listen_fd < 0) exit(EXIT_FAILURE);
+    }
+  }
+
+  // 워커를 띄우기 전에 스냅샷을 올리고, 그 뒤의 로그만 재생하고 이어 쓴다
+  if (config.wal_path != NULL) {
+    uint64_t start_lsn = 0;
+    seats_restore_begin();
+    if (config.snapshot_path != NULL && !snapshot_load(config.snapshot_path, &start_lsn)) {
+      fprintf(stderr, "cannot load %s\n", config.snapshot_path);
+      exit(EXIT_FAILURE);
+    }
+    if (!wal_replay(config.wal_path, start_lsn, seats_restore_record)) {
+      fprintf(stderr, "cannot replay %s\n", config.wal_path);
+      exit(EXIT_FAILURE);
+    }
+    seats_restore_finish();
+    if (!wal_start(config.wal_path, config.wal_mode, config.wal_window_us, on_wal_durable)) {
+      exit(EXIT_FAILURE);
+    }
+    if (config.snapshot_path != NULL &&
+        !snapshot_start(config.snapshot_path, config.snapshot_interval_sec)) {
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (config.backend == BACKEND_EPOLL) {
+    for (int i = 0; i < n_cores; i++) {
+      workers[i].epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+      if (workers[i].epoll_fd < 0) {
+        perror("epoll_create1 (falling back to poll)");
+        for (int k = 0; k < i; k++) close(workers[k].epoll_fd);
+        config.backend = BACKEND_POLL;
+        break;
+      }
+    }
+  }
 
   for (int i = 0; i < n_cores; i++) {
     if (pipe(pipe_fds[i]) < 0) {
@@ -201,24 +1577,51 @@ int main(int argc, char* argv[]) {
     data_arr[i].poll_set = create_poll_set(pipe_fds[i][0]);
     data_arr[i].users = &users;
     data_arr[i].seats = seats;
-    pthread_create(&tid_arr[i], NULL, thread_func, &data_arr[i]);
-  }
 
-  listenfd = socket(AF_INET, SOCK_STREAM, 0);
-  int opt = 1;
-  setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (config.backend == BACKEND_EPOLL) {
+      // 파이프는 종료 시 epoll_wait 를 깨우는 용도로만 쓴다
+      struct epoll_event ev;
+      memset(&ev, 0, sizeof(ev));
+      ev.events = EPOLLIN;
+      ev.data.fd = pipe_fds[i][0];
+      epoll_ctl(workers[i].epoll_fd, EPOLL_CTL_ADD, pipe_fds[i][0], &ev);
+      ev.data.fd = workers[i].event_fd;
+      epoll_ctl(workers[i].epoll_fd, EPOLL_CTL_ADD, workers[i].event_fd, &ev);
+    } else if (!poll_fds_init(&workers[i].poll_fds) ||
+               !poll_fds_append(&workers[i].poll_fds, pipe_fds[i][0], POLLIN) ||
+               !poll_fds_append(&workers[i].poll_fds, workers[i].event_fd, POLLIN)) {
+      perror("malloc");
+      exit(EXIT_FAILURE);
+    }
 
-  memset(&saddr, 0, sizeof(saddr));
-  saddr.sin_family = AF_INET;
-  saddr.sin_addr.s_addr = htonl(INADDR_ANY);
-  saddr.sin_port = htons(strtoull(argv[1], NULL, 10));
+    if (workers[i].listen_fd >= 0) {
+      if (config.backend == BACKEND_EPOLL) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.fd = workers[i].listen_fd;
+        epoll_ctl(workers[i].epoll_fd, EPOLL_CTL_ADD, workers[i].listen_fd, &ev);
+      } else {
+        poll_fds_append(&workers[i].poll_fds, workers[i].listen_fd, POLLIN);
+      }
+    }
+    pthread_create(&tid_arr[i], NULL, thread_func, &data_arr[i]);
+  }
 
-  if (bind(listenfd, (struct sockaddr*)&saddr, sizeof(saddr)) < 0) {
-      perror("bind failed");
-      exit(EXIT_FAILURE);
+  if (!config.reuseport) {
+    listenfd = create_listener(port);
+    if (listenfd < 0) exit(EXIT_FAILURE);
+  }
+  if (config.admin_path != NULL && !metrics_start_admin(config.admin_path, worker_load)) {
+    exit(EXIT_FAILURE);
+  }
+  if (!balancer_init()) {
+    perror("calloc");
+    exit(EXIT_FAILURE);
   }
-  listen(listenfd, 10);
 
+  // --reuseport 면 메인 스레드는 stdin 만 본다
+  nfds_t main_nfds = config.reuseport ? 1 : 2;
   struct pollfd main_thread_poll_set[2];
   memset(main_thread_poll_set, 0, sizeof(main_thread_poll_set));
   main_thread_poll_set[0].fd = STDIN_FILENO;
@@ -227,13 +1630,15 @@ int main(int argc, char* argv[]) {
   main_thread_poll_set[1].events = POLLIN;
 
   while (!sigint_received) {
-    if (poll(main_thread_poll_set, 2, -1) < 0) {
+    // 배치만 하는 경우에도 처리율은 재야 하므로 주기마다 깨어난다
+    if (poll(main_thread_poll_set, main_nfds, balancer_timeout_ms()) < 0) {
       if (errno == EINTR) {
         continue;
       }
       perror("poll");
       exit(EXIT_FAILURE);
     }
+    balancer_tick();
 
     if (main_thread_poll_set[0].revents & POLLIN) {
       if (check_stdin_for_termination() == true) {
@@ -241,27 +1646,38 @@ int main(int argc, char* argv[]) {
         continue;
       }
     } else if (main_thread_poll_set[1].revents & POLLIN) {
-      uint32_t caddrlen = sizeof(caddr);
-      int connfd = accept(listenfd, (struct sockaddr*)&caddr, &caddrlen);
-      if (connfd < 0) {
-        if (errno == EINTR) {
-          continue;
-        }
+      // 대기 중인 연결을 한 번에 모두 받는다
+      Conn* conn;
+      while ((conn = accept_conn(listenfd)) != NULL) {
+        worker_hand_off(balancer_place(), conn);
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
         puts("accept() failed");
         exit(EXIT_FAILURE);
       }
-
-      printf("Accepted connection from client\n");
-      ssize_t pollset_i;
-      do {
-        pollset_i = find_suitable_pollset(data_arr, n_cores);
-      } while (pollset_i == -1);
-      
-      add_to_pollset(data_arr[pollset_i].poll_set, pipe_fds[pollset_i][1],
-                     connfd);
     }
   }
 
-  return terminate_after_cleanup(pipe_fds, tid_arr, data_arr, n_cores, listenfd,
-                                 &users, seats);
+  // 워커 상태를 읽으므로 정리하기 전에 멈춘다
+  metrics_stop_admin();
+  int ret = terminate_after_cleanup(pipe_fds, tid_arr, data_arr, n_cores, listenfd,
+                                    &users, seats);
+  // 워커가 모두 끝나 더 넘어올 로그인이 없다. 남은 해시를 마치고 결과를 치운다.
+  if (config.hash_threads > 0) {
+    hash_pool_stop();
+    workers_discard_logins();
+  }
+  // 워커가 모두 끝난 뒤 마지막 스냅샷을 쓰고 남은 레코드를 내보낸다
+  snapshot_stop();
+  wal_stop();
+  if (config.trace_every > 0) {
+    int64_t n_traces = trace_dump();
+    if (n_traces >= 0) {
+      fprintf(stderr, "wrote %lld traces to %s\n", (long long)n_traces, config.trace_path);
+    }
+  }
+#ifdef LOCK_PROFILE
+  lockprof_report(stderr);
+#endif
+  return ret;
 }
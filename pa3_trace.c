@@ -0,0 +1,223 @@
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "protocol.h"
+#include "trace.h"
+
+// 추적 파일 요약기.
+//
+// 서버가 --trace=N 으로 남긴 파일 (관리 소켓 "trace" 또는 종료 시) 을 읽어
+// 단계별 지연 분포와 가장 느린 요청들의 단계별 시간을 보여 준다.
+// 느린 요청마다 가장 오래 걸린 단계를 같이 적으므로 꼬리 지연이 어디서 오는지
+// (poll 에서 차례를 기다렸는지, 락인지, 해시인지, fsync 인지) 바로 보인다.
+//
+//   pa3_trace [--top=N] [--action=NAME] pa3_trace.bin
+
+#define DEFAULT_TOP 20
+
+static const char* stage_names[TRACE_N_STAGES] = {
+  "poll", "read", "queue", "handle", "lock", "hash", "wal", "write",
+};
+
+static const char* action_names[] = {
+  "termination", "login", "book", "confirm", "cancel", "logout",
+  "query", "book_many", "query_range", "select_event",
+};
+#define N_ACTION_NAMES (sizeof(action_names) / sizeof(action_names[0]))
+
+static void action_name(int32_t action, char* out, size_t size) {
+  if (action >= 0 && (size_t)action < N_ACTION_NAMES) {
+    snprintf(out, size, "%s", action_names[action]);
+  } else if (action == PROTOCOL_HELLO_ACTION) {
+    snprintf(out, size, "hello");
+  } else {
+    snprintf(out, size, "%d", action);
+  }
+}
+
+static int32_t find_action(const char* name) {
+  for (size_t i = 0; i < N_ACTION_NAMES; i++) {
+    if (strcmp(action_names[i], name) == 0) return (int32_t)i;
+  }
+  if (strcmp(name, "hello") == 0) return PROTOCOL_HELLO_ACTION;
+  return -1;
+}
+
+// 파일 전체를 읽는다. 형식이 맞지 않으면 NULL.
+static TraceRecord* load_traces(const char* path, TraceFileHeader* header) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    perror(path);
+    return NULL;
+  }
+  TraceRecord* records = NULL;
+  if (fread(header, sizeof(TraceFileHeader), 1, file) != 1 ||
+      memcmp(header->magic, TRACE_FILE_MAGIC, sizeof(header->magic)) != 0) {
+    fprintf(stderr, "%s: not a trace file\n", path);
+  } else if (header->version != TRACE_FILE_VERSION || header->record_size != sizeof(TraceRecord) ||
+             header->n_stages != TRACE_N_STAGES) {
+    fprintf(stderr, "%s: unsupported trace format (version %u, %u-byte records, %u stages)\n",
+            path, header->version, header->record_size, header->n_stages);
+  } else if ((records = malloc(sizeof(TraceRecord) * (header->n_records + 1))) == NULL) {
+    perror("malloc");
+  } else if (fread(records, sizeof(TraceRecord), header->n_records, file) != header->n_records) {
+    fprintf(stderr, "%s: truncated\n", path);
+    free(records);
+    records = NULL;
+  }
+  fclose(file);
+  return records;
+}
+
+static int compare_u32(const void* a, const void* b) {
+  uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+  return x == y ? 0 : x < y ? -1 : 1;
+}
+
+// 전체 시간이 긴 순서
+static int compare_total(const void* a, const void* b) {
+  const TraceRecord* x = a;
+  const TraceRecord* y = b;
+  if (x->total_ns != y->total_ns) return x->total_ns < y->total_ns ? 1 : -1;
+  return 0;
+}
+
+// 정렬된 values 의 q 분위수
+static uint32_t percentile(const uint32_t* values, size_t n, double q) {
+  if (n == 0) return 0;
+  size_t rank = (size_t)(q * n + 0.999999);
+  if (rank == 0) rank = 1;
+  return values[rank - 1];
+}
+
+// 단계마다 (그리고 전체) 분포를 낸다
+static void print_stages(const TraceRecord* records, size_t n) {
+  uint32_t* values = malloc(sizeof(uint32_t) * (n + 1));
+  if (values == NULL) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  double total_sum = 0;
+  for (size_t i = 0; i < n; i++) total_sum += records[i].total_ns;
+
+  printf("%-8s %10s %10s %10s %10s %10s %7s\n", "stage", "mean(us)", "p50(us)", "p99(us)",
+         "p999(us)", "max(us)", "share");
+  for (int32_t stage = -1; stage < TRACE_N_STAGES; stage++) {
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) {
+      values[i] = stage < 0 ? records[i].total_ns : records[i].stage_ns[stage];
+      sum += values[i];
+    }
+    qsort(values, n, sizeof(uint32_t), compare_u32);
+    // LOCK, HASH 는 HANDLE 안에 들어 있으므로 share 를 더하면 100% 를 넘는다
+    printf("%-8s %10.1f %10.1f %10.1f %10.1f %10.1f %6.1f%%\n",
+           stage < 0 ? "total" : stage_names[stage], sum / n / 1e3,
+           percentile(values, n, 0.50) / 1e3, percentile(values, n, 0.99) / 1e3,
+           percentile(values, n, 0.999) / 1e3, values[n - 1] / 1e3,
+           total_sum > 0 ? 100 * sum / total_sum : 0);
+  }
+  free(values);
+}
+
+// 가장 느린 요청들. 시작 시각은 파일에서 가장 이른 요청으로부터의 ms.
+static void print_slowest(TraceRecord* records, size_t n, size_t top) {
+  uint64_t first_ns = UINT64_MAX;
+  for (size_t i = 0; i < n; i++) {
+    if (records[i].started_ns < first_ns) first_ns = records[i].started_ns;
+  }
+  qsort(records, n, sizeof(TraceRecord), compare_total);
+
+  printf("\n%-4s %10s %6s %-12s %5s %10s", "rank", "at(ms)", "worker", "action", "code",
+         "total(us)");
+  for (size_t s = 0; s < TRACE_N_STAGES; s++) printf(" %8s", stage_names[s]);
+  printf("  %s\n", "slowest stage");
+  for (size_t i = 0; i < n && i < top; i++) {
+    const TraceRecord* r = &records[i];
+    char name[16];
+    action_name(r->action, name, sizeof(name));
+    printf("%-4zu %10.3f %6u %-12s %5d %10.1f", i + 1, (r->started_ns - first_ns) / 1e6,
+           r->worker, name, r->code, r->total_ns / 1e3);
+    // HANDLE 은 안에 든 LOCK, HASH 를 뺀 나머지로 비교한다
+    size_t slowest = 0;
+    uint32_t slowest_ns = 0;
+    for (size_t s = 0; s < TRACE_N_STAGES; s++) {
+      printf(" %8.1f", r->stage_ns[s] / 1e3);
+      uint32_t own = r->stage_ns[s];
+      if (s == TRACE_STAGE_HANDLE) {
+        uint32_t inner = r->stage_ns[TRACE_STAGE_LOCK] + r->stage_ns[TRACE_STAGE_HASH];
+        own = own > inner ? own - inner : 0;
+      }
+      if (own > slowest_ns) {
+        slowest = s;
+        slowest_ns = own;
+      }
+    }
+    printf("  %s\n", stage_names[slowest]);
+  }
+}
+
+static void print_usage(const char* prog) {
+  fprintf(stderr,
+          "usage: %s [--top=N] [--action=NAME] TRACE_FILE\n"
+          "       actions: login, book, confirm, cancel, logout, query, book_many,\n"
+          "                query_range, select_event, hello\n",
+          prog);
+}
+
+int main(int argc, char* argv[]) {
+  static const struct option long_options[] = {
+    {"top", required_argument, NULL, 'n'},
+    {"action", required_argument, NULL, 'a'},
+    {NULL, 0, NULL, 0},
+  };
+
+  size_t top = DEFAULT_TOP;
+  bool filter = false;
+  int32_t action = 0;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "n:a:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'n':
+        top = strtoull(optarg, NULL, 10);
+        break;
+      case 'a':
+        filter = true;
+        action = find_action(optarg);
+        if (action < 0) {
+          print_usage(argv[0]);
+          return 1;
+        }
+        break;
+      default:
+        print_usage(argv[0]);
+        return 1;
+    }
+  }
+  if (optind != argc - 1) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  TraceFileHeader header;
+  TraceRecord* records = load_traces(argv[optind], &header);
+  if (records == NULL) return 1;
+
+  size_t n = 0;
+  for (size_t i = 0; i < header.n_records; i++) {
+    if (!filter || records[i].action == action) records[n++] = records[i];
+  }
+  printf("%zu traces from %u workers", n, header.n_workers);
+  if (filter) printf(" (%zu before filtering)", (size_t)header.n_records);
+  printf("\n\n");
+  if (n == 0) {
+    free(records);
+    return 0;
+  }
+
+  print_stages(records, n);
+  print_slowest(records, n, top);
+  free(records);
+  return 0;
+}
@@ -0,0 +1,123 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+#include <string.h>
+
+// 와이어 프로토콜 버전.
+//
+// v1 (기본): 요청 = action(i32) + username_length(u64) + data_size(u64) + username + data
+//            응답 = data_size(u64) + code(i32) + data
+//            좌석 번호와 confirm 종류는 10진 문자열, 좌석 목록은 size_t 배열.
+//
+// v2: 연결의 첫 요청으로 v1 HELLO 프레임(action = PROTOCOL_HELLO_ACTION,
+//     data = 원하는 최고 버전 1 바이트)을 보내고, 응답 data 의 1 바이트가
+//     앞으로 쓸 버전이다. v2 를 모르는 서버는 모르는 action 이라 code -1 을
+//     돌려주므로 클라이언트는 v1 로 계속한다.
+//     요청 헤더 8 바이트: action(u8) username_length(u8) data_size(u16) request_id(u32)
+//     응답 헤더 8 바이트: request_id(u32) code(i8) | data_size(u24) 를 묶은 u32
+//     BOOK/CANCEL/QUERY 의 data 는 좌석 번호 u32, CONFIRM 의 data 는 종류 u8,
+//     CONFIRM 응답의 좌석 목록은 u32 배열이다.
+//     username_length 가 0 이면 서버는 연결에 묶인 세션 유저를 쓴다.
+// 정수는 v1 과 마찬가지로 호스트 바이트 순서로 보낸다.
+
+#define PROTOCOL_V1 1
+#define PROTOCOL_V2 2
+#define PROTOCOL_MAX_VERSION PROTOCOL_V2
+
+#define PROTOCOL_HELLO_ACTION 0x70
+
+// helper 의 Action 에 없는 확장 action.
+// ACTION_BOOK_MANY: 여러 좌석을 모두 예약하거나 하나도 예약하지 않는다.
+//   data: v1 은 공백/쉼표로 구분한 10진 좌석 번호, v2 는 u32 배열.
+//   응답 code 는 전체 결과 (BOOK_ERROR_*), data 는 요청 순서대로 좌석별 결과
+//   (v1 은 i32, v2 는 i8). 좌석별 결과가 0 이면 그 좌석은 예약할 수 있었다는
+//   뜻이고, 실제 예약 여부는 전체 code 가 0 인지로 정해진다.
+#define ACTION_BOOK_MANY 7
+// ACTION_QUERY_RANGE: first..last 좌석을 한 번에 조회한다 (한 시점의 상태).
+//   data: v1 은 "first last" 10진 문자열, v2 는 u32 두 개.
+//   응답 data 는 SeatRecord 배열. 한 번에 QUERY_RANGE_MAX_SEATS 좌석까지
+//   조회할 수 있고, 넘으면 QUERY_ERROR_SEAT_OUT_OF_RANGE 이다.
+#define ACTION_QUERY_RANGE 8
+// ACTION_SELECT_EVENT: 이 연결이 다룰 이벤트(좌석 맵)를 고른다. 연결은 기본
+//   이벤트 (0) 로 시작하고, 이후 BOOK/CANCEL/QUERY/CONFIRM 의 좌석 번호는 고른
+//   이벤트 안의 번호다. 로그인과 상관없다.
+//   data: v1 은 10진 이벤트 id, v2 는 u32. 응답 data 는 그 이벤트의 좌석 수
+//   (v1 은 size_t, v2 는 u32).
+#define ACTION_SELECT_EVENT 9
+
+#define SELECT_EVENT_ERROR_SUCCESS 0
+#define SELECT_EVENT_ERROR_NOT_FOUND 1
+#define SELECT_EVENT_ERROR_NO_DATA 2
+
+// 좌석 조회 결과 레코드. v2 의 QUERY 와 (두 버전의) QUERY_RANGE 응답이 쓴다.
+// 서버 메모리 배치와 상관없이 고정된 13 바이트이다.
+typedef struct __attribute__((packed)) {
+  uint32_t id;
+  uint32_t times_booked;
+  uint32_t times_canceled;
+  uint8_t booked;
+} SeatRecord;
+
+#define V2_REQUEST_HEADER_SIZE 8
+#define V2_RESPONSE_HEADER_SIZE 8
+#define V2_MAX_USERNAME_LENGTH UINT8_MAX
+#define V2_MAX_DATA_SIZE UINT16_MAX
+#define V2_MAX_RESPONSE_DATA_SIZE ((1u << 24) - 1)
+
+// QUERY_RANGE 한 번에 조회할 수 있는 좌석 수. 응답이 v2 의 24비트 크기에
+// 들어가고, 스레드 arena 가 계속 들고 있을 수 있는 크기 (1MB) 를 넘지 않는다.
+#define QUERY_RANGE_MAX_SEATS 65536
+_Static_assert(QUERY_RANGE_MAX_SEATS * sizeof(SeatRecord) <= V2_MAX_RESPONSE_DATA_SIZE,
+               "QUERY_RANGE response must fit the v2 data size");
+
+#define V2_CONFIRM_AVAILABLE 0
+#define V2_CONFIRM_BOOKED 1
+#define V2_CONFIRM_INVALID 0xff
+
+// 좌석 번호로 해석할 수 없는 값. 0 번 좌석은 없으므로 서버는 범위 밖으로 답한다.
+#define V2_SEAT_INVALID 0
+
+typedef struct {
+  uint8_t action;
+  uint8_t username_length;
+  uint16_t data_size;
+  uint32_t request_id;
+} V2RequestHeader;
+
+typedef struct {
+  uint32_t request_id;
+  int32_t code;
+  uint32_t data_size;
+} V2ResponseHeader;
+
+static inline void v2_pack_request_header(uint8_t* out, const V2RequestHeader* header) {
+  out[0] = header->action;
+  out[1] = header->username_length;
+  memcpy(out + 2, &header->data_size, sizeof(uint16_t));
+  memcpy(out + 4, &header->request_id, sizeof(uint32_t));
+}
+
+static inline void v2_unpack_request_header(const uint8_t* in, V2RequestHeader* header) {
+  header->action = in[0];
+  header->username_length = in[1];
+  memcpy(&header->data_size, in + 2, sizeof(uint16_t));
+  memcpy(&header->request_id, in + 4, sizeof(uint32_t));
+}
+
+static inline void v2_pack_response_header(uint8_t* out, const V2ResponseHeader* header) {
+  uint32_t code_and_size = ((uint32_t)(uint8_t)(int8_t)header->code << 24) |
+                           (header->data_size & V2_MAX_RESPONSE_DATA_SIZE);
+  memcpy(out, &header->request_id, sizeof(uint32_t));
+  memcpy(out + 4, &code_and_size, sizeof(uint32_t));
+}
+
+static inline void v2_unpack_response_header(const uint8_t* in, V2ResponseHeader* header) {
+  uint32_t code_and_size;
+  memcpy(&header->request_id, in, sizeof(uint32_t));
+  memcpy(&code_and_size, in + 4, sizeof(uint32_t));
+  header->code = (int8_t)(code_and_size >> 24);
+  header->data_size = code_and_size & V2_MAX_RESPONSE_DATA_SIZE;
+}
+
+#endif
@@ -0,0 +1,382 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <helper.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "event_table.h"
+#include "handle_request.h"
+#include "snapshot.h"
+#include "user_table.h"
+#include "wal.h"
+
+// 좌석은 이만큼씩 writer 가 없는 시점에 복사한다 (writer 를 막더라도 잠깐만)
+#define SNAPSHOT_CHUNK_SEATS 65536
+#define SNAPSHOT_PAGE_SIZE 4096
+
+static struct {
+  const char* path;
+  uint32_t interval_sec;
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t wake;
+  bool stopping;
+  bool running;
+  uint64_t last_lsn;  // 마지막 스냅샷의 로그 위치
+} snapshotter = {
+  .mutex = PTHREAD_MUTEX_INITIALIZER,
+  .wake = PTHREAD_COND_INITIALIZER,
+};
+
+static uint64_t align_up(uint64_t value, uint64_t align) {
+  return (value + align - 1) & ~(align - 1);
+}
+
+static bool pwrite_all(int32_t fd, const void* buf, size_t count, uint64_t offset) {
+  const uint8_t* p = buf;
+  while (count > 0) {
+    ssize_t n_written = pwrite(fd, p, count, offset);
+    if (n_written < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    p += n_written;
+    count -= n_written;
+    offset += n_written;
+  }
+  return true;
+}
+
+// 유저 구간을 offset 부터 쓰고 끝 위치를 돌려준다. 실패하면 0.
+static uint64_t write_users(int32_t fd, uint64_t offset, SnapshotHeader* header) {
+  uint32_t count = user_table_count();
+  uint8_t record[2 * sizeof(uint32_t) + HASHED_PASSWORD_SIZE];
+  header->users_offset = offset;
+  header->next_user_id = count;
+  header->n_users = 0;
+
+  for (uint32_t id = 0; id < count; id++) {
+    // id 는 받았지만 아직 공개되지 않은 유저는 등록 레코드가 스냅샷 위치 뒤에 있다
+    UserEntry* user = user_table_get(id);
+    if (user == NULL) continue;
+    uint32_t username_length = user->username_length;
+    memcpy(record, &user->id, sizeof(uint32_t));
+    memcpy(record + sizeof(uint32_t), &username_length, sizeof(uint32_t));
+    memcpy(record + 2 * sizeof(uint32_t), user->hashed_password, HASHED_PASSWORD_SIZE);
+    if (!pwrite_all(fd, record, sizeof(record), offset) ||
+        !pwrite_all(fd, user->username, username_length, offset + sizeof(record))) {
+      return 0;
+    }
+    offset += sizeof(record) + username_length;
+    header->n_users++;
+  }
+  header->users_size = offset - header->users_offset;
+  return offset;
+}
+
+// 이벤트 하나의 좌석 배열을 구간씩 복사해서 쓰고, 복사한 owner 워드에서 예약된
+// 좌석을 뽑아 *bookings_end 에 이어 쓴다.
+static bool write_event_seats(int32_t fd, Event* event, SnapshotEvent* entry,
+                              uint64_t* owner, SeatCounters* counters,
+                              SnapshotBooking* bookings, uint64_t* bookings_end) {
+  entry->bookings_offset = *bookings_end;
+  entry->n_bookings = 0;
+  for (uint32_t first = 0; first < event->n_seats; first += SNAPSHOT_CHUNK_SEATS) {
+    uint32_t count = event->n_seats - first < SNAPSHOT_CHUNK_SEATS
+                         ? event->n_seats - first
+                         : SNAPSHOT_CHUNK_SEATS;
+    seats_checkpoint(event, first, count, owner, counters);
+    uint32_t n_bookings = 0;
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t user = (uint32_t)owner[i];  // 유저 id + 1
+      if (user == 0) continue;
+      bookings[n_bookings++] = (SnapshotBooking){.seat_id = first + i + 1, .user_id = user - 1};
+    }
+    if (!pwrite_all(fd, owner, count * sizeof(uint64_t),
+                    entry->owner_offset + (uint64_t)first * sizeof(uint64_t)) ||
+        !pwrite_all(fd, counters, count * sizeof(SeatCounters),
+                    entry->counters_offset + (uint64_t)first * sizeof(SeatCounters)) ||
+        !pwrite_all(fd, bookings, n_bookings * sizeof(SnapshotBooking), *bookings_end)) {
+      return false;
+    }
+    *bookings_end += n_bookings * sizeof(SnapshotBooking);
+    entry->n_bookings += n_bookings;
+  }
+  return true;
+}
+
+static bool fsync_parent_dir(const char* path) {
+  char* copy = strdup(path);
+  if (copy == NULL) return false;
+  int32_t dir_fd = open(dirname(copy), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  free(copy);
+  if (dir_fd < 0) return false;
+  bool ok = fsync(dir_fd) == 0;
+  close(dir_fd);
+  return ok;
+}
+
+static bool write_snapshot_file(int32_t fd, SnapshotHeader* header) {
+  // 1. 이 위치보다 앞의 레코드는 모두 좌석/유저에 반영되어 있다
+  header->wal_lsn = wal_appended_lsn();
+
+  // 2. 이벤트 목록과 유저
+  Event* events[EVENT_MAX_EVENTS];
+  uint32_t n_events = 0;
+  for (uint32_t id = 0; id < EVENT_MAX_EVENTS; id++) {
+    Event* event = event_table_get(id);
+    if (event != NULL) events[n_events++] = event;
+  }
+  header->n_events = n_events;
+
+  SnapshotEvent* entries = calloc(n_events ? n_events : 1, sizeof(SnapshotEvent));
+  uint64_t* owner = malloc(sizeof(uint64_t) * SNAPSHOT_CHUNK_SEATS);
+  SeatCounters* counters = malloc(sizeof(SeatCounters) * SNAPSHOT_CHUNK_SEATS);
+  SnapshotBooking* bookings = malloc(sizeof(SnapshotBooking) * SNAPSHOT_CHUNK_SEATS);
+  bool ok = entries != NULL && owner != NULL && counters != NULL && bookings != NULL;
+
+  uint64_t offset = sizeof(SnapshotHeader) + n_events * sizeof(SnapshotEvent);
+  if (ok) {
+    offset = write_users(fd, offset, header);
+    ok = offset != 0;
+  }
+
+  // 3. 좌석 배열은 페이지 경계에 맞춰 둔다 (복구할 때 매핑을 그대로 쓴다).
+  // 크기를 아는 좌석 배열의 자리를 먼저 정하고, 예약 목록은 그 뒤에 이어 쓴다.
+  for (uint32_t i = 0; ok && i < n_events; i++) {
+    entries[i].id = events[i]->id;
+    entries[i].n_seats = events[i]->n_seats;
+    entries[i].owner_offset = align_up(offset, SNAPSHOT_PAGE_SIZE);
+    entries[i].counters_offset = align_up(
+        entries[i].owner_offset + (uint64_t)events[i]->n_seats * sizeof(uint64_t),
+        SNAPSHOT_PAGE_SIZE);
+    offset = entries[i].counters_offset + (uint64_t)events[i]->n_seats * sizeof(SeatCounters);
+  }
+  for (uint32_t i = 0; ok && i < n_events; i++) {
+    ok = write_event_seats(fd, events[i], &entries[i], owner, counters, bookings, &offset);
+  }
+
+  header->file_size = offset;
+  ok = ok && ftruncate(fd, offset) == 0 &&
+       pwrite_all(fd, entries, n_events * sizeof(SnapshotEvent), sizeof(SnapshotHeader)) &&
+       pwrite_all(fd, header, sizeof(SnapshotHeader), 0);
+  free(entries);
+  free(owner);
+  free(counters);
+  free(bookings);
+  return ok;
+}
+
+bool snapshot_write(const char* path) {
+  char tmp_path[4096];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+  int32_t fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    perror("snapshot open");
+    return false;
+  }
+
+  struct timespec started;
+  clock_gettime(CLOCK_MONOTONIC, &started);
+  SnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.format_version = SNAPSHOT_FORMAT_VERSION;
+
+  bool ok = write_snapshot_file(fd, &header);
+  // 복사하는 사이 바뀐 좌석의 레코드도 디스크에 있어야 스냅샷을 공개할 수 있다
+  if (ok) wal_wait_durable(wal_appended_lsn());
+  ok = ok && fsync(fd) == 0;
+  close(fd);
+  if (!ok || rename(tmp_path, path) < 0 || !fsync_parent_dir(path)) {
+    perror("snapshot write");
+    unlink(tmp_path);
+    return false;
+  }
+
+  struct timespec finished;
+  clock_gettime(CLOCK_MONOTONIC, &finished);
+  fprintf(stderr, "snapshot: %u users, %u events at wal %llu in %ld ms\n",
+          header.n_users, header.n_events, (unsigned long long)header.wal_lsn,
+          (finished.tv_sec - started.tv_sec) * 1000 +
+              (finished.tv_nsec - started.tv_nsec) / 1000000);
+
+  snapshotter.last_lsn = header.wal_lsn;
+  wal_discard_before(header.wal_lsn);
+  return true;
+}
+
+static bool load_users(const uint8_t* base, const SnapshotHeader* header) {
+  const uint8_t* p = base + header->users_offset;
+  const uint8_t* end = p + header->users_size;
+  for (uint32_t i = 0; i < header->n_users; i++) {
+    uint32_t id, username_length;
+    char hashed_password[HASHED_PASSWORD_SIZE];
+    if (end - p < (ptrdiff_t)(2 * sizeof(uint32_t) + HASHED_PASSWORD_SIZE)) return false;
+    memcpy(&id, p, sizeof(uint32_t));
+    memcpy(&username_length, p + sizeof(uint32_t), sizeof(uint32_t));
+    memcpy(hashed_password, p + 2 * sizeof(uint32_t), HASHED_PASSWORD_SIZE);
+    hashed_password[HASHED_PASSWORD_SIZE - 1] = '\0';
+    p += 2 * sizeof(uint32_t) + HASHED_PASSWORD_SIZE;
+    if (end - p < (ptrdiff_t)username_length) return false;
+
+    char* username = strndup((const char*)p, username_length);
+    if (username == NULL || user_table_restore(id, username, hashed_password) == NULL) {
+      free(username);
+      return false;
+    }
+    free(username);
+    p += username_length;
+  }
+  return true;
+}
+
+// 좌석 배열을 이벤트에 올린다. 좌석 수가 같으면 매핑을 그대로 쓰고, --event 설정이
+// 바뀌었으면 겹치는 좌석만 복사한다. 예약 목록으로 가용 비트맵과 유저 예약 목록을
+// 채운다. 매핑을 쓴 이벤트가 있으면 true.
+static bool load_event(uint8_t* base, const SnapshotEvent* entry) {
+  Event* event = event_table_get(entry->id);
+  if (event == NULL) {
+    fprintf(stderr, "snapshot: event %u is not configured, skipping its %u seats\n",
+            entry->id, entry->n_seats);
+    return false;
+  }
+
+  _Atomic uint64_t* owner = (_Atomic uint64_t*)(base + entry->owner_offset);
+  SeatCounters* counters = (SeatCounters*)(base + entry->counters_offset);
+  bool mapped = event_table_attach(entry->id, entry->n_seats, owner, counters);
+  if (!mapped) {
+    uint32_t n_seats = entry->n_seats < event->n_seats ? entry->n_seats : event->n_seats;
+    fprintf(stderr, "snapshot: event %u has %u seats (was %u), copying %u\n", entry->id,
+            event->n_seats, entry->n_seats, n_seats);
+    memcpy((void*)event->owner, (const void*)owner, n_seats * sizeof(uint64_t));
+    memcpy(event->counters, counters, n_seats * sizeof(SeatCounters));
+  }
+
+  // 줄어든 이벤트의 범위 밖 좌석은 seats_restore_booking 이 거른다
+  const SnapshotBooking* bookings = (const SnapshotBooking*)(base + entry->bookings_offset);
+  for (uint64_t i = 0; i < entry->n_bookings; i++) {
+    seats_restore_booking(event, bookings[i].seat_id, bookings[i].user_id);
+  }
+  return mapped;
+}
+
+bool snapshot_load(const char* path, uint64_t* wal_lsn) {
+  *wal_lsn = 0;
+  int32_t fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return errno == ENOENT;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+    close(fd);
+    fprintf(stderr, "snapshot: %s is too short\n", path);
+    return false;
+  }
+  // 쓰기는 이 프로세스의 사본에만 간다 (MAP_PRIVATE)
+  uint8_t* base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    perror("snapshot mmap");
+    return false;
+  }
+
+  SnapshotHeader header;
+  memcpy(&header, base, sizeof(header));
+  if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+      header.format_version != SNAPSHOT_FORMAT_VERSION ||
+      header.file_size != (uint64_t)st.st_size ||
+      header.users_offset + header.users_size > header.file_size ||
+      sizeof(SnapshotHeader) + (uint64_t)header.n_events * sizeof(SnapshotEvent) >
+          header.users_offset) {
+    fprintf(stderr, "snapshot: %s is not a valid version %d snapshot\n", path,
+            SNAPSHOT_FORMAT_VERSION);
+    munmap(base, st.st_size);
+    return false;
+  }
+
+  const SnapshotEvent* entries = (const SnapshotEvent*)(base + sizeof(SnapshotHeader));
+  for (uint32_t i = 0; i < header.n_events; i++) {
+    if (entries[i].counters_offset + (uint64_t)entries[i].n_seats * sizeof(SeatCounters) >
+            header.file_size ||
+        entries[i].n_bookings > entries[i].n_seats ||
+        entries[i].bookings_offset % sizeof(uint32_t) != 0 ||
+        entries[i].bookings_offset + entries[i].n_bookings * sizeof(SnapshotBooking) >
+            header.file_size) {
+      fprintf(stderr, "snapshot: event %u is out of bounds\n", entries[i].id);
+      munmap(base, st.st_size);
+      return false;
+    }
+  }
+  if (!load_users(base, &header)) {
+    fprintf(stderr, "snapshot: cannot restore users\n");
+    munmap(base, st.st_size);
+    return false;
+  }
+
+  bool mapped = false;
+  for (uint32_t i = 0; i < header.n_events; i++) {
+    mapped |= load_event(base, &entries[i]);
+  }
+  // 매핑을 쓰는 이벤트가 있으면 프로세스가 끝날 때까지 둔다
+  if (!mapped) munmap(base, st.st_size);
+
+  fprintf(stderr, "snapshot: loaded %u users, %u events from %s (wal %llu)\n",
+          header.n_users, header.n_events, path, (unsigned long long)header.wal_lsn);
+  *wal_lsn = header.wal_lsn;
+  snapshotter.last_lsn = header.wal_lsn;
+  return true;
+}
+
+static void* snapshot_thread_func(void* arg) {
+  pthread_mutex_lock(&snapshotter.mutex);
+  while (!snapshotter.stopping) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += snapshotter.interval_sec;
+    while (!snapshotter.stopping &&
+           pthread_cond_timedwait(&snapshotter.wake, &snapshotter.mutex, &deadline) != ETIMEDOUT) {
+    }
+    if (snapshotter.stopping) break;
+
+    // 지난 스냅샷 뒤로 로그가 늘지 않았으면 쓰지 않는다
+    pthread_mutex_unlock(&snapshotter.mutex);
+    if (wal_appended_lsn() != snapshotter.last_lsn) snapshot_write(snapshotter.path);
+    pthread_mutex_lock(&snapshotter.mutex);
+  }
+  pthread_mutex_unlock(&snapshotter.mutex);
+  return NULL;
+}
+
+bool snapshot_start(const char* path, uint32_t interval_sec) {
+  snapshotter.path = path;
+  snapshotter.interval_sec = interval_sec;
+  if (interval_sec == 0) return true;  // 종료할 때만 쓴다
+  if (pthread_create(&snapshotter.thread, NULL, snapshot_thread_func, NULL) != 0) {
+    perror("pthread_create (snapshot)");
+    return false;
+  }
+  snapshotter.running = true;
+  return true;
+}
+
+void snapshot_stop(void) {
+  if (snapshotter.path == NULL) return;
+  if (snapshotter.running) {
+    pthread_mutex_lock(&snapshotter.mutex);
+    snapshotter.stopping = true;
+    pthread_cond_signal(&snapshotter.wake);
+    pthread_mutex_unlock(&snapshotter.mutex);
+    pthread_join(snapshotter.thread, NULL);
+    snapshotter.running = false;
+  }
+  // 다음 시작이 로그를 재생하지 않아도 되게 마지막 상태를 남긴다
+  if (wal_appended_lsn() != snapshotter.last_lsn) snapshot_write(snapshotter.path);
+}
@@ -0,0 +1,75 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// 유저 테이블과 좌석 맵의 바이너리 스냅샷 (체크포인트).
+//
+// 스냅샷은 만들기 시작할 때의 WAL 위치를 함께 적는다. 재시작할 때는 스냅샷을
+// mmap 하고 그 위치 뒤의 로그만 재생하므로, 복구 시간이 로그 길이와 상관없다.
+// 스냅샷이 공개되면 그 앞의 로그 블록은 돌려준다 (wal_discard_before).
+//
+// 워커를 멈추지 않는다. 좌석은 이벤트마다 구간 단위로 writer 가 없는 시점에
+// 복사하므로 (seats_checkpoint) 스냅샷 전체가 한 시점은 아니다. 대신 좌석 버전이
+// 들어 있어 재생할 때 이미 들어 있는 레코드를 거른다 (seats_restore_record).
+// 복사한 내용을 덮는 로그가 fsync 된 뒤에 임시 파일을 rename 으로 바꿔 넣는다.
+//
+// 복사한 owner 워드에서 예약된 좌석 목록도 뽑아 적는다. 복구할 때 가용 비트맵과
+// 유저 예약 목록은 이 목록으로 채우므로 owner 배열은 로그가 건드린 좌석의
+// 페이지만 읽힌다.
+//
+// 파일 형식 (버전 SNAPSHOT_FORMAT_VERSION, 호스트 바이트 순서):
+//   SnapshotHeader
+//   SnapshotEvent * n_events
+//   유저 * n_users: id(u32) username_length(u32) hashed_password[HASHED_PASSWORD_SIZE] username
+//   (페이지 정렬) 이벤트마다 owner 워드 배열 (u64 * n_seats), SeatCounters 배열
+//   이벤트마다 SnapshotBooking * n_bookings (좌석 번호 오름차순)
+// 좌석 배열은 메모리 배치와 같으므로 복구할 때 MAP_PRIVATE 매핑을 그대로 쓴다.
+
+#define SNAPSHOT_MAGIC "PA3SNAP"
+#define SNAPSHOT_FORMAT_VERSION 2
+
+typedef struct {
+  char magic[8];
+  uint32_t format_version;
+  uint32_t n_events;
+  uint64_t wal_lsn;  // 이 위치부터 재생한다
+  uint64_t file_size;
+  uint32_t next_user_id;
+  uint32_t n_users;
+  uint64_t users_offset;
+  uint64_t users_size;
+  uint64_t reserved;
+} SnapshotHeader;
+
+typedef struct {
+  uint32_t id;
+  uint32_t n_seats;
+  uint64_t owner_offset;
+  uint64_t counters_offset;
+  uint64_t bookings_offset;
+  uint64_t n_bookings;
+} SnapshotEvent;
+
+typedef struct {
+  uint32_t seat_id;
+  uint32_t user_id;
+} SnapshotBooking;
+
+// path 의 스냅샷을 mmap 해서 유저 테이블과 이벤트 좌석 맵에 올린다.
+// *wal_lsn 에 재생을 시작할 로그 위치를 적는다 (스냅샷이 없으면 0).
+// 파일이 있는데 읽을 수 없으면 false (로그 앞부분이 이미 비워졌을 수 있으므로
+// 처음부터 재생하지 않는다). 워커를 띄우기 전, seats_restore_begin 뒤 WAL 재생
+// 전에 부른다.
+bool snapshot_load(const char* path, uint64_t* wal_lsn);
+
+// 지금 상태를 path 에 쓴다. 실패하면 이전 스냅샷을 그대로 둔다.
+bool snapshot_write(const char* path);
+
+// interval_sec 마다 (로그가 늘었으면) 스냅샷을 쓰는 스레드.
+bool snapshot_start(const char* path, uint32_t interval_sec);
+// 스레드를 끝내고 마지막 스냅샷을 쓴다. 워커가 모두 끝난 뒤, wal_stop 전에 부른다.
+void snapshot_stop(void);
+
+#endif
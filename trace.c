@@ -0,0 +1,136 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "latency.h"
+#include "trace.h"
+
+// 워커당 레코드 수 (2의 거듭제곱)
+#define TRACE_RING_RECORDS 8192
+
+// 워커 하나의 링 버퍼. 워커만 쓰고 trace_dump 는 락 없이 읽는다.
+// 워커는 칸을 쓰기 전에 reserved 를, 다 쓴 뒤에 committed 를 올린다.
+// 읽는 쪽은 committed 까지 복사한 뒤 reserved 를 다시 보고, 복사하는 사이
+// 덮어쓰였을 수 있는 오래된 칸을 버린다 (seqlock 과 같은 방식).
+typedef struct {
+  _Alignas(64) _Atomic uint64_t reserved;
+  _Atomic uint64_t committed;
+  uint64_t seen;  // 표본을 고르려고 센 요청 수 (워커만 쓴다)
+  TraceRecord records[TRACE_RING_RECORDS];
+} TraceRing;
+
+static struct {
+  bool enabled;
+  uint32_t every;
+  const char* path;
+  size_t n_workers;
+  TraceRing* rings;
+  pthread_mutex_t dump_mutex;  // 관리 스레드와 종료 경로가 동시에 쓰지 않게
+} tracer = {.dump_mutex = PTHREAD_MUTEX_INITIALIZER};
+
+static _Thread_local TraceRecord* current;
+
+bool trace_init(size_t n_workers, uint32_t every, const char* path) {
+  tracer.rings = aligned_alloc(64, sizeof(TraceRing) * n_workers);
+  if (tracer.rings == NULL) return false;
+  memset(tracer.rings, 0, sizeof(TraceRing) * n_workers);
+  tracer.n_workers = n_workers;
+  tracer.every = every > 0 ? every : 1;
+  tracer.path = path;
+  tracer.enabled = true;
+  return true;
+}
+
+uint64_t trace_now(void) {
+  return tracer.enabled ? now_ns() : 0;
+}
+
+bool trace_sample(size_t worker) {
+  if (!tracer.enabled) return false;
+  return tracer.rings[worker].seen++ % tracer.every == 0;
+}
+
+void trace_commit(size_t worker, const TraceRecord* record) {
+  TraceRing* ring = &tracer.rings[worker];
+  uint64_t index = atomic_load_explicit(&ring->committed, memory_order_relaxed);
+  atomic_store_explicit(&ring->reserved, index + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  ring->records[index & (TRACE_RING_RECORDS - 1)] = *record;
+  ring->records[index & (TRACE_RING_RECORDS - 1)].worker = (uint32_t)worker;
+  atomic_store_explicit(&ring->committed, index + 1, memory_order_release);
+}
+
+void trace_set_current(TraceRecord* record) {
+  current = record;
+}
+
+uint64_t trace_stage_begin(void) {
+  return current != NULL ? trace_now() : 0;
+}
+
+void trace_stage_end(TraceStage stage, uint64_t begin) {
+  if (begin == 0 || current == NULL) return;
+  uint64_t sum = (uint64_t)current->stage_ns[stage] + trace_span(begin, trace_now());
+  current->stage_ns[stage] = sum > UINT32_MAX ? UINT32_MAX : (uint32_t)sum;
+}
+
+// ring 에서 덮어쓰이지 않은 레코드를 out 에 복사하고 개수를 돌려준다
+static size_t copy_ring(TraceRing* ring, TraceRecord* out) {
+  uint64_t end = atomic_load_explicit(&ring->committed, memory_order_acquire);
+  uint64_t begin = end > TRACE_RING_RECORDS ? end - TRACE_RING_RECORDS : 0;
+  for (uint64_t i = begin; i < end; i++) {
+    out[i - begin] = ring->records[i & (TRACE_RING_RECORDS - 1)];
+  }
+  atomic_thread_fence(memory_order_acquire);
+  uint64_t reserved = atomic_load_explicit(&ring->reserved, memory_order_relaxed);
+  uint64_t stable = reserved > TRACE_RING_RECORDS ? reserved - TRACE_RING_RECORDS : 0;
+  if (stable <= begin) return end - begin;
+  if (stable >= end) return 0;
+  memmove(out, out + (stable - begin), sizeof(TraceRecord) * (end - stable));
+  return end - stable;
+}
+
+int64_t trace_dump(void) {
+  if (!tracer.enabled) return -1;
+  TraceRecord* records = malloc(sizeof(TraceRecord) * TRACE_RING_RECORDS * tracer.n_workers);
+  if (records == NULL) return -1;
+
+  pthread_mutex_lock(&tracer.dump_mutex);
+  size_t n_records = 0;
+  for (size_t w = 0; w < tracer.n_workers; w++) {
+    n_records += copy_ring(&tracer.rings[w], records + n_records);
+  }
+
+  TraceFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TRACE_FILE_MAGIC, sizeof(header.magic));
+  header.version = TRACE_FILE_VERSION;
+  header.record_size = sizeof(TraceRecord);
+  header.n_stages = TRACE_N_STAGES;
+  header.n_workers = (uint32_t)tracer.n_workers;
+  header.n_records = n_records;
+
+  // 읽는 도중의 파일을 보지 않도록 임시 파일에 쓰고 바꿔치기한다
+  char tmp_path[4096];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", tracer.path);
+  FILE* file = fopen(tmp_path, "wb");
+  bool ok = file != NULL && fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(records, sizeof(TraceRecord), n_records, file) == n_records;
+  if (file != NULL && fclose(file) != 0) ok = false;
+  if (ok && rename(tmp_path, tracer.path) != 0) ok = false;
+  if (!ok) {
+    perror("trace dump");
+    unlink(tmp_path);
+  }
+  pthread_mutex_unlock(&tracer.dump_mutex);
+
+  free(records);
+  return ok ? (int64_t)n_records : -1;
+}
+
+const char* trace_path(void) {
+  return tracer.path;
+}
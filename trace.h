@@ -0,0 +1,79 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 요청 단계별 추적 (--trace=N).
+//
+// 워커마다 N 개 요청 중 하나를 골라, 그 요청이 어느 단계에서 시간을 썼는지
+// TraceRecord 하나로 남긴다. 레코드는 워커별 링 버퍼에 쌓이고 (writer 는 그
+// 워커 하나뿐이라 락이 없다) 오래된 것부터 덮어쓴다. 관리 소켓의 "trace" 명령이나
+// 서버 종료 시 링 버퍼 내용을 --trace-file 에 이진 파일로 내보내고,
+// pa3_trace 로 가장 느린 요청들을 요약해서 본다.
+//
+// 각 단계의 시간은 ns 이고, 한 레코드 안에서 겹치지 않는다 (LOCK, HASH 는
+// HANDLE 안에 들어 있는 부분이다).
+
+typedef enum {
+  TRACE_STAGE_POLL,    // poll 이 돌아온 뒤 이 연결을 읽기 시작할 때까지
+  TRACE_STAGE_READ,    // 프레임을 마저 채운 read()
+  TRACE_STAGE_QUEUE,   // read 뒤에 앞선 프레임 (파이프라이닝, 로그인 대기) 을 기다린 시간
+  TRACE_STAGE_HANDLE,  // 요청 처리 전체 (LOCK, HASH 포함)
+  TRACE_STAGE_LOCK,    // 유저 예약 목록 mutex, 좌석 seqlock writer 대기
+  TRACE_STAGE_HASH,    // 비밀번호 해시. 해시 풀이면 큐에서 기다린 시간까지
+  TRACE_STAGE_WAL,     // 동기 WAL: fsync 를 기다리며 응답을 붙잡아 둔 시간
+  TRACE_STAGE_WRITE,   // 응답을 쌓은 뒤 소켓으로 다 보낼 때까지 (WAL 제외)
+  TRACE_N_STAGES,
+} TraceStage;
+
+// 파일에도 이 배치 그대로 쓴다 (호스트 바이트 순서)
+typedef struct {
+  uint64_t started_ns;  // 이 요청을 읽게 된 poll 이 돌아온 시각 (CLOCK_MONOTONIC)
+  uint32_t total_ns;    // started_ns 부터 응답을 다 보낼 때까지
+  uint32_t stage_ns[TRACE_N_STAGES];
+  int32_t action;
+  int32_t code;
+  uint32_t worker;
+} TraceRecord;
+
+#define TRACE_FILE_MAGIC "PA3TRACE"
+#define TRACE_FILE_VERSION 1
+
+// 파일 헤더 뒤에 n_records 개의 TraceRecord 가 이어진다 (워커 순서, 워커 안에서는 시간 순서)
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;  // sizeof(TraceRecord)
+  uint32_t n_stages;     // TRACE_N_STAGES
+  uint32_t n_workers;
+  uint64_t n_records;
+} TraceFileHeader;
+
+// from 부터 to 까지의 ns. 레코드 칸에 맞게 자르고, 시각이 없으면 (0) 0 이다.
+static inline uint32_t trace_span(uint64_t from, uint64_t to) {
+  if (from == 0 || to <= from) return 0;
+  return to - from > UINT32_MAX ? UINT32_MAX : (uint32_t)(to - from);
+}
+
+// 워커마다 링 버퍼를 만들고 every 개 중 하나를 추적한다. 부르지 않으면 꺼져 있다.
+bool trace_init(size_t n_workers, uint32_t every, const char* path);
+// 꺼져 있으면 0
+uint64_t trace_now(void);
+// worker 의 다음 요청을 추적할 차례인지. worker 스레드에서만 부른다.
+bool trace_sample(size_t worker);
+// 끝난 레코드를 worker 의 링 버퍼에 넣는다. worker 스레드에서만 부른다.
+void trace_commit(size_t worker, const TraceRecord* record);
+
+// 이 스레드가 처리 중인 요청의 레코드. handle_request 안의 단계가 여기에 더해진다.
+void trace_set_current(TraceRecord* record);
+// 추적 중이 아니면 0 을 돌려주고 trace_stage_end 도 아무것도 하지 않는다
+uint64_t trace_stage_begin(void);
+void trace_stage_end(TraceStage stage, uint64_t begin);
+
+// 링 버퍼 내용을 파일로 쓴다. 쓴 레코드 수, 실패하면 -1.
+int64_t trace_dump(void);
+const char* trace_path(void);
+
+#endif
@@ -0,0 +1,253 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lockprof.h"
+#include "user_table.h"
+
+// 샤드 수와 샤드당 처음 버킷 수 (둘 다 2의 거듭제곱)
+#define USER_SHARDS 64
+#define USER_BUCKETS_INITIAL 64
+// id -> 유저 배열은 청크 단위로 늘린다 (이미 나간 포인터가 옮겨지지 않도록)
+#define USER_CHUNK_SIZE 1024
+#define USER_MAX_CHUNKS 65536
+
+// 버킷 체인의 노드. 한 번 공개되면 바뀌지 않는다.
+typedef struct BucketNode {
+  UserEntry* user;
+  struct BucketNode* next;
+} BucketNode;
+
+typedef struct {
+  size_t n_buckets;
+  _Atomic(BucketNode*)* buckets;
+} BucketArray;
+
+// 쓰기(등록)만 샤드 mutex 를 잡는다. 읽기는 table 을 acquire 로 읽고
+// 체인을 따라가기만 하므로 등록 중에도 막히지 않는다.
+typedef struct {
+  _Alignas(64) pthread_mutex_t mutex;
+  _Atomic(BucketArray*) table;
+  size_t count;
+} Shard;
+
+static Shard shards[USER_SHARDS];
+static _Atomic(_Atomic(UserEntry*)*) id_chunks[USER_MAX_CHUNKS];
+static _Atomic uint32_t next_id = 0;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+static uint64_t hash_username(const char* username) {
+  // FNV-1a
+  uint64_t hash = 1469598103934665603ULL;
+  for (const unsigned char* p = (const unsigned char*)username; *p; p++) {
+    hash ^= *p;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static Shard* shard_of(uint64_t hash) {
+  return &shards[hash >> 58];  // 상위 6비트 = 64 샤드
+}
+
+static BucketArray* bucket_array_create(size_t n_buckets) {
+  BucketArray* array = malloc(sizeof(BucketArray));
+  if (array == NULL) return NULL;
+  array->buckets = calloc(n_buckets, sizeof(_Atomic(BucketNode*)));
+  if (array->buckets == NULL) {
+    free(array);
+    return NULL;
+  }
+  array->n_buckets = n_buckets;
+  return array;
+}
+
+// 아직 공개하지 않은 배열과 그 노드들을 해제한다 (유저는 그대로 둔다)
+static void bucket_array_free(BucketArray* array) {
+  for (size_t i = 0; i < array->n_buckets; i++) {
+    BucketNode* node = atomic_load_explicit(&array->buckets[i], memory_order_relaxed);
+    while (node != NULL) {
+      BucketNode* next = node->next;
+      free(node);
+      node = next;
+    }
+  }
+  free(array->buckets);
+  free(array);
+}
+
+static void init_shards(void) {
+  for (size_t i = 0; i < USER_SHARDS; i++) {
+    pthread_mutex_init(&shards[i].mutex, NULL);
+    atomic_init(&shards[i].table, bucket_array_create(USER_BUCKETS_INITIAL));
+    shards[i].count = 0;
+  }
+}
+
+void user_table_init(void) {
+  pthread_once(&init_once, init_shards);
+}
+
+static UserEntry* find_in(BucketArray* table, uint64_t hash, const char* username) {
+  BucketNode* node = atomic_load_explicit(&table->buckets[hash & (table->n_buckets - 1)],
+                                          memory_order_acquire);
+  for (; node != NULL; node = node->next) {
+    if (node->user->hash == hash && strcmp(node->user->username, username) == 0) {
+      return node->user;
+    }
+  }
+  return NULL;
+}
+
+UserEntry* user_table_find(const char* username) {
+  if (username == NULL) return NULL;
+  uint64_t hash = hash_username(username);
+  BucketArray* table = atomic_load_explicit(&shard_of(hash)->table, memory_order_acquire);
+  return find_in(table, hash, username);
+}
+
+UserEntry* user_table_get(uint32_t id) {
+  if (id >= atomic_load_explicit(&next_id, memory_order_acquire)) return NULL;
+  _Atomic(UserEntry*)* chunk =
+      atomic_load_explicit(&id_chunks[id / USER_CHUNK_SIZE], memory_order_acquire);
+  if (chunk == NULL) return NULL;
+  return atomic_load_explicit(&chunk[id % USER_CHUNK_SIZE], memory_order_acquire);
+}
+
+uint32_t user_table_count(void) {
+  return atomic_load(&next_id);
+}
+
+// 미리 만든 노드를 버킷 체인 맨 앞에 붙인다. 샤드 mutex 를 잡은 상태에서 호출.
+static void bucket_link(BucketArray* table, BucketNode* node, UserEntry* user) {
+  _Atomic(BucketNode*)* head = &table->buckets[user->hash & (table->n_buckets - 1)];
+  node->user = user;
+  node->next = atomic_load_explicit(head, memory_order_relaxed);
+  atomic_store_explicit(head, node, memory_order_release);
+}
+
+static bool bucket_push(BucketArray* table, UserEntry* user) {
+  BucketNode* node = malloc(sizeof(BucketNode));
+  if (node == NULL) return false;
+  bucket_link(table, node, user);
+  return true;
+}
+
+// 버킷 수를 두 배로 늘린 새 배열을 만들어 공개한다. 샤드 mutex 를 잡은 상태에서 호출.
+// 옛 배열과 노드는 읽는 중인 스레드가 있을 수 있으므로 해제하지 않는다
+// (유저는 지워지지 않으니 전체 크기는 현재 크기의 두 배를 넘지 않는다).
+static void shard_grow(Shard* shard) {
+  BucketArray* old = atomic_load_explicit(&shard->table, memory_order_relaxed);
+  BucketArray* grown = bucket_array_create(old->n_buckets * 2);
+  if (grown == NULL) return;
+
+  for (size_t i = 0; i < old->n_buckets; i++) {
+    BucketNode* node = atomic_load_explicit(&old->buckets[i], memory_order_relaxed);
+    for (; node != NULL; node = node->next) {
+      if (!bucket_push(grown, node->user)) {
+        // 늘리지 못해도 옛 배열은 그대로 쓸 수 있다 (체인이 길어질 뿐)
+        bucket_array_free(grown);
+        return;
+      }
+    }
+  }
+  atomic_store_explicit(&shard->table, grown, memory_order_release);
+}
+
+// id -> 유저 청크를 가져온다. 아직 없으면 만들어서 CAS 로 설치한다.
+static _Atomic(UserEntry*)* id_chunk(uint32_t chunk_index) {
+  _Atomic(UserEntry*)* chunk = atomic_load(&id_chunks[chunk_index]);
+  if (chunk != NULL) return chunk;
+
+  _Atomic(UserEntry*)* fresh = calloc(USER_CHUNK_SIZE, sizeof(_Atomic(UserEntry*)));
+  if (fresh == NULL) return NULL;
+  if (atomic_compare_exchange_strong(&id_chunks[chunk_index], &chunk, fresh)) {
+    return fresh;
+  }
+  free(fresh);  // 다른 샤드가 먼저 설치했다
+  return chunk;
+}
+
+// id 를 정해 (USER_ID_NONE 이면 새로 받아) id -> 유저 배열에 넣는다. 자리가 없으면 false.
+static bool assign_id(UserEntry* user, uint32_t id) {
+  if (id == USER_ID_NONE) id = atomic_fetch_add(&next_id, 1);
+  if (id / USER_CHUNK_SIZE >= USER_MAX_CHUNKS) return false;
+
+  _Atomic(UserEntry*)* chunk = id_chunk(id / USER_CHUNK_SIZE);
+  if (chunk == NULL) return false;
+
+  user->id = id;
+  atomic_store_explicit(&chunk[id % USER_CHUNK_SIZE], user, memory_order_release);
+  return true;
+}
+
+// 공개하지 못한 유저를 해제한다
+static void user_entry_free(UserEntry* user) {
+  pthread_mutex_destroy(&user->bookings.mutex);
+  free(user->username);
+  free(user);
+}
+
+static UserEntry* insert_user(const char* username,
+                              const char* hashed_password,
+                              uint32_t id,
+                              bool* created) {
+  *created = false;
+  if (username == NULL) return NULL;
+
+  uint64_t hash = hash_username(username);
+  Shard* shard = shard_of(hash);
+
+  LOCKPROF_LOCK(&shard->mutex, LOCK_SITE_USER_INSERT);
+  BucketArray* table = atomic_load_explicit(&shard->table, memory_order_relaxed);
+  UserEntry* user = find_in(table, hash, username);
+  if (user != NULL) {
+    LOCKPROF_UNLOCK(&shard->mutex, LOCK_SITE_USER_INSERT);
+    return user;
+  }
+
+  user = calloc(1, sizeof(UserEntry));
+  if (user == NULL || (user->username = strdup(username)) == NULL) {
+    free(user);
+    LOCKPROF_UNLOCK(&shard->mutex, LOCK_SITE_USER_INSERT);
+    return NULL;
+  }
+  user->username_length = strlen(username);
+  user->hash = hash;
+  strncpy(user->hashed_password, hashed_password, HASHED_PASSWORD_SIZE - 1);
+  atomic_init(&user->logged_in, false);
+  pthread_mutex_init(&user->bookings.mutex, NULL);
+
+  // id 배열에 먼저 넣고 나서 해시 테이블에 공개한다. 버킷 노드는 그 전에 만들어
+  // 두어, id 로 공개된 뒤에는 실패하지 않는다 (공개된 유저는 해제할 수 없다:
+  // user_table_get 으로 이미 가져간 스레드가 있을 수 있다).
+  BucketNode* node = malloc(sizeof(BucketNode));
+  if (node == NULL || !assign_id(user, id)) {
+    LOCKPROF_UNLOCK(&shard->mutex, LOCK_SITE_USER_INSERT);
+    free(node);
+    user_entry_free(user);
+    return NULL;
+  }
+  bucket_link(table, node, user);
+
+  if (++shard->count > table->n_buckets * 2) shard_grow(shard);
+  LOCKPROF_UNLOCK(&shard->mutex, LOCK_SITE_USER_INSERT);
+
+  *created = true;
+  return user;
+}
+
+UserEntry* user_table_insert(const char* username,
+                             const char* hashed_password,
+                             bool* created) {
+  return insert_user(username, hashed_password, USER_ID_NONE, created);
+}
+
+UserEntry* user_table_restore(uint32_t id,
+                              const char* username,
+                              const char* hashed_password) {
+  if (id == USER_ID_NONE) return NULL;
+  // 로그에는 id 순서가 뒤바뀌어 들어 있을 수 있다. 새 유저는 가장 큰 id 다음부터.
+  if (id >= atomic_load(&next_id)) atomic_store(&next_id, id + 1);
+  bool created;
+  return insert_user(username, hashed_password, id, &created);
+}
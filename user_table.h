@@ -0,0 +1,60 @@
+#ifndef USER_TABLE_H
+#define USER_TABLE_H
+
+#include <helper.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 동시 접근용 유저 테이블. helper 의 Users/find_user 대신 쓴다.
+// - username 으로 찾기: 샤드별 해시 테이블, 읽기는 락 없이 진행
+// - id 로 찾기: O(1) (좌석 owner 와 세션은 id 만 들고 다닌다)
+// 유저는 한 번 등록되면 지워지지 않으므로 찾은 포인터는 계속 유효하다.
+
+// 유저가 예약한 좌석을 (이벤트 id, 좌석 번호) 키의 오름차순으로 담는다.
+// 좌석 owner CAS 와 함께 mutex 안에서 바뀌므로 좌석 상태와 어긋나지 않는다.
+// 같은 유저의 요청끼리만 경합하므로 거의 항상 비어 있는 락이다.
+typedef struct {
+  pthread_mutex_t mutex;
+  uint64_t* keys;  // 상위 32비트 이벤트 id, 하위 32비트 좌석 번호
+  size_t count;
+  size_t capacity;
+} UserBookings;
+
+typedef struct UserEntry {
+  uint32_t id;
+  char* username;
+  size_t username_length;
+  uint64_t hash;
+  char hashed_password[HASHED_PASSWORD_SIZE];
+  _Atomic bool logged_in;
+  UserBookings bookings;
+} UserEntry;
+
+#define USER_ID_NONE UINT32_MAX
+
+void user_table_init(void);
+
+// 없으면 NULL. username 은 NUL 로 끝나야 한다.
+UserEntry* user_table_find(const char* username);
+
+// id 로 찾는다. 없으면 NULL.
+UserEntry* user_table_get(uint32_t id);
+
+// 새 유저를 등록한다. 같은 이름이 이미 있으면 등록하지 않고 기존 유저를
+// 돌려주며 *created 는 false. 메모리가 없으면 NULL.
+UserEntry* user_table_insert(const char* username,
+                             const char* hashed_password,
+                             bool* created);
+
+// WAL 재생용: 기록된 id 그대로 유저를 다시 등록한다. 워커를 띄우기 전에만 부른다.
+UserEntry* user_table_restore(uint32_t id,
+                              const char* username,
+                              const char* hashed_password);
+
+// 지금까지 등록된 유저 수 (id 는 0 부터 이 값 - 1 까지)
+uint32_t user_table_count(void);
+
+#endif
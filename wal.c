@@ -0,0 +1,382 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <helper.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "lockprof.h"
+#include "wal.h"
+
+#define WAL_HEADER_SIZE (2 * sizeof(uint32_t))
+#define WAL_PAYLOAD_FIXED_SIZE (4 + sizeof(uint32_t))
+// 이보다 큰 레코드는 깨진 것으로 본다
+#define WAL_MAX_RECORD_SIZE (64u * 1024 * 1024)
+#define WAL_BUFFER_INITIAL_SIZE (64 * 1024)
+#define WAL_DISCARD_ALIGN 4096
+
+// 붙이는 쪽은 buffer 에 쌓고, writer 스레드는 buffer 와 spare 를 바꿔 들고 나가서
+// 락 밖에서 write/fdatasync 한다. 그동안 들어온 레코드는 다음 묶음이 된다.
+static struct {
+  int32_t fd;
+  WalMode mode;
+  uint32_t window_us;
+  void (*on_durable)(void);
+
+  pthread_mutex_t mutex;
+  pthread_cond_t wake;
+  pthread_cond_t durable;  // durable_lsn 이 오를 때마다 broadcast
+  uint8_t* buffer;
+  size_t len;
+  size_t cap;
+  uint8_t* spare;
+  size_t spare_cap;
+  uint64_t appended_lsn;  // buffer 끝의 파일 위치
+  bool stopping;
+
+  _Atomic uint64_t durable_lsn;
+  _Atomic bool enabled;
+  pthread_t thread;
+} wal = {
+  .fd = -1,
+  .mutex = PTHREAD_MUTEX_INITIALIZER,
+  .wake = PTHREAD_COND_INITIALIZER,
+  .durable = PTHREAD_COND_INITIALIZER,
+};
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void) {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+    crc_table[i] = c;
+  }
+}
+
+static uint32_t crc32(const uint8_t* p, size_t n) {
+  uint32_t c = 0xffffffffu;
+  while (n-- > 0) c = crc_table[(c ^ *p++) & 0xff] ^ (c >> 8);
+  return c ^ 0xffffffffu;
+}
+
+static size_t record_payload_size(const WalRecord* record) {
+  if (record->type == WAL_RECORD_REGISTER) {
+    return WAL_PAYLOAD_FIXED_SIZE + sizeof(uint32_t) + strlen(record->username) +
+           HASHED_PASSWORD_SIZE;
+  }
+  return WAL_PAYLOAD_FIXED_SIZE + 2 * sizeof(uint32_t) + record->n_seats * sizeof(WalSeat);
+}
+
+static uint8_t* put_u32(uint8_t* p, uint32_t value) {
+  memcpy(p, &value, sizeof(uint32_t));
+  return p + sizeof(uint32_t);
+}
+
+static void encode_payload(uint8_t* p, const WalRecord* record) {
+  memset(p, 0, 4);
+  p[0] = (uint8_t)record->type;
+  p = put_u32(p + 4, record->user_id);
+  if (record->type == WAL_RECORD_REGISTER) {
+    uint32_t username_length = strlen(record->username);
+    p = put_u32(p, username_length);
+    memcpy(p, record->username, username_length);
+    p += username_length;
+    memset(p, 0, HASHED_PASSWORD_SIZE);
+    strncpy((char*)p, record->hashed_password, HASHED_PASSWORD_SIZE - 1);
+    return;
+  }
+  p = put_u32(p, record->event_id);
+  p = put_u32(p, record->n_seats);
+  memcpy(p, record->seats, record->n_seats * sizeof(WalSeat));
+}
+
+// payload 를 record 로 푼다. username/seats 는 호출한 쪽이 free 한다. 형식이 틀리면 false.
+static bool decode_payload(const uint8_t* p, size_t size, WalRecord* record,
+                           char* hashed_password) {
+  memset(record, 0, sizeof(WalRecord));
+  if (size < WAL_PAYLOAD_FIXED_SIZE) return false;
+  record->type = p[0];
+  memcpy(&record->user_id, p + 4, sizeof(uint32_t));
+  p += WAL_PAYLOAD_FIXED_SIZE;
+  size -= WAL_PAYLOAD_FIXED_SIZE;
+
+  uint32_t a, b;
+  if (size < sizeof(uint32_t)) return false;
+  memcpy(&a, p, sizeof(uint32_t));
+
+  if (record->type == WAL_RECORD_REGISTER) {
+    if (size != sizeof(uint32_t) + (size_t)a + HASHED_PASSWORD_SIZE) return false;
+    char* username = strndup((const char*)p + sizeof(uint32_t), a);
+    if (username == NULL) return false;
+    memcpy(hashed_password, p + sizeof(uint32_t) + a, HASHED_PASSWORD_SIZE);
+    hashed_password[HASHED_PASSWORD_SIZE - 1] = '\0';
+    record->username = username;
+    record->hashed_password = hashed_password;
+    return true;
+  }
+  if (record->type != WAL_RECORD_BOOK && record->type != WAL_RECORD_CANCEL) return false;
+  if (size < 2 * sizeof(uint32_t)) return false;
+
+  memcpy(&b, p + sizeof(uint32_t), sizeof(uint32_t));
+  if (size != 2 * sizeof(uint32_t) + (size_t)b * sizeof(WalSeat)) return false;
+  WalSeat* seats = malloc(sizeof(WalSeat) * (b ? b : 1));
+  if (seats == NULL) return false;
+  memcpy(seats, p + 2 * sizeof(uint32_t), (size_t)b * sizeof(WalSeat));
+  record->event_id = a;
+  record->n_seats = b;
+  record->seats = seats;
+  return true;
+}
+
+bool wal_replay(const char* path, uint64_t start_lsn,
+                void (*apply)(const WalRecord* record)) {
+  pthread_once(&crc_once, crc_init);
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) return errno == ENOENT && start_lsn == 0;
+
+  // 스냅샷이 덮는 앞부분은 건너뛴다 (wal_discard_before 로 비워졌을 수도 있다)
+  fseeko(file, 0, SEEK_END);
+  if (ftello(file) < (off_t)start_lsn) {
+    fprintf(stderr, "wal: %s is shorter than the snapshot position %llu\n", path,
+            (unsigned long long)start_lsn);
+    fclose(file);
+    return false;
+  }
+  fseeko(file, start_lsn, SEEK_SET);
+
+  uint8_t* payload = NULL;
+  size_t payload_cap = 0;
+  uint64_t offset = start_lsn;
+  size_t n_records = 0;
+  while (true) {
+    uint32_t header[2];
+    if (fread(header, sizeof(uint32_t), 2, file) != 2) break;
+    uint32_t size = header[0];
+    if (size > WAL_MAX_RECORD_SIZE) break;
+    if (size > payload_cap) {
+      uint8_t* grown = realloc(payload, size);
+      if (grown == NULL) break;
+      payload = grown;
+      payload_cap = size;
+    }
+    if (fread(payload, 1, size, file) != size || crc32(payload, size) != header[1]) break;
+
+    WalRecord record;
+    char hashed_password[HASHED_PASSWORD_SIZE];
+    if (!decode_payload(payload, size, &record, hashed_password)) break;
+    apply(&record);
+    free((char*)record.username);
+    free((WalSeat*)record.seats);
+
+    offset += WAL_HEADER_SIZE + size;
+    n_records++;
+  }
+
+  // 끝이 잘린 레코드는 응답이 나가지 않은 것이므로 버린다
+  fseeko(file, 0, SEEK_END);
+  off_t file_size = ftello(file);
+  fclose(file);
+  free(payload);
+  if (file_size > (off_t)offset) {
+    fprintf(stderr, "wal: dropping %lld torn bytes at offset %llu\n",
+            (long long)(file_size - offset), (unsigned long long)offset);
+    if (truncate(path, offset) < 0) {
+      perror("wal truncate");
+      return false;
+    }
+  }
+  fprintf(stderr, "wal: replayed %zu records from %s\n", n_records, path);
+  return true;
+}
+
+static void write_all(const uint8_t* p, size_t n) {
+  while (n > 0) {
+    ssize_t n_written = write(wal.fd, p, n);
+    if (n_written < 0) {
+      if (errno == EINTR) continue;
+      // 응답을 기다리는 연결이 있으므로 계속할 수 없다
+      perror("wal write");
+      exit(EXIT_FAILURE);
+    }
+    p += n_written;
+    n -= n_written;
+  }
+}
+
+static void* wal_thread_func(void* arg) {
+  while (true) {
+    pthread_mutex_lock(&wal.mutex);
+    while (wal.len == 0 && !wal.stopping) {
+      pthread_cond_wait(&wal.wake, &wal.mutex);
+    }
+    if (wal.len == 0) {
+      pthread_mutex_unlock(&wal.mutex);
+      break;
+    }
+    bool stopping = wal.stopping;
+    pthread_mutex_unlock(&wal.mutex);
+
+    // 첫 레코드가 들어온 뒤 창만큼 더 모은다
+    if (wal.window_us > 0 && !stopping) {
+      struct timespec delay = {.tv_sec = wal.window_us / 1000000,
+                               .tv_nsec = (wal.window_us % 1000000) * 1000L};
+      nanosleep(&delay, NULL);
+    }
+
+    LOCKPROF_LOCK(&wal.mutex, LOCK_SITE_WAL_FLUSH);
+    uint8_t* batch = wal.buffer;
+    size_t batch_len = wal.len;
+    size_t batch_cap = wal.cap;
+    uint64_t batch_lsn = wal.appended_lsn;
+    wal.buffer = wal.spare;
+    wal.cap = wal.spare_cap;
+    wal.len = 0;
+    LOCKPROF_UNLOCK(&wal.mutex, LOCK_SITE_WAL_FLUSH);
+
+    write_all(batch, batch_len);
+    if (fdatasync(wal.fd) < 0) {
+      // fsync 가 실패한 뒤의 페이지 캐시는 믿을 수 없다
+      perror("wal fdatasync");
+      exit(EXIT_FAILURE);
+    }
+
+    LOCKPROF_LOCK(&wal.mutex, LOCK_SITE_WAL_FLUSH);
+    wal.spare = batch;
+    wal.spare_cap = batch_cap;
+    atomic_store(&wal.durable_lsn, batch_lsn);
+    pthread_cond_broadcast(&wal.durable);
+    LOCKPROF_UNLOCK(&wal.mutex, LOCK_SITE_WAL_FLUSH);
+
+    if (wal.on_durable != NULL) wal.on_durable();
+  }
+  return NULL;
+}
+
+bool wal_start(const char* path, WalMode mode, uint32_t window_us,
+               void (*on_durable)(void)) {
+  if (mode == WAL_MODE_OFF) return true;
+  pthread_once(&crc_once, crc_init);
+
+  wal.fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (wal.fd < 0) {
+    perror("wal open");
+    return false;
+  }
+  off_t end = lseek(wal.fd, 0, SEEK_END);
+  wal.buffer = malloc(WAL_BUFFER_INITIAL_SIZE);
+  wal.spare = malloc(WAL_BUFFER_INITIAL_SIZE);
+  if (end < 0 || wal.buffer == NULL || wal.spare == NULL) {
+    free(wal.buffer);
+    free(wal.spare);
+    close(wal.fd);
+    wal.fd = -1;
+    return false;
+  }
+  wal.cap = wal.spare_cap = WAL_BUFFER_INITIAL_SIZE;
+  wal.len = 0;
+  wal.mode = mode;
+  wal.window_us = window_us;
+  wal.on_durable = on_durable;
+  wal.appended_lsn = end;
+  atomic_store(&wal.durable_lsn, end);
+
+  if (pthread_create(&wal.thread, NULL, wal_thread_func, NULL) != 0) {
+    perror("pthread_create (wal)");
+    close(wal.fd);
+    wal.fd = -1;
+    return false;
+  }
+  atomic_store(&wal.enabled, true);
+  return true;
+}
+
+void wal_stop(void) {
+  if (!atomic_load(&wal.enabled)) return;
+  pthread_mutex_lock(&wal.mutex);
+  wal.stopping = true;
+  pthread_cond_signal(&wal.wake);
+  pthread_mutex_unlock(&wal.mutex);
+  pthread_join(wal.thread, NULL);
+
+  atomic_store(&wal.enabled, false);
+  close(wal.fd);
+  wal.fd = -1;
+  free(wal.buffer);
+  free(wal.spare);
+  wal.buffer = wal.spare = NULL;
+}
+
+uint64_t wal_append(const WalRecord* record) {
+  if (!atomic_load_explicit(&wal.enabled, memory_order_relaxed)) return 0;
+
+  size_t payload_size = record_payload_size(record);
+  size_t size = WAL_HEADER_SIZE + payload_size;
+
+  LOCKPROF_LOCK(&wal.mutex, LOCK_SITE_WAL_APPEND);
+  if (wal.len + size > wal.cap) {
+    size_t cap = wal.cap * 2;
+    while (cap < wal.len + size) cap *= 2;
+    uint8_t* grown = realloc(wal.buffer, cap);
+    if (grown == NULL) {
+      LOCKPROF_UNLOCK(&wal.mutex, LOCK_SITE_WAL_APPEND);
+      perror("wal buffer");
+      exit(EXIT_FAILURE);
+    }
+    wal.buffer = grown;
+    wal.cap = cap;
+  }
+
+  uint8_t* header = wal.buffer + wal.len;
+  uint8_t* payload = header + WAL_HEADER_SIZE;
+  encode_payload(payload, record);
+  put_u32(put_u32(header, payload_size), crc32(payload, payload_size));
+  bool was_empty = wal.len == 0;
+  wal.len += size;
+  wal.appended_lsn += size;
+  uint64_t lsn = wal.appended_lsn;
+  if (was_empty) pthread_cond_signal(&wal.wake);
+  LOCKPROF_UNLOCK(&wal.mutex, LOCK_SITE_WAL_APPEND);
+
+  return wal.mode == WAL_MODE_SYNC ? lsn : 0;
+}
+
+uint64_t wal_appended_lsn(void) {
+  pthread_mutex_lock(&wal.mutex);
+  uint64_t lsn = wal.appended_lsn;
+  pthread_mutex_unlock(&wal.mutex);
+  return lsn;
+}
+
+void wal_wait_durable(uint64_t lsn) {
+  pthread_mutex_lock(&wal.mutex);
+  while (atomic_load(&wal.durable_lsn) < lsn && wal.fd >= 0) {
+    pthread_cond_wait(&wal.durable, &wal.mutex);
+  }
+  pthread_mutex_unlock(&wal.mutex);
+}
+
+void wal_discard_before(uint64_t lsn) {
+  if (!atomic_load(&wal.enabled)) return;
+  // 파일 위치가 곧 LSN 이므로 크기는 그대로 두고 블록만 돌려준다 (한계는 wal.h)
+  off_t length = lsn & ~(uint64_t)(WAL_DISCARD_ALIGN - 1);
+  if (length > 0 &&
+      fallocate(wal.fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0, length) < 0 &&
+      errno != EOPNOTSUPP) {
+    perror("wal fallocate");
+  }
+}
+
+uint64_t wal_durable_lsn(void) {
+  return atomic_load(&wal.durable_lsn);
+}
+
+bool wal_enabled(void) {
+  return atomic_load_explicit(&wal.enabled, memory_order_relaxed);
+}
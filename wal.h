@@ -0,0 +1,87 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 예약/취소/유저 등록을 파일 끝에 덧붙이는 write-ahead log.
+//
+// 워커는 wal_append 로 레코드를 메모리 버퍼에 붙이기만 하고, 전용 writer 스레드가
+// 쌓인 레코드를 한 번의 write + fdatasync 로 내보낸다 (group commit). 동기 모드에서
+// 워커는 wal_append 가 돌려준 위치(LSN) 가 wal_durable_lsn 이하가 될 때까지
+// 그 연결의 응답을 내보내지 않는다.
+//
+// 파일의 레코드: size(u32) crc32(u32) payload[size]
+//   payload: type(u8) pad(3) user_id(u32) 다음에
+//     REGISTER:     username_length(u32) username hashed_password[HASHED_PASSWORD_SIZE]
+//     BOOK/CANCEL:  event_id(u32) n_seats(u32) (seat_id(u32) version(u32)) * n_seats
+// BOOK_MANY 는 좌석 여러 개를 한 레코드에 담으므로 끝이 잘려도 일부만 남지 않는다.
+// version 은 바뀐 뒤의 좌석 owner 버전이다. 레코드가 파일에 붙는 순서와 좌석이
+// 바뀐 순서가 다를 수 있으므로 재생할 때는 좌석마다 가장 큰 버전을 따른다.
+// 정수는 호스트 바이트 순서.
+
+typedef enum {
+  WAL_MODE_OFF,    // 로그를 쓰지 않는다
+  WAL_MODE_ASYNC,  // 로그는 쓰지만 응답은 fsync 를 기다리지 않는다 (마지막 창만큼 잃을 수 있음)
+  WAL_MODE_SYNC,   // 응답은 그 레코드를 덮는 fsync 가 끝난 뒤에 나간다
+} WalMode;
+
+typedef enum {
+  WAL_RECORD_REGISTER = 1,
+  WAL_RECORD_BOOK = 2,
+  WAL_RECORD_CANCEL = 3,
+} WalRecordType;
+
+typedef struct {
+  uint32_t seat_id;
+  uint32_t version;
+} WalSeat;
+
+typedef struct {
+  WalRecordType type;
+  uint32_t user_id;
+  // REGISTER
+  const char* username;
+  const char* hashed_password;
+  // BOOK / CANCEL
+  uint32_t event_id;
+  uint32_t n_seats;
+  const WalSeat* seats;
+} WalRecord;
+
+// path 의 로그를 start_lsn (스냅샷이 덮는 위치, 없으면 0) 부터 읽어 레코드마다
+// apply 를 부른다. 끝이 잘린 (crc 가 맞지 않는) 레코드를 만나면 그 앞에서 파일을
+// 잘라 낸다. 파일이 없으면 아무것도 하지 않는다. 읽을 수 없으면 false.
+bool wal_replay(const char* path, uint64_t start_lsn,
+                void (*apply)(const WalRecord* record));
+
+// 로그를 이어 쓰기로 열고 writer 스레드를 띄운다. window_us 는 첫 레코드가
+// 들어온 뒤 더 모아서 함께 fsync 할 시간이다 (0 이면 fsync 가 도는 동안 쌓인
+// 만큼만 묶는다). fsync 가 끝날 때마다 writer 스레드에서 on_durable 을 부른다.
+bool wal_start(const char* path, WalMode mode, uint32_t window_us,
+               void (*on_durable)(void));
+// 버퍼에 남은 레코드를 내보내고 writer 스레드를 끝낸다.
+void wal_stop(void);
+
+// 레코드를 붙이고 응답이 기다려야 할 LSN 을 돌려준다.
+// 로그가 꺼져 있거나 비동기 모드면 0 (기다릴 필요 없음).
+uint64_t wal_append(const WalRecord* record);
+uint64_t wal_durable_lsn(void);
+bool wal_enabled(void);
+
+// 스냅샷용
+// 지금까지 붙은 레코드의 끝 위치 (fsync 여부와 상관없이)
+uint64_t wal_appended_lsn(void);
+// lsn 까지 fsync 될 때까지 기다린다
+void wal_wait_durable(uint64_t lsn);
+// lsn 앞부분의 디스크 블록을 돌려준다 (파일 크기와 위치는 그대로).
+// 위치가 곧 LSN 이고 스냅샷이 그 위치를 기억하므로 로그는 돌려 쓰지 않는다.
+// 디스크는 로그 꼬리만큼만 쓰지만 파일의 논리 크기는 쓴 레코드 전체만큼 계속
+// 자라, 파일 시스템의 최대 파일 크기가 로그 전체의 한계다 (ext4 4K 블록이면
+// 16 TiB: 좌석 하나짜리 BOOK 레코드 32 바이트를 초당 10만 건 쓰면 약 60 일).
+// 넘으면 write 가 EFBIG 으로 실패해 서버가 멈춘다. 더 오래 돌리려면 로그를
+// 세그먼트 파일로 나눠야 한다.
+void wal_discard_before(uint64_t lsn);
+
+#endif